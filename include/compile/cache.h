@@ -0,0 +1,41 @@
+#pragma once
+#include "compile/project.h"
+#include "univ/iff.h"
+
+/*
+ * The compile cache saves each compiled module to a file named by a key, so a module that hasn't
+ * changed can skip parsing and compiling.
+ *
+ * A module's key is a SHA-256 hash of the compiler key, the module's ID and source (or object file,
+ * for a precompiled module), and the keys of the modules it imports. Compiled code refers to imports
+ * by their IDs and export positions, so a change to an import (or to the build order) changes the
+ * key of every module that depends on it. Keys must be computed in build order.
+ *
+ * A cache file is an IFF form of type 'CMOD', stored in host byte order:
+ *
+ * - 'CODE': Bytecode
+ * - 'SRCS': Source positions, as (position, byte count) pairs for each part of the code
+ * - 'SYMS': Names of the symbols used in the module, for the program's string table
+ * - 'EXPT': Names of the module's exports
+ */
+
+/* A hash of the compiler version, value size and primitive table, which compiled code depends on */
+void CompilerKey(u8 key[32]);
+
+void ModuleCacheKey(Module *mod, Project *project);
+bool ReadCachedModule(Module *mod, char *cache_path); /* returns whether the module was found */
+void WriteCachedModule(Module *mod, char *cache_path);
+
+/*
+ * Object files (see "object.h") start with the same fields as a cache file, so these helpers are
+ * shared. Loading a module's code also pushes its exports onto its AST.
+ */
+
+bool ValidModuleFile(IFFChunk *form, u32 file_size, u32 form_type);
+IFFChunk *GetModuleField(IFFChunk *form, u32 index, u32 type, u32 unit); /* 0 if invalid */
+bool LoadModuleCode(Module *mod, IFFChunk *form);
+u32 *LoadNames(char *names, u32 size, u32 *symbols);
+IFFChunk *SerializeModuleCode(Module *mod, u32 form_type);
+IFFChunk *AppendField(IFFChunk *form, u32 type, void *data, u32 size);
+void PushName(char **names, u32 sym);
+bool WriteModuleFile(IFFChunk *form, char *filename); /* through a temporary file */
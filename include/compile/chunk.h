@@ -6,7 +6,16 @@
  *
  * A chunk is a linked list, but logically represents the code in the entire list. `needs_env` and
  * `modifies_env` should represent all chunks, and functions to append or emit chunks work on chunk
- * lists as a whole.
+ * lists as a whole. The first chunk in a list also keeps the list's total size and last chunk, so
+ * these don't walk the list. Once a list is appended to another, it should only be used through the
+ * other list.
+ *
+ * Like AST nodes, chunks and their data are allocated from the thread's local arena, and are freed
+ * with it.
+ *
+ * A module's ID depends on the build order, so a chunk that refers to one starts with a `const`
+ * instruction whose argument is ModuleRefSize bytes, and `module_ref` is the module's name. This
+ * lets a precompiled module be relocated when it's linked (see "object.h").
  */
 
 typedef struct Chunk {
@@ -14,13 +23,19 @@ typedef struct Chunk {
   bool needs_env;
   bool modifies_env;
   u32 src;
+  u32 module_ref;
+  u32 size; /* of the whole list */
+  struct Chunk *last; /* of the whole list */
   struct Chunk *next;
 } Chunk;
 
+#define ModuleRefSize 4
+
 Chunk *NewChunk(u32 src);
-void FreeChunk(Chunk *chunk);
 void Emit(u8 byte, Chunk *chunk);
 void EmitInt(u32 num, Chunk *chunk);
+void EmitPaddedInt(u32 num, u32 size, Chunk *chunk);
+void EmitBytes(u8 *bytes, u32 size, Chunk *chunk);
 u32 ChunkSize(Chunk *chunk);
 Chunk *PrependChunk(u8 byte, Chunk *chunk);
 Chunk *AppendChunk(Chunk *first, Chunk *second);
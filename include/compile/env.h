@@ -3,7 +3,8 @@
 
 /*
  * An Env keeps track of variables currently in scope during compilation. Each item in the env is
- * the symbol of the variable and an optional constant value.
+ * the symbol of the variable and an optional constant value. Env frames are allocated from the
+ * thread's local arena, so popping a frame doesn't free it.
  */
 
 typedef struct {
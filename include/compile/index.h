@@ -0,0 +1,36 @@
+#pragma once
+#include "univ/hashmap.h"
+
+/*
+ * The module index remembers the header of each source file it has seen, so a project can build
+ * its module map without reading files that haven't changed.
+ *
+ * An entry is keyed by the file's path, and is only valid while the file's modification time and
+ * size match. The header is the start of the file up to the end of its imports, which parses to
+ * the same module name and imports (at the same positions) as the whole file.
+ *
+ * The index file is an IFF form of type 'MIDX', stored in host byte order, with one 'MODL' field
+ * per file: the modification time (as two u32s, low first), the size, the null-terminated path,
+ * and the header text.
+ */
+
+typedef struct {
+  char *path;
+  u64 mtime;
+  u32 size;
+  char *header;
+} IndexEntry;
+
+typedef struct {
+  IndexEntry *entries; /* vec */
+  HashMap map; /* path hash -> entry */
+  bool changed;
+} ModuleIndex;
+
+void LoadModuleIndex(ModuleIndex *index, char *cache_path);
+void SaveModuleIndex(ModuleIndex *index, char *cache_path); /* only writes if changed */
+void DestroyModuleIndex(ModuleIndex *index);
+
+/* Returns the indexed header of a file, or 0 if it isn't indexed or has changed */
+char *IndexedHeader(ModuleIndex *index, char *path, u64 mtime, u32 size);
+void IndexModule(ModuleIndex *index, char *path, u64 mtime, u32 size, char *header, u32 len);
@@ -1,6 +1,14 @@
 #pragma once
+#include "univ/vec.h"
 
-/* The lexer produces tokens by scanning some source input. */
+/*
+ * The lexer produces tokens by scanning some source input. Characters are classified by table, and
+ * keywords are found with a perfect hash.
+ *
+ * A token list keeps the tokens lexed from a text so far, so a text is only lexed once, even when
+ * it's parsed more than once (a module's header, then the whole module). The list ends with the
+ * first token that doesn't advance: the end of the text, or an unrecognized character.
+ */
 
 typedef enum {
   eofToken,
@@ -71,5 +79,17 @@ typedef struct {
   u32 length;
 } Token;
 
+typedef struct {
+  char *text; /* borrowed */
+  Token *tokens; /* vec */
+} TokenList;
+
 Token NextToken(char *src, u32 pos);
 bool IsKeyword(TokenType type);
+
+void InitTokenList(TokenList *list, char *text);
+void DestroyTokenList(TokenList *list);
+/* Returns the token at an index, or the last token if the list ends before it */
+#define TokenAt(list, i) \
+  ((i) < VecCount((list)->tokens) ? (list)->tokens[i] : LexTokens(list, i))
+Token LexTokens(TokenList *list, u32 index); /* lexes up to the token at index */
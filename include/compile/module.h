@@ -1,6 +1,8 @@
 #pragma once
 #include "compile/chunk.h"
+#include "compile/lex.h"
 #include "compile/node.h"
+#include "univ/arena.h"
 #include "univ/hashmap.h"
 
 /* A Module keeps track of a module's various components. */
@@ -9,9 +11,17 @@ typedef struct Module {
   u32 id;
   char *filename;
   char *source;
+  TokenList tokens; /* lexed while parsing the header, and kept until the module is parsed */
   ASTNode *ast;
   Chunk *code;
   HashMap exports;
+  u32 *symbols; /* vec; symbols used in the module, for the program's string table */
+  u8 cache_key[32];
+  bool cached; /* code was loaded, not compiled, so ast only has the name, imports and exports */
+  bool precompiled; /* loaded from an object file, so code must be relocated (see "object.h") */
+  u32 *relocs; /* vec; (code offset, module) pairs, where module 0 is this one and n is import n-1 */
+  u32 *import_keys; /* vec; the exports key each import was compiled against */
+  Arena arena; /* holds the module's AST and code, which is set as the local arena to build them */
 } Module;
 #define ModuleName(mod) NodeChild((mod)->ast, 0)
 #define ModuleImports(mod) NodeChild((mod)->ast, 1)
@@ -3,7 +3,8 @@
 #include "univ/vec.h"
 
 /*
-An ASTNode is a node parsed from text.
+An ASTNode is a node parsed from text. Nodes are allocated from the thread's local arena (see
+"univ/arena.h"), so they're never freed individually; a module's nodes are freed with its arena.
 
 Node structures:
 
@@ -70,12 +71,16 @@ typedef enum {
   moduleNode
 } NodeType;
 
-typedef struct {
-  u32 name;
-  u32 value;
+/* Attributes the parser annotates nodes with. Each node has a slot for every attribute, and a bit
+ * set of which ones are set. */
+typedef enum {
+  opCodeAttr,     /* opNode: the op to emit */
+  indexAttr,      /* assignNode, defNode: the variable's index in its scope */
+  numAssignsAttr, /* doNode: number of assigns and defs, which come first */
+  guardAttr,      /* ifNode: the node is a guard clause */
+  numNodeAttrs
 } NodeAttr;
 
-
 typedef struct ASTNode {
   NodeType nodeType;
   u32 start;
@@ -84,27 +89,26 @@ typedef struct ASTNode {
     u32 value;
     struct ASTNode **children; /* vec */
   } data;
-  NodeAttr *attrs; /* vec */
+  u8 attrBits;
+  u32 attrs[numNodeAttrs];
 } ASTNode;
 #define IsErrorNode(n)  ((n)->nodeType == errorNode)
 #define NodeCount(n)    VecCount((n)->data.children)
 #define NodeChild(n,i)  ((n)->data.children[i])
 #define NodeValue(n)    ((n)->data.value)
 #define IsNodeFalse(n)   \
-  ((n)->nodeType == nilNode || ((n)->nodeType == intNode && RawInt(NodeValue(n)) == 0))
+  ((n)->nodeType == nilNode || ((n)->nodeType == intNode && ConstInt(NodeValue(n)) == 0))
 
 ASTNode *NewNode(NodeType type, u32 start, u32 end, u32 value);
 #define ErrorNode(msg, start, end) NewNode(errorNode, start, end, Symbol(msg))
 ASTNode *CloneNode(ASTNode *node);
 ASTNode *WrapNode(ASTNode *node, NodeType type);
-void FreeNode(ASTNode *node);
-void FreeNodeShallow(ASTNode *node);
 bool IsTerminal(ASTNode *node);
 bool IsConstNode(ASTNode *node);
 void NodePush(ASTNode *node, ASTNode *child);
-void SetNodeAttr(ASTNode *node, char *name, u32 value);
-bool NodeHasAttr(ASTNode *node, char *name);
-u32 GetNodeAttr(ASTNode *node, char *name);
+#define SetNodeAttr(n,a,v)  ((n)->attrBits |= 1 << (a), (n)->attrs[a] = (v))
+#define NodeHasAttr(n,a)    (((n)->attrBits & (1 << (a))) != 0)
+#define GetNodeAttr(n,a)    ((n)->attrs[a]) /* 0 if not set */
 
 ASTNode *SimplifyNode(ASTNode *node, Env *env);
 
@@ -0,0 +1,38 @@
+#pragma once
+#include "compile/project.h"
+
+/*
+ * An object file holds a precompiled module, so it can be linked into a program without being
+ * parsed or compiled. `cassette -o folder` precompiles each module in a folder, writing an object
+ * file next to each source file. A project uses an object file in place of its source file when the
+ * source is gone or unchanged since it was compiled: it has the same size and mtime, and if it was
+ * modified in the second the object file was written, the same hash. The entry file is always
+ * compiled.
+ *
+ * Compiled code refers to modules by their IDs, which depend on the build order. So each module ID
+ * is a fixed size (see "chunk.h"), and an object file has a list of where they are, to be rewritten
+ * by LinkModules. Symbols are hashes of their names, so they don't need to be relocated; the object
+ * file just has their names, for the string table.
+ *
+ * Code also refers to an import's exports by position, so each import's exports key (a hash of its
+ * export names) is kept. When an import's exports have changed, the module is compiled from its
+ * source instead, and it's an error only if there's no source.
+ *
+ * An object file is an IFF form of type 'COBJ', stored in host byte order. It starts with the fields
+ * of a cache file (see "cache.h"), followed by:
+ *
+ * - 'VERS': The compiler key (see "cache.h")
+ * - 'NAME': The module's name
+ * - 'SRCS': The source file's mtime, size, and SHA-256 hash
+ * - 'IMPT': Names of the modules it imports
+ * - 'IKEY': The exports key of each import
+ * - 'RELC': Module IDs in the code, as (position, module) pairs, where module 0 is this module and
+ *           module n is import n-1
+ */
+
+#define OBJECT_EXT ".cto"
+
+bool ReadModuleObject(Module *mod); /* returns whether an up-to-date object file was found */
+Error *WriteModuleObject(Module *mod, Project *project);
+Error *CheckModuleObject(Module *mod, Project *project);
+void RelocateModule(Module *mod, u8 *code, Project *project);
@@ -4,9 +4,16 @@
  * These options control how a program is compiled and run.
  *
  * `debug` controls whether the VM will trace its execution.
+ * `snapshot` runs a program's imported modules, then saves a snapshot to resume later.
+ * `precompile` compiles each module in the folder `entry` to an object file (see "object.h").
  * `lib_path` is a folder to scan for files to add to a project.
  * `entry` is the filename of the entry module.
  * `default_imports` is a list of modules to automatically import.
+ * `gc_pause` is a pause target in microseconds for incremental garbage collection (0 to collect all
+ * at once).
+ * `heap_profile` is a sampling interval in bytes for the heap profiler (0 to disable).
+ * `mem_limit` is the most memory the heap may use, in megabytes (0 for no limit).
+ * `cache_path` is a folder for the compile cache (0 to disable).
  */
 
 #define VERSION_MAJOR   3
@@ -16,11 +23,17 @@
 typedef struct {
   bool debug;
   bool compile;
+  bool snapshot;
+  bool precompile;
   char *lib_path;
   char *entry;
   char *manifest;
   char *source_ext;
   char **program_args; /* vec */
+  u32 gc_pause;
+  u32 heap_profile;
+  u32 mem_limit;
+  char *cache_path;
 } Opts;
 
 Opts *DefaultOpts(void);
@@ -8,13 +8,15 @@
 
 typedef struct {
   char *text; /* borrowed */
+  TokenList *tokens; /* borrowed */
+  u32 index;
   Token token;
 } Parser;
 
-void InitParser(Parser *p, char *text);
+void InitParser(Parser *p, TokenList *tokens);
 
-ASTNode *ParseModule(char *source);
-ASTNode *ParseModuleHeader(char *source);
+ASTNode *ParseModule(TokenList *tokens);
+ASTNode *ParseModuleHeader(TokenList *tokens);
 ASTNode *ParseImportList(Parser *p);
 
 Grammar *CassetteGrammar(void);
@@ -10,11 +10,21 @@
  * these steps:
  *
  * 1. All project files are parsed up to their module name and imports to generate a module map.
+ *    Files that haven't changed since the last build aren't read unless they're in the build list,
+ *    since their headers come from the module index (see "index.h"). A file with an up-to-date
+ *    object file is loaded from that instead (see "object.h").
  * 2. Starting with the entry file, a build list is constructed of only the imported modules, in
  *    order of dependency.
- * 3. Each module in the build list is parsed and compiled.
+ * 3. Each module in the build list is parsed and compiled, unless it was precompiled or it's found
+ *    in the compile cache (see "cache.h").
  * 4. The compiled modules are linked into a Program in order of dependency. Each module is executed
  *    before the modules that import it. The entry module is executed last.
+ *
+ * Steps 1 and 3 run in parallel, one module per task. Modules are compiled after every module in
+ * the build list is parsed, since compiling a module needs its imports' exports.
+ *
+ * When precompiling, every named module is in the build list, and instead of linking, each one is
+ * written to an object file.
  */
 
 typedef struct {
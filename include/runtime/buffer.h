@@ -0,0 +1,22 @@
+#pragma once
+#include "runtime/mem.h"
+
+/*
+ * Buffers are growable binaries, for building output a piece at a time.
+ *
+ * A buffer is a tuple record {:Buffer, length, data}, where `data` is a binary with room for at
+ * least `length` bytes. When an append doesn't fit, the data is copied into a binary twice as
+ * large, so appending takes amortized constant time. Finishing a buffer shrinks its data to its
+ * length in place and returns it, and retires the buffer. A retired buffer's data is nil.
+ *
+ * These functions reserve the memory they need before reading their arguments, so their arguments
+ * don't need to be on the stack.
+ */
+
+bool IsBuffer(val value);
+val NewBuffer(u32 capacity); /* may GC */
+u32 BufferLength(val buffer);
+bool BufferFinished(val buffer);
+val BufferWrite(val buffer, val iolist); /* may GC; returns the buffer */
+val BufferWriteInt(val buffer, ival value, u32 size, bool little_endian); /* may GC; returns the buffer */
+val FinishBuffer(val buffer); /* may GC */
@@ -0,0 +1,22 @@
+#pragma once
+#include "runtime/mem.h"
+
+/*
+ * Builders construct a tuple, binary or map in place, without copying it for each change.
+ *
+ * A builder is a tuple record {:Builder, kind, value}, where `kind` is :tuple, :binary or :map. A
+ * tuple or binary builder holds the object being filled, which is allocated at its final length. A
+ * map builder holds a list of the entries put so far, newest first, which are loaded into a map in
+ * one pass when it's frozen.
+ *
+ * Freezing a builder returns its value and retires the builder, so nothing can change the value
+ * afterwards. A retired builder's kind is nil.
+ */
+
+bool IsBuilder(val value);
+val BuilderKind(val builder); /* nil once frozen */
+u32 BuilderLength(val builder); /* tuples and binaries */
+val NewBuilder(val kind, u32 length); /* may GC; length is ignored for maps */
+void BuilderSet(val builder, u32 index, val value); /* tuples and binaries; index must be checked */
+val BuilderPut(val builder, val key, val value); /* may GC; maps; returns the builder */
+val FreezeBuilder(val builder); /* may GC */
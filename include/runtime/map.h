@@ -0,0 +1,31 @@
+#pragma once
+#include "runtime/mem.h"
+
+/*
+ * Persistent maps, stored as hash array mapped tries (HAMTs) of tuples.
+ *
+ * A map is a tuple record {:Map, count, root}. Each node of the trie holds up to 32 slots, chosen
+ * by 5 bits of the key's hash, and a 32-bit bitmap of which slots are present. Only the present
+ * slots are stored, in order, so a slot's position is the popcount of the bitmap below it. A slot
+ * is either an entry, a pair (key : value), or a child node for the next 5 bits of the hash. Keys
+ * that share every hash bit are kept in a collision node below the last level, a tuple of entries.
+ *
+ * A node is a tuple {low, high, slots...}, where `low` and `high` are integers holding the low and
+ * high 16 bits of the bitmap, since an integer can't hold all 32. A node other than the root never
+ * holds a single entry: it's replaced by the entry. So a map's shape only depends on its keys, and
+ * equal maps are usually equal values.
+ *
+ * Keys are compared with ValEq. These functions reserve the memory they need before reading their
+ * arguments, so their arguments don't need to be on the stack.
+ */
+
+bool IsMap(val value);
+val NewMap(void); /* may GC */
+val ListToMap(val list); /* may GC; later (key : value) entries replace earlier ones */
+val StackToMap(val list); /* may GC; earlier entries replace later ones */
+u32 MapCount(val map);
+bool MapContains(val map, val key);
+val MapGet(val map, val key, val missing);
+val MapPut(val map, val key, val value); /* may GC */
+val MapDelete(val map, val key); /* may GC */
+val MapEntries(val map); /* may GC; returns a list of (key : value) entries */
@@ -8,27 +8,63 @@
  * header. Tuple and binary headers should only appear in the heap. An object value is considered to
  * "be" a pair, tuple, or binary if that's what it points to.
  *
+ * When built with WIDE_VALUES, values (and heap cells) are 64 bits long instead, so integers have
+ * 62 bits; object indexes are still limited to 32 bits. Runtime code should hold values in the
+ * `val` type. Constants in bytecode are always encoded as 32-bit values, which a wide VM
+ * sign-extends, so a compiled program runs with either width; the compiler works in that form,
+ * with ConstInt and MaxConstInt. Symbols are small enough to be constants.
+ *
  * A tuple header contains the count of its items, followed by the items. A binary header contains
- * its length in bytes, followed by its binary data. Since heap space is allocated in 32-bit cells,
- * a binary is padded to the next cell boundary.
+ * its length in bytes, followed by its binary data. Since heap space is allocated in cells, a
+ * binary is padded to the next cell boundary. After its data, a binary has one more cell to cache
+ * its hash; the top bit of the binary header's length is set once the cache is filled.
+ *
+ * When the collector copies a list, its spine is cdr-coded: its pairs are laid out one after
+ * another, and a bit in a side bitmap marks a pair whose tail is the next cell, so the pair takes
+ * one cell instead of two. Lists are built with ordinary pairs. The last pair of a run is a normal pair. Since the tail isn't
+ * stored, a cdr-coded pair's tail can't be read through a raw cell pointer; use Tail.
  *
  * Values can be stored on the stack, and objects can be created in the heap. If there isn't enough
  * space, garbage is collected and the heap is potentially resized.
  *
  * Before calling any function that may collect garbage, all live objects (except the function
  * arguments) must be on the stack, in the heap, or in the root values. Those objects must be read
- * back after the call, since their values may have changed.
+ * back after the call, since their values may have changed. Code that builds several objects at
+ * once can instead reserve room for all of them with ReserveMem, after which it won't GC.
+ *
+ * By default, garbage is collected all at once when the heap fills up. With a pause target set,
+ * collection is incremental: it's spread across allocations in small steps, and GCStep can do
+ * extra work during idle time. In that mode, objects may only be read with the heap accessors
+ * (Head, Tail, TupleGet), never through raw cell pointers.
+ *
+ * Copying needs a second space as big as the heap. When that can't be allocated, or the heap is
+ * over half of the memory limit, garbage is instead compacted in place. If the heap still can't
+ * fit an allocation (or even at the memory limit it would be nearly full), it's made from a small
+ * reserve and MemExhausted becomes true, so the VM can stop with an error. A later collection
+ * that frees enough clears it.
  */
 
 enum {objType, intType, tupleHdr, binHdr};
 
+#ifdef WIDE_VALUES
+typedef u64 val;
+typedef i64 ival;
+#define valSize         64
+#else
+typedef u32 val;
+typedef i32 ival;
+#define valSize         32
+#endif
+
 #define typeBits        2
-#define valBits         (32 - typeBits)
+#define valBits         (valSize - typeBits)
+#define symBits         (32 - typeBits - 1)
 #define typeMask        ((1 << typeBits)-1)
-#define Val(type, x)    (((x) << typeBits) | (type & typeMask))
+#define Val(type, x)    ((((val)(x)) << typeBits) | (type & typeMask))
 #define ValType(x)      ((x) & typeMask)
-#define RawVal(v)       (((u32)(v)) >> typeBits)
-#define RawInt(v)       ((i32)((RawVal(v)^(1<<(valBits-1)))-(1 << (valBits-1))))
+#define RawVal(v)       (((val)(v)) >> typeBits)
+#define RawInt(v)       ((ival)((RawVal(v)^((val)1<<(valBits-1)))-((val)1 << (valBits-1))))
+#define ConstInt(v)     ((i32)(((((u32)(v)) >> typeBits)^(1<<29))-(1 << 29)))
 #define ObjVal(x)       Val(objType, x)
 #define IntVal(x)       Val(intType, x)
 #define TupleHeader(x)  Val(tupleHdr, x)
@@ -36,63 +72,97 @@ enum {objType, intType, tupleHdr, binHdr};
 #define IsType(v,t)     (ValType(v) == (t))
 #define IsObj(v)        IsType(v, objType)
 #define IsInt(v)        IsType(v, intType)
-#define IsSymbol(v)     (IsInt(v) && SymbolName(RawVal(v)))
+#define SymbolValName(v) ((RawVal(v) >> symBits) ? 0 : SymbolName(RawVal(v)))
+#define IsSymbol(v)     (IsInt(v) && SymbolValName(v))
 #define IsTupleHdr(v)   IsType(v, tupleHdr)
 #define IsBinHdr(v)     IsType(v, binHdr)
 #define IsPair(v)       (IsObj(v) && !IsTupleHdr(Head(v)) && !IsBinHdr(Head(v)))
 #define IsTuple(v)      (IsObj(v)  && IsTupleHdr(Head(v)))
 #define IsBinary(v)     (IsObj(v) && IsBinHdr(Head(v)))
-#define MaxIntVal       0x7FFFFFFD
-#define MinIntVal       0x80000001
+#define binHashed       ((val)1 << (valBits - 1))
+#define HdrLength(h)    (RawVal(h) & ~binHashed)
+#define MaxIntVal       IntVal(((val)1 << (valBits - 1)) - 1)
+#define MinIntVal       IntVal((val)1 << (valBits - 1))
+#define MaxConstInt     ((1 << 29) - 1)
 
 typedef struct {
   u32 capacity;
   u32 free;
-  u32 *stack; /* vec */
-  u32 *data;
-  u32 *roots;
+  val *stack; /* vec */
+  val *data;
+  val *roots;
   u32 num_roots;
+  u32 size;       /* cells allocated for data */
+  u32 *cdr;       /* bitmap of pairs whose tail is the next cell */
+  u32 *moved;     /* bitmap of objects forwarded during a collection */
+  bool incremental;
+  u32 base;       /* start of the current space */
+  u32 from_start; /* from-space, during an incremental collection */
+  u32 from_end;
+  u32 scan;
+  u32 uncopied;   /* upper bound on from-space cells left to copy */
+  u32 pause;      /* pause target, in microseconds */
+  u32 quantum;    /* cells scanned per incremental step */
+  u32 debt;
+  u32 live;       /* cells in use after the last incremental collection */
+  bool profile;   /* report allocations and collections to the heap profiler */
+  u32 limit;      /* max cells for data (0 for no limit) */
+  bool exhausted; /* the heap is out of room and allocating from its reserve */
 } Mem;
 
 void InitMem(u32 size);
 void DestroyMem(void);
-void SetMemRoots(u32 *roots, u32 num_roots);
+void SetMemRoots(val *roots, u32 num_roots);
 void CollectGarbage(void);
+void ReserveMem(u32 count); /* may GC; then count cells can be allocated without GC */
+void SetGCPause(u32 pause); /* enables incremental collection, with a pause target in microseconds */
+bool GCStep(u32 budget); /* may GC; returns whether a collection is still in progress */
+void SetMemLimit(u32 megabytes); /* limits the size of the heap (0 for no limit) */
+bool MemExhausted(void); /* whether an allocation has failed */
+void SetMemProfile(bool profile);
+val *HeapImage(u32 *count, u32 **cdr); /* GCs; returns the compacted heap, for snapshots */
+void LoadHeapImage(val *cells, u32 count, u32 *cdr, val *stack, u32 stack_count); /* restores it */
 
-u32 StackPush(u32 value); /* may GC */
-u32 StackPop(void);
-u32 StackPeek(u32 index);
+val StackPush(val value); /* may GC */
+val StackPop(void);
+val StackPeek(u32 index);
 u32 StackSize(void);
 
-u32 Pair(u32 head, u32 tail); /* may GC */
-u32 Head(u32 pair);
-u32 Tail(u32 pair);
+val Pair(val head, val tail); /* may GC */
+val Head(val pair);
+val Tail(val pair);
 
-u32 ObjLength(u32 obj);
+u32 ObjLength(val obj);
 
-u32 Tuple(u32 length); /* may GC */
-u32 TupleGet(u32 tuple, u32 index);
-void TupleSet(u32 tuple, u32 index, u32 value);
-u32 TupleJoin(u32 left, u32 right); /* may GC */
-u32 TupleSlice(u32 tuple, u32 start, u32 end); /* may GC */
+val Tuple(u32 length); /* may GC */
+val TupleGet(val tuple, u32 index);
+void TupleSet(val tuple, u32 index, val value);
+val TupleJoin(val left, val right); /* may GC */
+val TupleSlice(val tuple, u32 start, u32 end); /* may GC */
 
-#define BinSpace(length)  (Align(length, sizeof(u32)) / sizeof(u32))
-u32 NewBinary(u32 length); /* may GC */
-u32 Binary(char *str); /* may GC */
-u32 BinaryFrom(char *data, u32 length); /* may GC */
-char *BinaryData(u32 bin);
-u32 BinaryGet(u32 bin, u32 index);
-void BinarySet(u32 bin, u32 index, u32 value);
-u32 BinaryJoin(u32 left, u32 right); /* may GC */
-u32 BinarySlice(u32 list, u32 start, u32 end); /* may GC */
-bool BinIsPrintable(u32 bin);
-char *BinToStr(u32 bin);
+#define BinSpace(length)  (Align(length, sizeof(val)) / sizeof(val))
+#define BinCells(length)  (Max(1, BinSpace(length)) + 2) /* header, data, hash */
+val NewBinary(u32 length); /* may GC */
+val Binary(char *str); /* may GC */
+val BinaryFrom(char *data, u32 length); /* may GC */
+char *BinaryData(val bin);
+u32 BinaryGet(val bin, u32 index);
+void BinarySet(val bin, u32 index, u32 value);
+val BinaryJoin(val left, val right); /* may GC */
+val BinarySlice(val list, u32 start, u32 end); /* may GC */
+val BinaryTruncate(val bin, u32 length); /* may GC; shrinks the binary in place when it can */
+bool BinIsPrintable(val bin);
+char *BinToStr(val bin);
 
-u32 FormatVal(u32 value); /* may GC */
+/* An iolist is a binary, a byte-sized integer, or a list or tuple of iolists. */
+u32 IOListSize(val value);
+void FormatValTo(val value, char *buf); /* writes IOListSize(value) bytes */
+val FormatVal(val value); /* may GC */
 
-bool ValEq(u32 a, u32 b);
-u32 HashVal(u32 a);
-char *MemValStr(u32 value);
+bool ValEq(val a, val b);
+i32 CompareVal(val a, val b); /* orders nil, integers, symbols, binaries, tuples, then pairs */
+val HashVal(val a);
+char *MemValStr(val value);
 
 #ifdef DEBUG
 void DumpMem(void);
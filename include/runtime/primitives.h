@@ -9,13 +9,14 @@
  * reverse order.
  */
 
-typedef u32 (*PrimFn)(VM *vm);
+typedef val (*PrimFn)(VM *vm);
 
 typedef struct {
   char *name;
   PrimFn fn;
 } PrimDef;
 
+u32 NumPrimitives(void);
 i32 PrimitiveID(u32 name);
 char *PrimitiveName(u32 id);
 PrimFn PrimitiveFn(u32 id);
@@ -0,0 +1,23 @@
+#pragma once
+#include "runtime/mem.h"
+#include "runtime/source_map.h"
+
+/*
+ * The heap profiler attributes allocations to the code address that made them. To keep overhead
+ * low, allocations are sampled: about once every `interval` bytes, the allocation being made is
+ * recorded, standing in for all the bytes allocated since the last sample.
+ *
+ * Sampled objects are followed through garbage collections. An object that survives a collection
+ * counts toward its site's survived bytes, and an object that no collection has freed yet counts
+ * toward its retained bytes.
+ *
+ * The report groups sites by source location, and ranks them by bytes allocated and by bytes
+ * retained.
+ */
+
+void StartHeapProfile(u32 interval, u32 *pc);
+void StopHeapProfile(void);
+void ProfileAlloc(u32 index, u32 cells); /* called for each allocation */
+/* called before a collection frees [start, end); relocate gives an object's new index, or 0 */
+void ProfileCollection(u32 start, u32 end, u32 (*relocate)(u32 index));
+void PrintHeapProfile(SourceMap *srcmap);
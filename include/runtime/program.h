@@ -9,6 +9,7 @@
  * `code` is the bytecode instructions.
  * `strings` is a sequence of null-terminated symbols and strings that appear in the program.
  * `srcmap` maps bytecode addresses to source file positions.
+ * `entry` is the address of the entry module's code, which runs after all imported modules.
  *
  * A program can be serialized into a "tape" file, which contains the bytecode and strings. The file
  * format is an IFF form of type 'TAPE'; it has two fields:
@@ -25,6 +26,7 @@ typedef struct {
   u8 *code; /* vec */
   char *strings; /* vec */
   SourceMap srcmap;
+  u32 entry;
 } Program;
 
 Program *NewProgram(void);
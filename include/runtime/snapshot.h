@@ -0,0 +1,26 @@
+#pragma once
+#include "runtime/vm.h"
+
+/*
+ * A snapshot saves a VM's state after a program's imported modules have run, so the program can be
+ * resumed later without re-running module initialization or re-interning its symbols.
+ *
+ * The file format is an IFF form of type 'SNAP'. Unlike a tape, the fields are stored uncompressed
+ * and in host byte order, so they can be copied straight out of a memory-mapped file:
+ *
+ * - 'VERS': Version (big-endian, as in a tape)
+ * - 'REGS': Byte order mark, value width, pc, link, and the VM registers
+ * - 'CODE': Bytecode
+ * - 'NAME': Symbol name block
+ * - 'SYMS': Symbol table, as (symbol, offset) pairs
+ * - 'STAK': Stack values
+ * - 'HEAP': Heap cells, from a freshly-collected heap
+ * - 'CDRS': The heap's cdr-coding bitmap, a bit per heap cell (see "mem.h")
+ * - 'FMAP': The source map's file map, as (filename, length) pairs (see "source_map.h")
+ * - 'PMAP': The source map's position map, as (pos, length) pairs
+ *
+ * A snapshot can only be resumed on a machine with the same byte order and value width.
+ */
+
+Error *WriteSnapshot(VM *vm, char *filename);
+Error *ReadSnapshot(char *filename, VM *vm, Opts *opts); /* vm->program must be freed */
@@ -0,0 +1,19 @@
+#pragma once
+#include "runtime/vm.h"
+
+/*
+ * Stable sorts of tuples and lists, which return a sorted copy of the same kind.
+ *
+ * Each sort is a merge sort of an array of indexes, so only the result (and a tuple copy of a list)
+ * is allocated on the heap. Without a function, items are ordered by CompareVal, and when every
+ * item is an integer they're radix sorted instead. `less` is a function called through the VM to
+ * compare two items, and returns true if the first should come before the second. Sorting by key
+ * calls the key function once for each item, then sorts by the keys in the default order.
+ *
+ * Calling functions can collect garbage, so the values being sorted stay on the stack while the
+ * sort works on indexes. Lists must be checked by the caller.
+ */
+
+val Sort(val items, VM *vm); /* may GC */
+val SortWith(val items, val less, VM *vm); /* may GC */
+val SortByKey(val items, val key_fn, VM *vm); /* may GC */
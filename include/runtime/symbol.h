@@ -3,9 +3,31 @@
 /*
  * A symbol is a hash of the symbol name. Names are stored in a static block and can be retrieved
  * later.
+ *
+ * For snapshots, the table can be exported as the name block plus a vec of (symbol, offset) pairs,
+ * and restored from them without hashing any names.
+ *
+ * The table isn't locked, so threads that may add symbols (such as when parsing in parallel) must
+ * each set a local symbol set. The table is only read while a local set is active, and new names
+ * go into the local set instead. Since a symbol's value is its hash, symbols created this way are
+ * already valid; afterwards, each set is merged into the table, in a consistent order so the table
+ * comes out the same as if everything ran on one thread.
  */
 
+#include "univ/hashmap.h"
+
+typedef struct {
+  char *names; /* vec */
+  HashMap map;
+} SymbolSet;
+
 u32 Symbol(char *name);
 u32 SymbolFrom(char *name, u32 len);
 char *SymbolName(u32 sym);
 void SetSymbolSize(i32 size);
+char *SymbolNames(u32 *size);
+u32 *SymbolTable(void); /* vec */
+void LoadSymbols(char *names, u32 size, u32 *table, u32 count);
+void InitSymbolSet(SymbolSet *set);
+void SetLocalSymbols(SymbolSet *set); /* new symbols on this thread go into set, until set to 0 */
+void MergeSymbols(SymbolSet *set); /* adds the set's symbols to the table and empties the set */
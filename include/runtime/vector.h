@@ -0,0 +1,43 @@
+#pragma once
+#include "runtime/mem.h"
+
+/*
+ * Persistent vectors, stored as relaxed radix-balanced (RRB) trees of tuples.
+ *
+ * A vector is a tuple record {:Vector, count, shift, root, tail}. The last few items (up to 32) are
+ * kept in the tail, a leaf outside of the tree, so most pushes and pops only copy the tail. The
+ * tree's nodes are tuples whose first item is the transient that owns the node, or nil. A leaf then
+ * holds up to 32 items. A branch holds a size table and up to 32 subtrees; `shift` is the number of
+ * index bits below the root.
+ *
+ * When every child of a branch but the last is full, the branch has no size table, and the child
+ * holding an index is found from the index's bits. Concatenating and slicing can make branches
+ * with partly empty children, which have a size table: a tuple of the cumulative item counts of
+ * their children. Concatenation rebalances the nodes along its seam so the tree stays shallow.
+ *
+ * A transient is a record {:TransientVector, count, shift, root, tail, tail_count} that is changed
+ * in place. Nodes it creates are owned by it, and later changes to them don't copy them. Its tail
+ * always has room for 32 items. Making it persistent returns a vector and retires the transient.
+ *
+ * Indexes must be checked by the caller. These functions reserve the memory they need before
+ * reading their arguments, so their arguments don't need to be on the stack.
+ */
+
+bool IsVector(val value);
+bool IsTransientVector(val value);
+val NewVector(void); /* may GC */
+val ListToVector(val list); /* may GC */
+val VectorToList(val vector); /* may GC */
+u32 VectorCount(val vector); /* also works on transients */
+val VectorGet(val vector, u32 index); /* also works on transients */
+val VectorSet(val vector, u32 index, val value); /* may GC */
+val VectorPush(val vector, val value); /* may GC */
+val VectorPop(val vector); /* may GC */
+val VectorConcat(val left, val right); /* may GC */
+val VectorSlice(val vector, u32 start, u32 end); /* may GC */
+
+val VectorTransient(val vector); /* may GC */
+val TransientPush(val transient, val value); /* may GC; returns the transient */
+val TransientSet(val transient, u32 index, val value); /* may GC; returns the transient */
+val TransientPop(val transient); /* may GC; returns the transient */
+val PersistVector(val transient); /* may GC */
@@ -1,6 +1,7 @@
 #pragma once
 #include "compile/opts.h"
 #include "runtime/error.h"
+#include "runtime/mem.h"
 #include "runtime/program.h"
 
 /*
@@ -25,7 +26,7 @@ enum {regEnv, regMod};
 
 typedef struct VM {
   Error *error; /* borrowed */
-  u32 regs[8];
+  val regs[8];
   u32 pc;
   u32 link;
   Program *program; /* borrowed */
@@ -37,7 +38,12 @@ void InitVM(VM *vm, Program *program, Opts *opts); /* prepare the VM to run a pr
 void DestroyVM(VM *vm);
 void VMStep(VM *vm); /* execute one instruction */
 Error *VMRun(Program *program, Opts *opts); /* execute an entire program */
+Error *VMSnapshot(Program *program, Opts *opts, char *filename); /* load modules, then snapshot */
+Error *VMResume(char *filename, Opts *opts); /* resume a program from a snapshot */
+#define MaxCallArgs 4
+bool IsFunction(val value);
+val VMCall(val fn, u32 num_args, VM *vm); /* call a function with args on the stack; may GC */
 u32 VMPushRef(void *ref, VM *vm); /* create a ref */
 void *VMGetRef(u32 ref, VM *vm); /* get the value of a ref */
 i32 VMFindRef(void *ref, VM *vm); /* find a ref */
-u32 RuntimeError(char *message, VM *vm); /* create a runtime error */
+val RuntimeError(char *message, VM *vm); /* create a runtime error */
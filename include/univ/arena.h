@@ -0,0 +1,34 @@
+#pragma once
+#include "univ/vec.h"
+
+/*
+ * An arena allocates from large blocks by bumping a pointer, and frees everything at once when it's
+ * destroyed. Nothing allocated from an arena is freed on its own.
+ *
+ * Vecs can live in an arena, using the Arena* vec macros to grow them. A vec that was the arena's
+ * last allocation grows in place; otherwise it's copied, leaving the old space unused.
+ *
+ * Like symbol sets, each thread can set a local arena, which the Arena* vec macros and anything
+ * that calls ArenaNew allocate from.
+ */
+
+typedef struct {
+  struct ArenaBlock *blocks;
+  u8 *last; /* the last allocation, which can grow in place */
+} Arena;
+
+void InitArena(Arena *arena);
+void DestroyArena(Arena *arena); /* frees everything, leaving an empty arena */
+void *ArenaAlloc(Arena *arena, u32 size);
+
+void SetLocalArena(Arena *arena); /* allocations on this thread come from arena, until set to 0 */
+Arena *LocalArena(void);
+#define ArenaNew(type)            ((type*)ArenaAlloc(LocalArena(), sizeof(type)))
+
+#define ArenaVecPush(vec, val)    (ArenaVecMakeRoom(vec, 1), (vec)[RawVecCount(vec)++] = val)
+#define ArenaGrowVec(vec, num)    (ArenaVecMakeRoom(vec, Max(1, num)), RawVecCount(vec) += num)
+#define ArenaVecMakeRoom(vec, n)  (VecHasRoom(vec, n) ? 0 : DoArenaVecGrow(vec, n))
+#define DoArenaVecGrow(vec, n)    \
+  (*((void **)&(vec)) = ArenaResizeVec(LocalArena(), (vec), (n), sizeof(*(vec))/* NOLINT */))
+
+void *ArenaResizeVec(Arena *arena, void *vec, u32 numItems, u32 itemSize);
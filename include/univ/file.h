@@ -17,6 +17,11 @@ i32 Read(i32 file, char *buf, u32 size, char **error);
 /* Writes size bytes from a buffer into a file */
 i32 Write(i32 file, char *buf, u32 size, char **error);
 
+/* Writes a sequence of buffers into a file with writev, retrying partial writes
+ * until every segment is written. The iovec array is modified. */
+struct iovec;
+i32 WriteVec(i32 file, struct iovec *iov, u32 count, char **error);
+
 /* Seeks to a position in a file */
 typedef enum {seek_set, seek_cur, seek_end} SeekMethod;
 i32 Seek(i32 file, i32 offset, SeekMethod whence, char **error);
@@ -42,6 +47,16 @@ char *ReadTextFile(char *path);
 /* Writes size bytes into a file */
 i32 WriteFile(void *data, u32 size, char *path);
 
+/* Writes size bytes into a temporary file named for this process, then renames it to path, so
+ * readers and other processes never see a partial file. Returns whether it was written. */
+bool ReplaceFile(void *data, u32 size, char *path);
+
+/* Maps an entire file into memory, read-only. Returns 0 on failure. */
+void *MapFile(char *path, u32 *size);
+
+/* Unmaps a file mapped with MapFile */
+void UnmapFile(void *data, u32 size);
+
 typedef struct {
   u32 count;
   char **filenames;
@@ -66,11 +81,20 @@ char *ReplaceExt(char *path, char *ext);
 /* Returns the part of a path that is the directory */
 char *DirName(char *path);
 
+/* Gets a file's modification time (in seconds) and size. Returns false if there's no file. */
+bool FileStat(char *path, u64 *mtime, u32 *size);
+
+/* Returns a new copy of a path made absolute, with links resolved, or 0 if there's no file */
+char *AbsolutePath(char *path);
+
 /* Returns whether a file exists at a path */
 bool FileExists(char *path);
 
 /* Returns whether a directory exists at a path */
 bool DirExists(char *path);
 
+/* Creates a directory and any missing parent directories. Returns whether the directory exists. */
+bool MakeDirs(char *path);
+
 /* Returns the user's home directory */
 char *HomeDir(void);
@@ -26,6 +26,9 @@ i32 LEBSize(i32 num);
 /* Writes a number into a buffer as a LEB */
 void WriteLEB(i32 num, u32 pos, u8 *buf);
 
+/* Writes a number into a buffer as a LEB padded to size bytes, so it can be rewritten in place */
+void WritePaddedLEB(i32 num, u32 size, u32 pos, u8 *buf);
+
 /* Reads a LEB number from a buffer */
 i32 ReadLEB(u32 index, u8 *buf);
 
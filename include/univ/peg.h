@@ -12,6 +12,7 @@ typedef struct PExpr {
   PExprType type;
   enum {pegMatch, pegAssert, pegRefute} predicate;
   enum {pegOne, pegOptional, pegZeroPlus, pegOnePlus} quantity;
+  u32 rule; /* for pegRule, the rule's index once the grammar is resolved */
   union {
     struct PExpr **parts;
     PRange *ranges;
@@ -38,9 +39,21 @@ typedef struct {
   PRuleAction action;
 } PRule;
 
+/*
+ * Rule references are resolved to rule indexes before a grammar is first used, so matching a rule
+ * doesn't look up its name.
+ *
+ * A grammar can memoize rule matches by rule and position (packrat parsing). A memoized failure is
+ * never retried, and a memoized match isn't matched again. When the match built a node, the node is
+ * built again from the rule nodes it was made of, running their actions again; otherwise nothing is
+ * built, so actions that return 0 shouldn't have side effects. The memo only lasts for one ParseRule
+ * call. Its limit is a number of entries; once it's reached, new entries replace old ones.
+ */
 typedef struct {
   HashMap map;
   PRule **rules; /* vec */
+  bool resolved;
+  u32 memoLimit; /* 0 for no memo */
 } Grammar;
 
 Grammar *NewGrammar(void);
@@ -48,6 +61,7 @@ void FreeGrammar(Grammar *g);
 void AddRule(char *name, char *expr, PRuleAction action, Grammar *g);
 Grammar *ReadGrammar(char *text);
 void OnRule(char *name, PRuleAction action, Grammar *g);
+void SetGrammarMemo(u32 limit, Grammar *g); /* limit is 0 for none, or MaxUInt for unbounded */
 
 PNode *TransparentNode(PNode *node);
 PNode *TransparentChild(PNode *node);
@@ -55,6 +69,7 @@ PNode *DiscardNode(PNode *node);
 PNode *TextNode(PNode *node);
 
 PNode *ParseRule(char *name, char *text, u32 *index, u32 length, Grammar *g);
+PNode *NewPNode(char *name);
 void FreePNode(PNode *node);
 
 #ifdef DEBUG
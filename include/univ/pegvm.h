@@ -0,0 +1,37 @@
+#pragma once
+#include "univ/peg.h"
+
+/*
+ * A grammar can be compiled to a program for a parsing machine, which matches the same text as the
+ * grammar and builds the same nodes, without walking expression trees.
+ *
+ * Each instruction is a word, with the opcode in the low byte and an argument (a character, set,
+ * rule, or address) above it. Literals compile to a sequence of character tests, and classes to
+ * sets of 256 bits. Choices, optionals and repetitions push a backtrack entry with the position to
+ * return to, and rule calls push a return entry, on the same stack. When a test fails, the machine
+ * pops entries until it reaches a backtrack entry, and resumes there.
+ *
+ * Rule nodes aren't built while matching. Instead, the machine logs where each rule starts and
+ * ends, and backtracking truncates the log. After a match, the log is replayed to build the nodes
+ * and run the rule actions, so actions only run for nodes in the result. Nothing is logged inside
+ * predicates or rules whose action is DiscardNode, since those nodes are never kept.
+ *
+ * Unlike ParseRule, the machine doesn't memoize rules, and on failure it reports the furthest
+ * position where a test failed.
+ */
+
+typedef struct {
+  Grammar *g; /* borrowed */
+  u32 *code; /* vec */
+  u32 *rules; /* vec, the address of each rule */
+  u32 *quiet; /* vec, the address of each rule's version that doesn't log its node */
+  u32 *sets; /* vec, 8 words per set */
+} PProgram;
+
+PProgram *CompileGrammar(Grammar *g);
+void FreePProgram(PProgram *prog);
+PNode *RunPProgram(char *name, char *text, u32 *index, u32 length, PProgram *prog);
+
+#ifdef DEBUG
+void PrintPProgram(PProgram *prog);
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+/* A simple thread pool for running independent tasks in parallel */
+
+typedef void (*TaskFn)(u32 index, void *data);
+
+/* Returns the number of online processors */
+u32 NumProcessors(void);
+
+/* Calls fn(index, data) for each index below count, spread across up to one thread per processor.
+ * Tasks are taken in index order, but may finish in any order. Returns once every task is done. */
+void RunTasks(TaskFn fn, u32 count, void *data);
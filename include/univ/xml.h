@@ -1,4 +1,5 @@
 #pragma once
+#include "univ/peg.h"
 
 typedef struct {
   char *name;
@@ -13,6 +14,7 @@ typedef struct XMLNode {
   struct XMLNode **children; /* vec */
 } XMLNode;
 
+Grammar *XMLGrammar(void);
 XMLNode *ParseXML(char *str);
 void FreeXMLNode(XMLNode *node);
 void PrintXMLNode(XMLNode *node);
@@ -0,0 +1,254 @@
+#include "compile/cache.h"
+#include "runtime/mem.h"
+#include "runtime/primitives.h"
+#include "runtime/symbol.h"
+#include "univ/encrypt.h"
+#include "univ/file.h"
+#include "univ/iff.h"
+#include "univ/str.h"
+#include "univ/vec.h"
+#include <string.h>
+
+#define CACHE_EXT ".cmod"
+
+static void PushBytes(u8 **buf, void *data, u32 size)
+{
+  GrowVec(*buf, size);
+  Copy(data, *buf + VecCount(*buf) - size, size);
+}
+
+void CompilerKey(u8 key[32])
+{
+  u8 *buf = 0; /* vec */
+  u32 version[4];
+  u32 i;
+
+  version[0] = VERSION_MAJOR;
+  version[1] = VERSION_MINOR;
+  version[2] = VERSION_PATCH;
+  version[3] = valBits;
+  PushBytes(&buf, version, sizeof(version));
+  for (i = 0; i < NumPrimitives(); i++) {
+    char *name = PrimitiveName(i);
+    PushBytes(&buf, name, strlen(name) + 1);
+  }
+
+  Sha256(buf, VecCount(buf), key);
+  FreeVec(buf);
+}
+
+void ModuleCacheKey(Module *mod, Project *project)
+{
+  u8 *buf = 0; /* vec */
+  ASTNode *imports = ModuleImports(mod);
+  u8 compiler_key[32];
+  u32 i;
+
+  CompilerKey(compiler_key);
+  PushBytes(&buf, compiler_key, sizeof(compiler_key));
+  PushBytes(&buf, &mod->id, sizeof(mod->id));
+  if (mod->precompiled) {
+    /* a precompiled module's key starts as a hash of its object file */
+    PushBytes(&buf, mod->cache_key, sizeof(mod->cache_key));
+  } else {
+    PushBytes(&buf, mod->source, strlen(mod->source) + 1);
+  }
+
+  for (i = 0; i < NodeCount(imports); i++) {
+    u32 name = NodeValue(NodeChild(NodeChild(imports, i), 0));
+    Module *import;
+    if (name == Symbol("Host")) continue;
+    import = &project->modules[HashMapGet(&project->mod_map, name)];
+    PushBytes(&buf, import->cache_key, sizeof(import->cache_key));
+  }
+
+  Sha256(buf, VecCount(buf), mod->cache_key);
+  FreeVec(buf);
+}
+
+static char *CacheFilename(Module *mod, char *cache_path)
+{
+  char hex[2*sizeof(mod->cache_key) + sizeof(CACHE_EXT)];
+  WriteHex(mod->cache_key, sizeof(mod->cache_key), hex);
+  Copy(CACHE_EXT, hex + 2*sizeof(mod->cache_key), sizeof(CACHE_EXT));
+  return JoinStr(cache_path, hex, '/');
+}
+
+/* Appends each name in a block of null-terminated names as a symbol */
+u32 *LoadNames(char *names, u32 size, u32 *symbols)
+{
+  char *end = names + size;
+  while (names < end) {
+    char *stop = memchr(names, 0, end - names);
+    if (!stop) break;
+    VecPush(symbols, SymbolFrom(names, stop - names));
+    names = stop + 1;
+  }
+  return symbols;
+}
+
+/* Fields of a module's code, in order, and the unit each field's size must be a multiple of */
+static u32 fieldTypes[] = {'CODE', 'SRCS', 'SYMS', 'EXPT'};
+static u32 fieldUnits[] = {1, 2*sizeof(u32), 1, 1};
+enum {codeField, srcsField, symsField, exptField, numFields};
+
+IFFChunk *GetModuleField(IFFChunk *form, u32 index, u32 type, u32 unit)
+{
+  IFFChunk *field = IFFGetField(form, index);
+  u32 offset, end = IFFChunkSize(form);
+  if (!field) return 0;
+  offset = (u8*)field - (u8*)form;
+  if (offset + 8 > end || offset + IFFChunkSize(field) > end) return 0;
+  if (IFFChunkType(field) != type) return 0;
+  if (IFFDataSize(field) % unit != 0) return 0;
+  return field;
+}
+
+bool ValidModuleFile(IFFChunk *form, u32 file_size, u32 form_type)
+{
+  return file_size >= 12 && IFFChunkSize(form) <= file_size && IFFFormType(form) == form_type;
+}
+
+static bool ValidModuleCode(IFFChunk *form, IFFChunk **fields)
+{
+  u32 i, code_size = 0;
+  u32 *srcs;
+
+  for (i = 0; i < numFields; i++) {
+    fields[i] = GetModuleField(form, i, fieldTypes[i], fieldUnits[i]);
+    if (!fields[i]) return false;
+  }
+
+  /* the source positions must cover the code exactly */
+  srcs = IFFData(fields[srcsField]);
+  for (i = 0; i < IFFDataSize(fields[srcsField])/sizeof(u32); i += 2) {
+    u32 count;
+    Copy(srcs + i + 1, &count, sizeof(count));
+    code_size += count;
+  }
+  return code_size == IFFDataSize(fields[codeField]);
+}
+
+bool LoadModuleCode(Module *mod, IFFChunk *form)
+{
+  IFFChunk *fields[numFields];
+  u32 i, num_srcs;
+  u8 *code;
+  u32 *exports = 0; /* vec */
+  ASTNode *export_node;
+
+  if (!ValidModuleCode(form, fields)) return false;
+
+  /* rebuild the code as one chunk per source position, so the source map comes out the same */
+  code = IFFData(fields[codeField]);
+  num_srcs = IFFDataSize(fields[srcsField])/(2*sizeof(u32));
+  for (i = 0; i < num_srcs; i++) {
+    u32 src[2];
+    Chunk *chunk;
+    Copy((u32*)IFFData(fields[srcsField]) + 2*i, src, sizeof(src));
+    chunk = NewChunk(src[0]);
+    EmitBytes(code, src[1], chunk);
+    code += src[1];
+    if (mod->code) {
+      TackOnChunk(mod->code, chunk);
+    } else {
+      mod->code = chunk;
+    }
+  }
+  if (!mod->code) mod->code = NewChunk(0);
+
+  mod->symbols = LoadNames(IFFData(fields[symsField]), IFFDataSize(fields[symsField]), 0);
+  exports = LoadNames(IFFData(fields[exptField]), IFFDataSize(fields[exptField]), 0);
+
+  export_node = NewNode(tupleNode, 0, 0, 0);
+  for (i = 0; i < VecCount(exports); i++) {
+    NodePush(export_node, NewNode(idNode, 0, 0, IntVal(exports[i])));
+  }
+  NodePush(mod->ast, export_node);
+  FreeVec(exports);
+
+  mod->cached = true;
+  return true;
+}
+
+bool ReadCachedModule(Module *mod, char *cache_path)
+{
+  char *filename = CacheFilename(mod, cache_path);
+  IFFChunk *form;
+  u32 file_size;
+  bool found;
+
+  form = MapFile(filename, &file_size);
+  free(filename);
+  if (!form) return false;
+  found = ValidModuleFile(form, file_size, 'CMOD') && LoadModuleCode(mod, form);
+  UnmapFile(form, file_size);
+  return found;
+}
+
+IFFChunk *AppendField(IFFChunk *form, u32 type, void *data, u32 size)
+{
+  IFFChunk *chunk = NewIFFChunk(type, data, size);
+  form = IFFAppendChunk(form, chunk);
+  free(chunk);
+  return form;
+}
+
+void PushName(char **names, u32 sym)
+{
+  char *name = SymbolName(sym);
+  PushBytes((u8**)names, name, strlen(name) + 1);
+}
+
+IFFChunk *SerializeModuleCode(Module *mod, u32 form_type)
+{
+  IFFChunk *form;
+  u8 *code;
+  u32 *srcs = 0; /* vec */
+  char *syms = 0, *exports = 0; /* vec */
+  ASTNode *export_node = ModuleExports(mod);
+  Chunk *chunk;
+  u32 i;
+
+  code = NewVec(u8, ChunkSize(mod->code));
+  SerializeChunk(mod->code, code);
+  for (chunk = mod->code; chunk; chunk = chunk->next) {
+    if (VecCount(chunk->data) == 0) continue;
+    VecPush(srcs, chunk->src);
+    VecPush(srcs, VecCount(chunk->data));
+  }
+  for (i = 0; i < VecCount(mod->symbols); i++) PushName(&syms, mod->symbols[i]);
+  for (i = 0; i < NodeCount(export_node); i++) {
+    PushName(&exports, RawVal(NodeValue(NodeChild(export_node, i))));
+  }
+
+  form = NewIFFForm(form_type);
+  form = AppendField(form, 'CODE', code, ChunkSize(mod->code));
+  form = AppendField(form, 'SRCS', srcs, VecCount(srcs)*sizeof(u32));
+  form = AppendField(form, 'SYMS', syms, VecCount(syms));
+  form = AppendField(form, 'EXPT', exports, VecCount(exports));
+  FreeVec(code);
+  FreeVec(srcs);
+  FreeVec(syms);
+  FreeVec(exports);
+  return form;
+}
+
+bool WriteModuleFile(IFFChunk *form, char *filename)
+{
+  return ReplaceFile(form, IFFChunkSize(form), filename);
+}
+
+void WriteCachedModule(Module *mod, char *cache_path)
+{
+  char *filename;
+  IFFChunk *form;
+
+  if (!MakeDirs(cache_path)) return;
+
+  form = SerializeModuleCode(mod, 'CMOD');
+  filename = CacheFilename(mod, cache_path);
+  WriteModuleFile(form, filename);
+  free(form);
+  free(filename);
+}
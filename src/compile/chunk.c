@@ -1,53 +1,60 @@
 #include "compile/chunk.h"
 #include "runtime/ops.h"
 #include "runtime/vm.h"
+#include "univ/arena.h"
 #include "univ/str.h"
 #include "univ/vec.h"
 #include "univ/math.h"
 
 Chunk *NewChunk(u32 src)
 {
-  Chunk *chunk = malloc(sizeof(Chunk));
+  Chunk *chunk = ArenaNew(Chunk);
   chunk->data = 0;
   chunk->needs_env = false;
   chunk->modifies_env = false;
   chunk->src = src;
+  chunk->module_ref = 0;
+  chunk->size = 0;
+  chunk->last = chunk;
   chunk->next = 0;
   return chunk;
 }
 
-void FreeChunk(Chunk *chunk)
-{
-  if (!chunk) return;
-  if (chunk->data) FreeVec(chunk->data);
-  if (chunk->next) FreeChunk(chunk->next);
-  free(chunk);
-}
-
 void Emit(u8 byte, Chunk *chunk)
 {
-  while (chunk->next) chunk = chunk->next;
-  VecPush(chunk->data, byte);
+  ArenaVecPush(chunk->last->data, byte);
+  chunk->size++;
 }
 
 void EmitInt(u32 num, Chunk *chunk)
 {
   u32 size = LEBSize(num);
-  u32 index;
-  while (chunk->next) chunk = chunk->next;
-  index = VecCount(chunk->data);
-  GrowVec(chunk->data, size);
-  WriteLEB(num, index, chunk->data);
+  u32 index = VecCount(chunk->last->data);
+  ArenaGrowVec(chunk->last->data, size);
+  WriteLEB(num, index, chunk->last->data);
+  chunk->size += size;
+}
+
+void EmitPaddedInt(u32 num, u32 size, Chunk *chunk)
+{
+  u32 index = VecCount(chunk->last->data);
+  ArenaGrowVec(chunk->last->data, size);
+  WritePaddedLEB(num, size, index, chunk->last->data);
+  chunk->size += size;
+}
+
+void EmitBytes(u8 *bytes, u32 size, Chunk *chunk)
+{
+  u32 index = VecCount(chunk->last->data);
+  if (size == 0) return;
+  ArenaGrowVec(chunk->last->data, size);
+  Copy(bytes, chunk->last->data + index, size);
+  chunk->size += size;
 }
 
 u32 ChunkSize(Chunk *chunk)
 {
-  u32 size = 0;
-  while (chunk) {
-    size += VecCount(chunk->data);
-    chunk = chunk->next;
-  }
-  return size;
+  return chunk ? chunk->size : 0;
 }
 
 Chunk *PrependChunk(u8 byte, Chunk *chunk)
@@ -69,9 +76,9 @@ Chunk *AppendChunk(Chunk *first, Chunk *second)
 
 void TackOnChunk(Chunk *first, Chunk *second)
 {
-  Chunk *last = first;
-  while (last->next) last = last->next;
-  last->next = second;
+  first->last->next = second;
+  first->last = second->last;
+  first->size += second->size;
 }
 
 Chunk *PreservingEnv(Chunk *first, Chunk *second)
@@ -82,7 +89,7 @@ Chunk *PreservingEnv(Chunk *first, Chunk *second)
     Chunk *save_env = NewChunk(first->src);
     Emit(opPush, save_env);
     EmitInt(regEnv, save_env);
-    save_env->next = first;
+    TackOnChunk(save_env, first);
     Emit(opSwap, save_env);
     Emit(opPull, save_env);
     EmitInt(regEnv, save_env);
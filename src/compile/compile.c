@@ -60,12 +60,6 @@ static Chunk *UndefinedModule(ASTNode *node, Compiler *c)
   return 0;
 }
 
-static Chunk *CompileFail(Chunk *chunk)
-{
-  FreeChunk(chunk);
-  return 0;
-}
-
 /* Emitter functions */
 
 static void EmitConst(u32 n, Chunk *chunk)
@@ -183,8 +177,18 @@ static void EmitDefine(u32 index, Chunk *chunk)
   EmitInt(index, chunk);
 }
 
+/* Emits a module's ID in its own chunk, so it can be relocated (see "chunk.h") */
+static void EmitModuleID(Module *mod, Chunk *chunk)
+{
+  Chunk *ref = NewChunk(chunk->last->src);
+  ref->module_ref = NodeValue(ModuleName(mod));
+  Emit(opConst, ref);
+  EmitPaddedInt(IntVal(mod->id - 1), ModuleRefSize, ref);
+  TackOnChunk(chunk, ref);
+}
+
 /* Sets the value of a module */
-static void EmitSetModule(Chunk *chunk, u32 mod_id)
+static void EmitSetModule(Chunk *chunk, Module *mod)
 {
   /*
   getMod
@@ -194,7 +198,7 @@ static void EmitSetModule(Chunk *chunk, u32 mod_id)
   drop
   */
   EmitGetMod(chunk);
-  EmitConst(mod_id - 1, chunk);
+  EmitModuleID(mod, chunk);
   Emit(opRot, chunk);
   Emit(opSet, chunk);
   Emit(opDrop, chunk);
@@ -386,7 +390,7 @@ static Chunk *CompileTuple(ASTNode *node, bool returns, Compiler *c)
     ASTNode *item = NodeChild(node, index);
 
     item_chunk = CompileExpr(item, false, c);
-    if (!item_chunk) return CompileFail(items_chunk);
+    if (!item_chunk) return 0;
 
     set_chunk = NewChunk(node->start);
     Emit(opSet, set_chunk);
@@ -416,7 +420,7 @@ static Chunk *CompileList(ASTNode *node, bool returns, Compiler *c)
     ASTNode *item = NodeChild(node, i);
     Chunk *itemChunk = CompileExpr(item, false, c);
     chunk = PrependChunk(opPair, chunk);
-    if (!itemChunk) return CompileFail(chunk);
+    if (!itemChunk) return 0;
     chunk = PreservingEnv(itemChunk, chunk);
   }
 
@@ -441,7 +445,7 @@ static Chunk *CompileOp(OpCode op, ASTNode *node, bool returns, Compiler *c)
   for (i = 0; i < num_items; i++) {
     ASTNode *item = NodeChild(node, num_items - 1 - i);
     Chunk *result = CompileExpr(item, false, c);
-    if (!result) return CompileFail(chunk);
+    if (!result) return 0;
     chunk = PreservingEnv(result, chunk);
   }
   Emit(op, chunk);
@@ -479,7 +483,7 @@ after:
   right_chunk = AppendChunk(chunk, right_chunk);
 
   left_chunk = CompileExpr(NodeChild(node, 0), false, c);
-  if (!left_chunk) return CompileFail(right_chunk);
+  if (!left_chunk) return 0;
 
   chunk = PreservingEnv(left_chunk, right_chunk);
   if (returns) EmitReturn(chunk);
@@ -504,10 +508,10 @@ after:
   if (!pred_code) return pred_code;
 
   true_code = CompileExpr(NodeChild(node, 1), returns, c);
-  if (!true_code) return CompileFail(pred_code);
+  if (!true_code) return 0;
 
   false_code = CompileExpr(NodeChild(node, 2), returns, c);
-  if (!false_code) return CompileFail(AppendChunk(pred_code, true_code));
+  if (!false_code) return 0;
 
   if (!returns) {
     Emit(opJump, false_code);
@@ -527,7 +531,7 @@ static Chunk *CompileDo(ASTNode *node, bool returns, Compiler *c)
 {
   u32 i, numDefs;
   Chunk *chunk = NewChunk(node->start);
-  numDefs = GetNodeAttr(node, "numAssigns");
+  numDefs = GetNodeAttr(node, numAssignsAttr);
 
   if (numDefs > 0) {
     c->env = ExtendEnv(numDefs, c->env);
@@ -547,10 +551,7 @@ static Chunk *CompileDo(ASTNode *node, bool returns, Compiler *c)
       setChunk = NewChunk(def->start);
       EmitDefine(index, setChunk);
       defChunk = CompileExpr(NodeChild(def, 1), false, c);
-      if (!defChunk) {
-        FreeChunk(setChunk);
-        return CompileFail(chunk);
-      }
+      if (!defChunk) return 0;
       defChunk = PreservingEnv(defChunk, setChunk);
       chunk = PreservingEnv(defChunk, chunk);
     }
@@ -572,10 +573,7 @@ static Chunk *CompileDo(ASTNode *node, bool returns, Compiler *c)
       Chunk *stmtChunk;
       bool isLast = index == NodeCount(node) - 1;
       stmtChunk = CompileExpr(stmt, isLast && returns, c);
-      if (!stmtChunk) {
-        FreeChunk(stmtsChunk);
-        return CompileFail(chunk);
-      }
+      if (!stmtChunk) return 0;
       if (!isLast) stmtsChunk = PrependChunk(opDrop, stmtsChunk);
       stmtsChunk = PreservingEnv(stmtChunk, stmtsChunk);
     }
@@ -606,7 +604,7 @@ static Chunk *CompileLet(ASTNode *node, bool returns, Compiler *c)
     u32 name = NodeValue(NodeChild(assign, 0));
     ASTNode *value = NodeChild(assign, 1);
     valueChunk = CompileExpr(value, false, c);
-    if (!valueChunk) return CompileFail(chunk);
+    if (!valueChunk) return 0;
     setChunk = NewChunk(assign->start);
     EmitDefine(i, setChunk);
     valueChunk = PreservingEnv(valueChunk, setChunk);
@@ -615,7 +613,7 @@ static Chunk *CompileLet(ASTNode *node, bool returns, Compiler *c)
   }
 
   exprChunk = CompileExpr(expr, returns, c);
-  if (!exprChunk) return CompileFail(chunk);
+  if (!exprChunk) return 0;
   chunk = PreservingEnv(chunk, exprChunk);
   c->env = PopEnv(c->env);
   return EmitScope(numAssigns, node->start, chunk);
@@ -697,7 +695,7 @@ ok:
   }
 
   result = CompileExpr(body, true, c);
-  if (!result) return CompileFail(chunk);
+  if (!result) return 0;
 
   if (num_params > 0) c->env = PopEnv(c->env);
 
@@ -742,7 +740,7 @@ static Chunk *CompileArgs(ASTNode *node, Chunk *chunk, Compiler *c)
     u32 index = NodeCount(node) - 1 - i;
     ASTNode *arg = NodeChild(node, index);
     Chunk *arg_chunk = CompileExpr(arg, false, c);
-    if (!arg_chunk) return CompileFail(chunk);
+    if (!arg_chunk) return 0;
     chunk = PreservingEnv(arg_chunk, chunk);
   }
 
@@ -902,7 +900,7 @@ static Chunk *CompileRef(ASTNode *alias, ASTNode *sym, bool returns, Compiler *c
 
   chunk = NewChunk(sym->start);
   EmitGetMod(chunk);
-  EmitConst(mod->id - 1, chunk);
+  EmitModuleID(mod, chunk);
   Emit(opGet, chunk);
   EmitConst(sym_index, chunk);
   Emit(opGet, chunk);
@@ -924,7 +922,8 @@ static Chunk *CompileModule(ASTNode *node, bool returns, Compiler *c)
   */
 
   ASTNode *imports = NodeChild(node, 1);
-  u32 i, mod_id;
+  Module *mod = &c->project->modules[c->current_mod];
+  u32 i;
   Chunk *chunk;
 
   InitHashMap(&c->alias_map);
@@ -952,9 +951,8 @@ static Chunk *CompileModule(ASTNode *node, bool returns, Compiler *c)
   chunk = CompileExpr(NodeChild(node, 3), false, c);
   if (!chunk) return 0;
 
-  mod_id = c->project->modules[c->current_mod].id;
-  if (mod_id > 0) {
-    EmitSetModule(chunk, mod_id);
+  if (mod->id > 0) {
+    EmitSetModule(chunk, mod);
   } else {
     Emit(opHalt, chunk);
   }
@@ -975,7 +973,7 @@ static Chunk *CompileExpr(ASTNode *node, bool returns, Compiler *c)
   case tupleNode:   return CompileTuple(node, returns, c);
   case listNode:    return CompileList(node, returns, c);
   case lambdaNode:  return CompileLambda(node, returns, c);
-  case opNode:      return CompileOp(GetNodeAttr(node, "opCode"), node, returns, c);
+  case opNode:      return CompileOp(GetNodeAttr(node, opCodeAttr), node, returns, c);
   case callNode:    return CompileCall(node, returns, c);
   case refNode:     return CompileDot(node, returns, c);
   case andNode:     return CompileLogic(node, returns, c);
@@ -1,11 +1,12 @@
 #include "compile/env.h"
+#include "univ/arena.h"
 
 Env *ExtendEnv(u32 size, Env *parent)
 {
   u32 i;
-  Env *env = malloc(sizeof(Env));
+  Env *env = ArenaNew(Env);
   env->size = size;
-  env->items = malloc(size*sizeof(*env->items));
+  env->items = ArenaAlloc(LocalArena(), size*sizeof(*env->items));
   env->parent = parent;
   for (i = 0; i < size; i++) {
     env->items[i].var = 0;
@@ -16,12 +17,7 @@ Env *ExtendEnv(u32 size, Env *parent)
 
 Env *PopEnv(Env *env)
 {
-  Env *parent;
-  if (!env) return env;
-  parent = env->parent;
-  free(env->items);
-  free(env);
-  return parent;
+  return env ? env->parent : env;
 }
 
 i32 EnvFind(u32 value, Env *env)
@@ -0,0 +1,164 @@
+#include "compile/index.h"
+#include "univ/file.h"
+#include "univ/iff.h"
+#include "univ/math.h"
+#include "univ/str.h"
+#include "univ/time.h"
+#include "univ/vec.h"
+#include <string.h>
+
+#define INDEX_FILE "modules.idx"
+
+/* Size of an entry's modification time and file size fields */
+#define StampSize (3*sizeof(u32))
+
+static u32 PathKey(char *path)
+{
+  return Hash(path, strlen(path));
+}
+
+static IndexEntry *FindEntry(ModuleIndex *index, char *path)
+{
+  u32 n;
+  if (!HashMapFetch(&index->map, PathKey(path), &n)) return 0;
+  if (!StrEq(index->entries[n].path, path)) return 0;
+  return &index->entries[n];
+}
+
+static void AddEntry(ModuleIndex *index, char *path, u64 mtime, u32 size, char *header, u32 len)
+{
+  IndexEntry entry;
+  u32 n;
+  entry.path = NewString(path);
+  entry.mtime = mtime;
+  entry.size = size;
+  entry.header = malloc(len + 1);
+  Copy(header, entry.header, len);
+  entry.header[len] = 0;
+
+  /* paths with the same hash replace each other */
+  if (HashMapFetch(&index->map, PathKey(path), &n)) {
+    free(index->entries[n].path);
+    free(index->entries[n].header);
+    index->entries[n] = entry;
+  } else {
+    HashMapSet(&index->map, PathKey(path), VecCount(index->entries));
+    VecPush(index->entries, entry);
+  }
+}
+
+/* Adds an entry from a 'MODL' field, returning false if the field is malformed */
+static bool LoadEntry(ModuleIndex *index, IFFChunk *field)
+{
+  u32 stamp[3], size = IFFDataSize(field);
+  char *path = (char*)IFFData(field) + StampSize, *end;
+  if (IFFChunkType(field) != 'MODL' || size < StampSize) return false;
+  end = memchr(path, 0, size - StampSize);
+  if (!end) return false;
+  Copy(IFFData(field), stamp, sizeof(stamp));
+  AddEntry(index, path, stamp[0] | ((u64)stamp[1] << 32), stamp[2],
+      end + 1, (char*)IFFData(field) + size - (end + 1));
+  return true;
+}
+
+void LoadModuleIndex(ModuleIndex *index, char *cache_path)
+{
+  char *filename;
+  IFFChunk *form, *field;
+  u8 *end;
+  u32 file_size;
+
+  index->entries = 0;
+  InitHashMap(&index->map);
+  index->changed = false;
+  if (!cache_path) return;
+
+  filename = JoinStr(cache_path, INDEX_FILE, '/');
+  form = MapFile(filename, &file_size);
+  free(filename);
+  if (!form) return;
+
+  if (file_size >= 12 && IFFChunkSize(form) <= file_size && IFFFormType(form) == 'MIDX') {
+    end = (u8*)form + IFFChunkSize(form);
+    field = IFFGetField(form, 0);
+    while ((u8*)field + 8 <= end && (u8*)field + IFFChunkSize(field) <= end) {
+      if (!LoadEntry(index, field)) break;
+      field = (IFFChunk*)((u8*)field + IFFChunkSize(field));
+    }
+  }
+  UnmapFile(form, file_size);
+}
+
+static void PushBytes(u8 **buf, void *data, u32 size)
+{
+  GrowVec(*buf, size);
+  Copy(data, *buf + VecCount(*buf) - size, size);
+}
+
+/* Writes to a temporary file first, so other processes never see a partial file. Entries for
+ * files that no longer exist are dropped. */
+void SaveModuleIndex(ModuleIndex *index, char *cache_path)
+{
+  u8 *data = 0; /* vec */
+  u32 type = ByteSwap('MIDX'), i; /* stored like NewIFFForm stores it */
+  char *filename;
+  IFFChunk *form;
+
+  if (!cache_path || !index->changed || !MakeDirs(cache_path)) return;
+
+  PushBytes(&data, &type, sizeof(type));
+  for (i = 0; i < VecCount(index->entries); i++) {
+    IndexEntry *entry = &index->entries[i];
+    u32 path_len = strlen(entry->path) + 1;
+    u32 header_len = strlen(entry->header);
+    u32 stamp[3];
+    u8 *field = 0; /* vec */
+    IFFChunk *chunk;
+    if (!FileExists(entry->path)) continue;
+    stamp[0] = (u32)entry->mtime;
+    stamp[1] = (u32)(entry->mtime >> 32);
+    stamp[2] = entry->size;
+    PushBytes(&field, stamp, sizeof(stamp));
+    PushBytes(&field, entry->path, path_len);
+    PushBytes(&field, entry->header, header_len);
+    chunk = NewIFFChunk('MODL', field, VecCount(field));
+    PushBytes(&data, chunk, IFFChunkSize(chunk));
+    free(chunk);
+    FreeVec(field);
+  }
+  form = NewIFFChunk('FORM', data, VecCount(data));
+  FreeVec(data);
+
+  filename = JoinStr(cache_path, INDEX_FILE, '/');
+  ReplaceFile(form, IFFChunkSize(form), filename);
+  free(form);
+  free(filename);
+  index->changed = false;
+}
+
+void DestroyModuleIndex(ModuleIndex *index)
+{
+  u32 i;
+  for (i = 0; i < VecCount(index->entries); i++) {
+    free(index->entries[i].path);
+    free(index->entries[i].header);
+  }
+  FreeVec(index->entries);
+  DestroyHashMap(&index->map);
+}
+
+char *IndexedHeader(ModuleIndex *index, char *path, u64 mtime, u32 size)
+{
+  IndexEntry *entry = FindEntry(index, path);
+  if (!entry || entry->mtime != mtime || entry->size != size) return 0;
+  return entry->header;
+}
+
+/* A file modified in the same second it's indexed could change again without changing its
+ * modification time, so it isn't indexed until a later build. */
+void IndexModule(ModuleIndex *index, char *path, u64 mtime, u32 size, char *header, u32 len)
+{
+  if (mtime >= Time()) return;
+  AddEntry(index, path, mtime, size, header, len);
+  index->changed = true;
+}
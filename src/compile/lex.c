@@ -1,5 +1,7 @@
 #include "compile/lex.h"
 #include "univ/str.h"
+#include "univ/vec.h"
+#include <string.h>
 
 static Token MakeToken(TokenType type, u32 pos, u32 length)
 {
@@ -10,87 +12,177 @@ static Token MakeToken(TokenType type, u32 pos, u32 length)
   return token;
 }
 
-static bool IsSymChar(char ch)
-{
-  return IsAlpha(ch) || IsDigit(ch) || ch == '_' || ch == '!' || ch == '?';
-}
+/* Each character's class (in the low bits) decides which kind of token starts with it. The high
+ * bits mark which kinds of token it can continue. */
+enum {otherClass, endClass, spaceClass, newlineClass, digitClass, symClass, stringClass, byteClass,
+  opClass};
+#define ClassMask 0x0F
+#define symBit    0x10
+#define numBit    0x20
+#define hexBit    0x40
 
-static bool MatchKeyword(char *test, char *str)
-{
-  while (*test && *str) {
-    if (*test != *str) return false;
-    str++;
-    test++;
-  }
-  if (*test) return false;
-  return !IsSymChar(*str);
-}
+#define Oth otherClass
+#define End endClass
+#define Spc spaceClass
+#define NL  newlineClass
+#define Dig (digitClass | symBit | numBit | hexBit)
+#define Hex (symClass | symBit | hexBit)
+#define Sym (symClass | symBit)
+#define Und (symClass | symBit | numBit | hexBit)
+#define Str stringClass
+#define Byt byteClass
+#define Op  opClass
+#define Bng (opClass | symBit)
+
+static u8 chars[256] = {
+  End, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Spc, NL,  Oth, Oth, NL,  Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Spc, Bng, Str, Op,  Byt, Op,  Op,  Oth, Op,  Op,  Op,  Op,  Op,  Op,  Op,  Op,
+  Dig, Dig, Dig, Dig, Dig, Dig, Dig, Dig, Dig, Dig, Op,  Oth, Op,  Op,  Op,  Sym,
+  Op,  Hex, Hex, Hex, Hex, Hex, Hex, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym,
+  Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Op,  Op,  Op,  Op,  Und,
+  Oth, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym,
+  Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Sym, Op,  Op,  Op,  Op,  Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth,
+  Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth, Oth
+};
+
+#undef Oth
+#undef End
+#undef Spc
+#undef NL
+#undef Dig
+#undef Hex
+#undef Sym
+#undef Und
+#undef Str
+#undef Byt
+#undef Op
+#undef Bng
+
+#define CharClass(ch)     (chars[(u8)(ch)] & ClassMask)
+#define IsSymChar(ch)     (chars[(u8)(ch)] & symBit)
+#define IsNumChar(ch)     (chars[(u8)(ch)] & numBit)
+#define IsHexChar(ch)     (chars[(u8)(ch)] & hexBit)
 
 typedef struct {
   char *lexeme;
   TokenType type;
 } Keyword;
 
-static Keyword operators[] = {
-  {"->",      arrowToken},
-  {">>",      gtgtToken},
-  {"<<",      ltltToken},
-  {"<>",      ltgtToken},
-  {"!=",      bangeqToken},
-  {"==",      eqeqToken},
-  {"<=",      lteqToken},
-  {">=",      gteqToken},
-  {"#",       hashToken},
-  {"%",       percentToken},
-  {"&",       ampToken},
-  {"(",       lparenToken},
-  {")",       rparenToken},
-  {"*",       starToken},
-  {"+",       plusToken},
-  {",",       commaToken},
-  {"-",       minusToken},
-  {".",       dotToken},
-  {"/",       slashToken},
-  {":",       colonToken},
-  {"<",       ltToken},
-  {"=",       eqToken},
-  {">",       gtToken},
-  {"@",       atToken},
-  {"[",       lbracketToken},
-  {"\\",      bslashToken},
-  {"]",       rbracketToken},
-  {"^",       caretToken},
-  {"{",       lbraceToken},
-  {"|",       barToken},
-  {"}",       rbraceToken},
-  {"~",       tildeToken}
-};
-
-static Keyword keywords[] = {
-  {"and",     andToken},
+/* A perfect hash of the keywords, indexed by KeywordHash */
+static Keyword keywords[32] = {
+  {0,         idToken},
+  {"if",      ifToken},
+  {"nil",     nilToken},
+  {"when",    whenToken},
+  {"false",   falseToken},
+  {"do",      doToken},
   {"as",      asToken},
+  {0,         idToken},
+  {"not",     notToken},
+  {"in",      inToken},
+  {"true",    trueToken},
+  {0,         idToken},
+  {"import",  importToken},
+  {"record",  recordToken},
+  {0,         idToken},
+  {0,         idToken},
+  {0,         idToken},
+  {0,         idToken},
+  {"module",  moduleToken},
+  {"or",      orToken},
   {"def",     defToken},
-  {"do",      doToken},
   {"else",    elseToken},
-  {"end",     endToken},
-  {"false",   falseToken},
+  {0,         idToken},
+  {0,         idToken},
+  {0,         idToken},
   {"guard",   guardToken},
-  {"if",      ifToken},
-  {"import",  importToken},
-  {"in",      inToken},
+  {"and",     andToken},
+  {0,         idToken},
   {"let",     letToken},
-  {"module",  moduleToken},
-  {"nil",     nilToken},
-  {"not",     notToken},
-  {"or",      orToken},
-  {"record",  recordToken},
-  {"true",    trueToken},
-  {"when"  ,  whenToken},
+  {0,         idToken},
+  {"end",     endToken},
+  {0,         idToken}
 };
+#define KeywordHash(str, len) (((u8)(str)[0] + (u8)(str)[1] + 25*(len)) & 31)
+
+static TokenType KeywordType(char *str, u32 len)
+{
+  Keyword *keyword;
+  if (len < 2) return idToken;
+  keyword = &keywords[KeywordHash(str, len)];
+  if (!keyword->lexeme || strncmp(keyword->lexeme, str, len) != 0 || keyword->lexeme[len] != 0) {
+    return idToken;
+  }
+  return keyword->type;
+}
+
+/* Returns the operator at the start of str, or errorToken if there isn't one */
+static TokenType OpType(char *str, u32 *len)
+{
+  *len = 2;
+  switch (str[0]) {
+  case '-':
+    if (str[1] == '>') return arrowToken;
+    break;
+  case '>':
+    if (str[1] == '>') return gtgtToken;
+    if (str[1] == '=') return gteqToken;
+    break;
+  case '<':
+    if (str[1] == '<') return ltltToken;
+    if (str[1] == '>') return ltgtToken;
+    if (str[1] == '=') return lteqToken;
+    break;
+  case '=':
+    if (str[1] == '=') return eqeqToken;
+    break;
+  case '!':
+    if (str[1] == '=') return bangeqToken;
+    break;
+  }
+
+  *len = 1;
+  switch (str[0]) {
+  case '#':   return hashToken;
+  case '%':   return percentToken;
+  case '&':   return ampToken;
+  case '(':   return lparenToken;
+  case ')':   return rparenToken;
+  case '*':   return starToken;
+  case '+':   return plusToken;
+  case ',':   return commaToken;
+  case '-':   return minusToken;
+  case '.':   return dotToken;
+  case '/':   return slashToken;
+  case ':':   return colonToken;
+  case '<':   return ltToken;
+  case '=':   return eqToken;
+  case '>':   return gtToken;
+  case '@':   return atToken;
+  case '[':   return lbracketToken;
+  case '\\':  return bslashToken;
+  case ']':   return rbracketToken;
+  case '^':   return caretToken;
+  case '{':   return lbraceToken;
+  case '|':   return barToken;
+  case '}':   return rbraceToken;
+  case '~':   return tildeToken;
+  default:    return errorToken;
+  }
+}
 
 Token NextToken(char *src, u32 pos)
 {
-  u32 i;
+  u32 len;
+  TokenType type;
 
   if (src[pos] == ';') {
     while (src[pos] && !IsNewline(src[pos])) pos++;
@@ -98,68 +190,58 @@ Token NextToken(char *src, u32 pos)
 
   if (Match("---\n", src+pos) && (pos == 0 || src[pos-1] == '\n')) {
     pos += 4;
-    while (!Match("---\n", src+pos)) {
-      pos++;
-    }
-    pos += 4;
+    while (src[pos] && !Match("---\n", src+pos)) pos++;
+    if (src[pos]) pos += 4;
   }
 
-  if (src[pos] == 0) return MakeToken(eofToken, pos, 0);
-  if (IsSpace(src[pos])) {
-    u32 len = 0;
+  switch (CharClass(src[pos])) {
+  case endClass:
+    return MakeToken(eofToken, pos, 0);
+  case spaceClass:
+    len = 1;
     while (IsSpace(src[pos+len])) len++;
     return MakeToken(spaceToken, pos, len);
-  }
-  if (IsNewline(src[pos])) return MakeToken(newlineToken, pos, 1);
-  if (IsDigit(src[pos])) {
+  case newlineClass:
+    return MakeToken(newlineToken, pos, 1);
+  case digitClass:
     if (src[pos+1] == 'x') {
-      u32 len = 2;
-      while (IsHexDigit(src[pos+len]) || src[pos+len] == '_') len++;
+      len = 2;
+      while (IsHexChar(src[pos+len])) len++;
       return MakeToken(hexToken, pos, len);
-    } else {
-      u32 len = 1;
-      while (IsDigit(src[pos+len]) || src[pos+len] == '_') len++;
-      return MakeToken(numToken, pos, len);
     }
-  }
-
-  if (src[pos] == '"') {
-    u32 len = 1;
+    len = 1;
+    while (IsNumChar(src[pos+len])) len++;
+    return MakeToken(numToken, pos, len);
+  case stringClass:
+    len = 1;
     while (src[pos+len] && src[pos+len] != '"') {
       if (src[pos+len] == '\\') len++;
       len++;
     }
     if (src[pos+len] == 0) return MakeToken(errorToken, pos, len);
     return MakeToken(stringToken, pos, len+1);
-  }
-  if (src[pos] == '$') {
+  case byteClass:
     if (src[pos+1] == 0) return MakeToken(errorToken, pos, 1);
     if (src[pos+1] == '\\') {
       if (src[pos+2] == 0) return MakeToken(errorToken, pos, 1);
       return MakeToken(byteToken, pos, 3);
     }
     return MakeToken(byteToken, pos, 2);
+  case opClass:
+    type = OpType(src+pos, &len);
+    if (type != errorToken) return MakeToken(type, pos, len);
+    break;
+  case symClass:
+    break;
+  default:
+    return MakeToken(errorToken, pos, 0);
   }
 
-  for (i = 0; i < ArrayCount(operators); i++) {
-    if (Match(operators[i].lexeme, src+pos)) {
-      return MakeToken(operators[i].type, pos, StrLen(operators[i].lexeme));
-    }
-  }
-
-  for (i = 0; i < ArrayCount(keywords); i++) {
-    if (MatchKeyword(keywords[i].lexeme, src+pos)) {
-      return MakeToken(keywords[i].type, pos, StrLen(keywords[i].lexeme));
-    }
-  }
-
-  if (IsSymChar(src[pos])) {
-    u32 len = 0;
-    while (IsSymChar(src[pos+len])) len++;
-    return MakeToken(idToken, pos, len);
-  }
-
-  return MakeToken(errorToken, pos, 0);
+  /* an identifier, or an operator character that can start one */
+  if (!IsSymChar(src[pos])) return MakeToken(errorToken, pos, 0);
+  len = 1;
+  while (IsSymChar(src[pos+len])) len++;
+  return MakeToken(KeywordType(src+pos, len), pos, len);
 }
 
 bool IsKeyword(TokenType type)
@@ -189,3 +271,28 @@ bool IsKeyword(TokenType type)
     return false;
   }
 }
+
+void InitTokenList(TokenList *list, char *text)
+{
+  list->text = text;
+  list->tokens = 0;
+}
+
+void DestroyTokenList(TokenList *list)
+{
+  FreeVec(list->tokens);
+  list->tokens = 0;
+}
+
+Token LexTokens(TokenList *list, u32 index)
+{
+  Token token;
+  u32 count = VecCount(list->tokens);
+  if (count > 0 && list->tokens[count-1].length == 0) return list->tokens[count-1];
+  token = count > 0 ? list->tokens[count-1] : MakeToken(eofToken, 0, 0);
+  do {
+    token = NextToken(list->text, token.pos + token.length);
+    VecPush(list->tokens, token);
+  } while (VecCount(list->tokens) <= index && token.length > 0);
+  return token;
+}
@@ -5,21 +5,34 @@ void InitModule(Module *module)
   module->id = 0;
   module->filename = 0;
   module->source = 0;
+  InitTokenList(&module->tokens, 0);
   module->ast = 0;
   module->code = 0;
   InitHashMap(&module->exports);
+  module->symbols = 0;
+  module->cached = false;
+  module->precompiled = false;
+  module->relocs = 0;
+  module->import_keys = 0;
+  InitArena(&module->arena);
 }
 
 void DestroyModule(Module *module)
 {
   if (module->filename) free(module->filename);
   if (module->source) free(module->source);
-  if (module->ast) FreeNode(module->ast);
-  if (module->code) FreeChunk(module->code);
+  DestroyTokenList(&module->tokens);
   DestroyHashMap(&module->exports);
+  FreeVec(module->symbols);
+  FreeVec(module->relocs);
+  FreeVec(module->import_keys);
+  DestroyArena(&module->arena);
   module->id = 0;
   module->filename = 0;
   module->source = 0;
   module->ast = 0;
   module->code = 0;
+  module->symbols = 0;
+  module->relocs = 0;
+  module->import_keys = 0;
 }
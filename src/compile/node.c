@@ -1,16 +1,19 @@
 #include "compile/node.h"
 #include "runtime/ops.h"
 #include "runtime/symbol.h"
+#include "univ/arena.h"
 
 ASTNode *NewNode(NodeType type, u32 start, u32 end, u32 value)
 {
-  ASTNode *node = malloc(sizeof(ASTNode));
+  ASTNode *node = ArenaNew(ASTNode);
+  u32 i;
   node->nodeType = type;
   node->start = start;
   node->end = end;
   node->data.children = 0;
   node->data.value = value;
-  node->attrs = 0;
+  node->attrBits = 0;
+  for (i = 0; i < numNodeAttrs; i++) node->attrs[i] = 0;
   return node;
 }
 
@@ -35,28 +38,6 @@ ASTNode *WrapNode(ASTNode *node, NodeType type)
   return newNode;
 }
 
-void FreeNode(ASTNode *node)
-{
-  u32 i;
-  if (!IsTerminal(node)) {
-    for (i = 0; i < VecCount(node->data.children); i++) {
-      FreeNode(node->data.children[i]);
-    }
-    FreeVec(node->data.children);
-  }
-  FreeVec(node->attrs);
-  free(node);
-}
-
-void FreeNodeShallow(ASTNode *node)
-{
-  if (!IsTerminal(node)) {
-    FreeVec(node->data.children);
-  }
-  FreeVec(node->attrs);
-  free(node);
-}
-
 bool IsTerminal(ASTNode *node)
 {
   switch (node->nodeType) {
@@ -87,48 +68,10 @@ bool IsConstNode(ASTNode *node)
 
 void NodePush(ASTNode *node, ASTNode *child)
 {
-  VecPush(node->data.children, child);
+  ArenaVecPush(node->data.children, child);
   if (child->end > node->end) node->end = child->end;
 }
 
-void SetNodeAttr(ASTNode *node, char *name, u32 value)
-{
-  u32 i;
-  u32 key = Symbol(name);
-  NodeAttr attr;
-  for (i = 0; i < VecCount(node->attrs); i++) {
-    if (node->attrs[i].name == key) {
-      node->attrs[i].value = value;
-      return;
-    }
-  }
-  attr.name = key;
-  attr.value = value;
-  VecPush(node->attrs, attr);
-}
-
-bool NodeHasAttr(ASTNode *node, char *name)
-{
-  u32 i;
-  u32 key = Symbol(name);
-  for (i = 0; i < VecCount(node->attrs); i++) {
-    if (node->attrs[i].name == key) return true;
-  }
-  return false;
-}
-
-u32 GetNodeAttr(ASTNode *node, char *name)
-{
-  u32 i;
-  u32 key = Symbol(name);
-  for (i = 0; i < VecCount(node->attrs); i++) {
-    if (node->attrs[i].name == key) {
-      return node->attrs[i].value;
-    }
-  }
-  assert(false);
-}
-
 /* Simplifies constant arithemtic and logic expressions, including when they're
  * saved as variables */
 ASTNode *SimplifyNode(ASTNode *node, Env *env)
@@ -150,11 +93,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
     if (pos >= 0) {
       u32 value = EnvGet(pos, env);
       if (value == 0) {
-        FreeNode(node);
         return NewNode(nilNode, start, end, 0);
       } else if (IsInt(value)) {
         u32 value = NodeValue(node);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
     }
@@ -174,24 +115,21 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
   }
 
   case opNode: {
-    u32 op = GetNodeAttr(node, "opCode");
+    u32 op = GetNodeAttr(node, opCodeAttr);
     switch (op) {
     case opNeg:
       NodeChild(node, 0) = SimplifyNode(NodeChild(node, 0), env);
       if (NodeChild(node, 0)->nodeType == intNode) {
         u32 value = NodeValue(NodeChild(node, 0));
-        FreeNode(node);
-        return NewNode(intNode, start, end, IntVal(-RawInt(value)));
+        return NewNode(intNode, start, end, IntVal(-ConstInt(value)));
       }
       return node;
     case opNot:
       NodeChild(node, 0) = SimplifyNode(NodeChild(node, 0), env);
       if (IsConstNode(NodeChild(node, 0))) {
         if (IsNodeFalse(NodeChild(node, 0))) {
-          FreeNode(node);
           return NewNode(intNode, start, end, IntVal(1));
         } else {
-          FreeNode(node);
           return NewNode(intNode, start, end, IntVal(0));
         }
       }
@@ -200,8 +138,7 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 0) = SimplifyNode(NodeChild(node, 0), env);
       if (NodeChild(node, 0)->nodeType == intNode) {
         u32 value = NodeValue(NodeChild(node, 0));
-        FreeNode(node);
-        return NewNode(intNode, start, end, IntVal(~RawInt(value)));
+        return NewNode(intNode, start, end, IntVal(~ConstInt(value)));
       }
       return node;
     case opEq:
@@ -209,13 +146,11 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == nilNode &&
           NodeChild(node, 1)->nodeType == nilNode) {
-        FreeNode(node);
         return NewNode(intNode, start, end, IntVal(1));
       }
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
         bool eq = NodeValue(NodeChild(node, 0)) == NodeValue(NodeChild(node, 1));
-        FreeNode(node);
         return NewNode(intNode, start, end, IntVal(eq));
       }
       return node;
@@ -224,10 +159,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a % b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -236,10 +170,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a & b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -248,10 +181,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a * b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -260,10 +192,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a + b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -272,10 +203,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a - b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -284,10 +214,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a / b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -296,10 +225,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a < b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -308,10 +236,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a << b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -320,10 +247,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a > b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -332,10 +258,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a | b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -344,10 +269,9 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
       if (NodeChild(node, 0)->nodeType == intNode &&
           NodeChild(node, 1)->nodeType == intNode) {
-        i32 a = RawInt(NodeValue(NodeChild(node, 0)));
-        i32 b = RawInt(NodeValue(NodeChild(node, 1)));
+        i32 a = ConstInt(NodeValue(NodeChild(node, 0)));
+        i32 b = ConstInt(NodeValue(NodeChild(node, 1)));
         u32 value = IntVal(a ^ b);
-        FreeNode(node);
         return NewNode(intNode, start, end, value);
       }
       return node;
@@ -376,7 +300,6 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
     NodePush(args, arg);
     NodePush(call, obj);
     NodePush(call, args);
-    FreeNodeShallow(node);
     return call;
   }
 
@@ -385,12 +308,8 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
     NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
     if (IsConstNode(NodeChild(node, 0))) {
       if (IsNodeFalse(NodeChild(node, 0))) {
-        FreeNodeShallow(node);
-        FreeNode(NodeChild(node, 1));
         return NodeChild(node, 0);
       } else {
-        FreeNodeShallow(node);
-        FreeNode(NodeChild(node, 0));
         return NodeChild(node, 1);
       }
     }
@@ -402,12 +321,8 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
     NodeChild(node, 1) = SimplifyNode(NodeChild(node, 1), env);
     if (IsConstNode(NodeChild(node, 0))) {
       if (IsNodeFalse(NodeChild(node, 0))) {
-        FreeNodeShallow(node);
-        FreeNode(NodeChild(node, 0));
         return NodeChild(node, 1);
       } else {
-        FreeNodeShallow(node);
-        FreeNode(NodeChild(node, 1));
         return NodeChild(node, 0);
       }
     }
@@ -420,14 +335,8 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
     arg2 = SimplifyNode(NodeChild(node, 1), env);
     arg3 = SimplifyNode(NodeChild(node, 2), env);
     if (IsNodeFalse(arg1)) {
-      FreeNodeShallow(node);
-      FreeNode(arg1);
-      FreeNode(arg2);
       return arg3;
     } else if (IsConstNode(arg1)) {
-      FreeNodeShallow(node);
-      FreeNode(arg1);
-      FreeNode(arg3);
       return arg2;
     }
     NodeChild(node, 0) = arg1;
@@ -437,7 +346,7 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
   }
 
   case assignNode: {
-    u32 index = GetNodeAttr(node, "index");
+    u32 index = GetNodeAttr(node, indexAttr);
     u32 var = NodeValue(NodeChild(node, 0));
     ASTNode *value = SimplifyNode(NodeChild(node, 1), env);
     if (value->nodeType == intNode || value->nodeType == nilNode) {
@@ -461,12 +370,11 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
   }
 
   case doNode: {
-    u32 numAssigns = GetNodeAttr(node, "numAssigns");
+    u32 numAssigns = GetNodeAttr(node, numAssignsAttr);
     u32 i;
 
     if (numAssigns == 0 && NodeCount(node) == 1) {
       ASTNode *stmt = SimplifyNode(NodeChild(node, 0), env);
-      FreeNodeShallow(node);
       return stmt;
     }
 
@@ -475,7 +383,7 @@ ASTNode *SimplifyNode(ASTNode *node, Env *env)
       ASTNode *child = NodeChild(node, i);
       u32 index, var;
       assert(child->nodeType == assignNode);
-      index = GetNodeAttr(child, "index");
+      index = GetNodeAttr(child, indexAttr);
       var = NodeValue(NodeChild(child, 0));
       EnvSet(var, EnvUndefined, index, env);
     }
@@ -532,6 +440,17 @@ static char *NodeTypeName(i32 type)
   }
 }
 
+static char *NodeAttrName(NodeAttr attr)
+{
+  switch (attr) {
+  case opCodeAttr:      return "opCode";
+  case indexAttr:       return "index";
+  case numAssignsAttr:  return "numAssigns";
+  case guardAttr:       return "guard";
+  default:              assert(false);
+  }
+}
+
 void PrintNodeLevel(ASTNode *node, u32 level, u32 lines)
 {
   u32 i, j;
@@ -540,7 +459,7 @@ void PrintNodeLevel(ASTNode *node, u32 level, u32 lines)
     NodeTypeName(node->nodeType), node->start, node->end);
 
   if (node->nodeType == opNode) {
-    u32 opCode = GetNodeAttr(node, "opCode");
+    u32 opCode = GetNodeAttr(node, opCodeAttr);
     fprintf(stderr, "<%s>", OpName(opCode));
   }
 
@@ -551,18 +470,20 @@ void PrintNodeLevel(ASTNode *node, u32 level, u32 lines)
   }
 */
 
-  if (VecCount(node->attrs) > 0) {
+  if (node->attrBits) {
+    bool first = true;
     fprintf(stderr, " (");
-    for (i = 0; i < VecCount(node->attrs); i++) {
-      char *value_str = SymbolName(node->attrs[i].value);
+    for (i = 0; i < numNodeAttrs; i++) {
+      char *value_str;
+      if (!NodeHasAttr(node, i)) continue;
+      if (!first) fprintf(stderr, ", ");
+      first = false;
+      value_str = SymbolName(node->attrs[i]);
       if (value_str) {
-        fprintf(stderr, "%s: %s",
-          SymbolName(node->attrs[i].name), value_str);
+        fprintf(stderr, "%s: %s", NodeAttrName(i), value_str);
       } else {
-        fprintf(stderr, "%s: %d",
-          SymbolName(node->attrs[i].name), node->attrs[i].value);
+        fprintf(stderr, "%s: %d", NodeAttrName(i), node->attrs[i]);
       }
-      if (i < VecCount(node->attrs) - 1) fprintf(stderr, ", ");
     }
     fprintf(stderr, ")");
   }
@@ -575,7 +496,7 @@ void PrintNodeLevel(ASTNode *node, u32 level, u32 lines)
     fprintf(stderr, " nil\n");
     break;
   case intNode:
-    fprintf(stderr, " %d\n", RawInt(NodeValue(node)));
+    fprintf(stderr, " %d\n", ConstInt(NodeValue(node)));
     break;
   case symNode:
     fprintf(stderr, " %s\n", SymbolName(RawVal(NodeValue(node))));
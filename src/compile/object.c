@@ -0,0 +1,274 @@
+#include "compile/object.h"
+#include "compile/cache.h"
+#include "runtime/mem.h"
+#include "runtime/symbol.h"
+#include "univ/encrypt.h"
+#include "univ/file.h"
+#include "univ/math.h"
+#include "univ/str.h"
+#include "univ/vec.h"
+#include <string.h>
+
+/* Fields after the module's code, in order, and the unit each field's size must be a multiple of */
+static u32 fieldTypes[] = {'VERS', 'NAME', 'SRCS', 'IMPT', 'IKEY', 'RELC'};
+static u32 fieldUnits[] = {1, 1, 1, 1, sizeof(u32), 2*sizeof(u32)};
+enum {versField, nameField, srcsField, imptField, ikeyField, relcField, numFields};
+
+/* The source file an object file was compiled from */
+typedef struct {
+  u64 mtime;
+  u32 size;
+  u8 hash[32];
+} SourceStamp;
+#define FirstField 4 /* after the cache file fields */
+
+static Error *ObjectError(char *message, Module *mod)
+{
+  char *filename = ReplaceExt(mod->filename, OBJECT_EXT);
+  char *name = SymbolName(RawVal(NodeValue(ModuleName(mod))));
+  Error *error = NewError(message, filename, -1, 0);
+  error->message = FormatString(error->message, name);
+  free(filename);
+  return error;
+}
+
+/* A hash of a module's export names, which an importer's code depends on */
+static u32 ExportsKey(Module *mod)
+{
+  ASTNode *exports = ModuleExports(mod);
+  u32 i, key = EmptyHash;
+  for (i = 0; i < NodeCount(exports); i++) {
+    u32 sym = RawVal(NodeValue(NodeChild(exports, i)));
+    key = AppendHash(key, &sym, sizeof(sym));
+  }
+  return key;
+}
+
+/* Imports of the Host pseudo-module aren't modules, so they're left out of an object file */
+static u32 *ImportNames(Module *mod)
+{
+  ASTNode *imports = ModuleImports(mod);
+  u32 *names = 0; /* vec */
+  u32 i;
+  for (i = 0; i < NodeCount(imports); i++) {
+    u32 name = NodeValue(NodeChild(NodeChild(imports, i), 0));
+    if (name == Symbol("Host")) continue;
+    VecPush(names, name);
+  }
+  return names;
+}
+
+static Module *ImportedModule(u32 name, Project *project)
+{
+  return &project->modules[HashMapGet(&project->mod_map, name)];
+}
+
+static void HashSource(char *source, u8 hash[32])
+{
+  Sha256(source, strlen(source), hash);
+}
+
+/*
+ * An object file is only used if its source is gone, or still has the size and mtime it was
+ * compiled from. Mtimes are in seconds, so a source changed in the second the object was written
+ * is also checked against its hash.
+ */
+static bool SourceMatches(Module *mod, IFFChunk *field, u64 object_time)
+{
+  SourceStamp stamp;
+  u64 mtime;
+  u32 size;
+  char *source;
+  u8 hash[32];
+  bool matches;
+
+  if (!FileStat(mod->filename, &mtime, &size)) return true;
+  Copy(IFFData(field), &stamp, sizeof(stamp));
+  if (mtime != stamp.mtime || size != stamp.size) return false;
+  if (mtime < object_time) return true;
+
+  source = ReadTextFile(mod->filename);
+  if (!source) return false;
+  HashSource(source, hash);
+  free(source);
+  matches = memcmp(hash, stamp.hash, sizeof(hash)) == 0;
+  return matches;
+}
+
+static bool LoadObject(Module *mod, IFFChunk *form, u32 file_size, u64 object_time)
+{
+  IFFChunk *fields[numFields];
+  u8 compiler_key[32];
+  u32 *name = 0, *imports = 0; /* vec */
+  u32 code_size, num_relocs, i;
+  IFFChunk *code;
+  ASTNode *import_node;
+  bool valid;
+
+  if (!ValidModuleFile(form, file_size, 'COBJ')) return false;
+  code = GetModuleField(form, 0, 'CODE', 1);
+  if (!code) return false;
+  for (i = 0; i < numFields; i++) {
+    fields[i] = GetModuleField(form, FirstField + i, fieldTypes[i], fieldUnits[i]);
+    if (!fields[i]) return false;
+  }
+
+  CompilerKey(compiler_key);
+  if (IFFDataSize(fields[versField]) != sizeof(compiler_key)) return false;
+  if (memcmp(IFFData(fields[versField]), compiler_key, sizeof(compiler_key)) != 0) return false;
+  if (IFFDataSize(fields[srcsField]) != sizeof(SourceStamp)) return false;
+  if (!SourceMatches(mod, fields[srcsField], object_time)) return false;
+
+  /* each module ID must be within the code, and refer to this module or an import */
+  name = LoadNames(IFFData(fields[nameField]), IFFDataSize(fields[nameField]), 0);
+  imports = LoadNames(IFFData(fields[imptField]), IFFDataSize(fields[imptField]), 0);
+  code_size = IFFDataSize(code);
+  num_relocs = IFFDataSize(fields[relcField])/(2*sizeof(u32));
+  valid = VecCount(name) == 1 &&
+    IFFDataSize(fields[ikeyField])/sizeof(u32) == VecCount(imports);
+  for (i = 0; valid && i < num_relocs; i++) {
+    u32 reloc[2];
+    Copy((u32*)IFFData(fields[relcField]) + 2*i, reloc, sizeof(reloc));
+    valid = reloc[0] < code_size && code_size - reloc[0] >= ModuleRefSize &&
+      reloc[1] <= VecCount(imports);
+  }
+
+  if (valid) {
+    mod->ast = NewNode(moduleNode, 0, 0, 0);
+    NodePush(mod->ast, NewNode(idNode, 0, 0, IntVal(name[0])));
+    import_node = NewNode(tupleNode, 0, 0, 0);
+    for (i = 0; i < VecCount(imports); i++) {
+      ASTNode *import = NewNode(importNode, 0, 0, 0);
+      NodePush(import, NewNode(idNode, 0, 0, IntVal(imports[i])));
+      NodePush(import, NewNode(idNode, 0, 0, IntVal(imports[i])));
+      NodePush(import, NewNode(listNode, 0, 0, 0));
+      NodePush(import_node, import);
+    }
+    NodePush(mod->ast, import_node);
+    valid = LoadModuleCode(mod, form);
+  }
+
+  if (valid) {
+    GrowVec(mod->relocs, 2*num_relocs);
+    Copy(IFFData(fields[relcField]), mod->relocs, 2*num_relocs*sizeof(u32));
+    GrowVec(mod->import_keys, VecCount(imports));
+    Copy(IFFData(fields[ikeyField]), mod->import_keys, VecCount(imports)*sizeof(u32));
+    mod->precompiled = true;
+  } else {
+    mod->ast = 0;
+  }
+
+  FreeVec(name);
+  FreeVec(imports);
+  return valid;
+}
+
+bool ReadModuleObject(Module *mod)
+{
+  char *filename = ReplaceExt(mod->filename, OBJECT_EXT);
+  u64 object_time;
+  u32 file_size;
+  IFFChunk *form;
+  bool found;
+
+  if (!FileStat(filename, &object_time, &file_size)) {
+    free(filename);
+    return false;
+  }
+
+  form = MapFile(filename, &file_size);
+  free(filename);
+  if (!form) return false;
+  found = LoadObject(mod, form, file_size, object_time);
+  /* the object file stands in for the source in the module's cache key */
+  if (found) Sha256(form, file_size, mod->cache_key);
+  UnmapFile(form, file_size);
+  return found;
+}
+
+Error *WriteModuleObject(Module *mod, Project *project)
+{
+  u32 name = NodeValue(ModuleName(mod));
+  char *mod_name = SymbolName(RawVal(name));
+  u32 *imports = ImportNames(mod); /* vec */
+  u32 *keys = 0, *relocs = 0; /* vec */
+  char *names = 0; /* vec */
+  u8 compiler_key[32];
+  SourceStamp stamp;
+  u32 offset = 0, i;
+  IFFChunk *form;
+  Chunk *chunk;
+  char *filename;
+  bool written;
+
+  for (i = 0; i < VecCount(imports); i++) {
+    PushName(&names, RawVal(imports[i]));
+    VecPush(keys, ExportsKey(ImportedModule(imports[i], project)));
+  }
+
+  /* each module ID follows the const op at the start of its chunk */
+  for (chunk = mod->code; chunk; chunk = chunk->next) {
+    if (chunk->module_ref) {
+      u32 target = 0;
+      if (chunk->module_ref != name) {
+        while (imports[target] != chunk->module_ref) target++;
+        target++;
+      }
+      VecPush(relocs, offset + 1);
+      VecPush(relocs, target);
+    }
+    offset += VecCount(chunk->data);
+  }
+
+  /* zeroed so the padding is written deterministically */
+  memset(&stamp, 0, sizeof(stamp));
+  FileStat(mod->filename, &stamp.mtime, &stamp.size);
+  HashSource(mod->source, stamp.hash);
+
+  CompilerKey(compiler_key);
+  form = SerializeModuleCode(mod, 'COBJ');
+  form = AppendField(form, 'VERS', compiler_key, sizeof(compiler_key));
+  form = AppendField(form, 'NAME', mod_name, strlen(mod_name) + 1);
+  form = AppendField(form, 'SRCS', &stamp, sizeof(stamp));
+  form = AppendField(form, 'IMPT', names, VecCount(names));
+  form = AppendField(form, 'IKEY', keys, VecCount(keys)*sizeof(u32));
+  form = AppendField(form, 'RELC', relocs, VecCount(relocs)*sizeof(u32));
+  FreeVec(imports);
+  FreeVec(keys);
+  FreeVec(relocs);
+  FreeVec(names);
+
+  filename = ReplaceExt(mod->filename, OBJECT_EXT);
+  written = WriteModuleFile(form, filename);
+  free(filename);
+  free(form);
+  if (!written) return ObjectError("Couldn't write object file for \"^\"", mod);
+  return 0;
+}
+
+Error *CheckModuleObject(Module *mod, Project *project)
+{
+  ASTNode *imports = ModuleImports(mod);
+  u32 i;
+  for (i = 0; i < NodeCount(imports); i++) {
+    u32 name = NodeValue(NodeChild(NodeChild(imports, i), 0));
+    if (ExportsKey(ImportedModule(name, project)) != mod->import_keys[i]) {
+      return ObjectError("Precompiled module \"^\" is out of date", mod);
+    }
+  }
+  return 0;
+}
+
+void RelocateModule(Module *mod, u8 *code, Project *project)
+{
+  ASTNode *imports = ModuleImports(mod);
+  u32 i;
+  for (i = 0; i < VecCount(mod->relocs); i += 2) {
+    u32 offset = mod->relocs[i], target = mod->relocs[i + 1];
+    Module *ref = mod;
+    if (target > 0) {
+      ref = ImportedModule(NodeValue(NodeChild(NodeChild(imports, target - 1), 0)), project);
+    }
+    WritePaddedLEB(IntVal(ref->id - 1), ModuleRefSize, offset, code);
+  }
+}
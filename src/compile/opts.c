@@ -11,9 +11,15 @@ static void Usage(void)
   fprintf(stderr, "Usage: cassette [opts] script\n");
   fprintf(stderr, "  -v            Print version\n");
   fprintf(stderr, "  -c            Compile project\n");
+  fprintf(stderr, "  -s            Snapshot project after loading its imports\n");
+  fprintf(stderr, "  -o            Precompile each module in a folder (given in place of script)\n");
   fprintf(stderr, "  -d            Enable debug mode\n");
+  fprintf(stderr, "  -g pause      Collect garbage incrementally, with a max pause in microseconds\n");
+  fprintf(stderr, "  -p interval   Profile heap allocations, sampling every interval bytes\n");
+  fprintf(stderr, "  -M limit      Limit the heap to limit megabytes\n");
   fprintf(stderr, "  -L lib_path   Library search path (default $CASSETTE_PATH)\n");
   fprintf(stderr, "  -m manifest   Project file list (default all .ct files in current directory)\n");
+  fprintf(stderr, "  -C cache_path Compile cache folder (default $HOME/.cache/cassette, \"\" to disable)\n");
 }
 
 /* Search for an existing library path in this order:
@@ -33,6 +39,14 @@ static char *GetLibPath(void)
   return 0;
 }
 
+/* Use $XDG_CACHE_HOME/cassette if set, or $HOME/.cache/cassette */
+static char *GetCachePath(void)
+{
+  char *path = getenv("XDG_CACHE_HOME");
+  if (path && *path) return JoinStr(path, "cassette", '/');
+  return StrCat(HomeDir(), "/.cache/cassette");
+}
+
 static void PrintVersion(void)
 {
   char *lib_path = GetLibPath();
@@ -46,11 +60,17 @@ Opts *DefaultOpts(void)
   Opts *opts = malloc(sizeof(Opts));
   opts->debug = false;
   opts->compile = false;
+  opts->snapshot = false;
+  opts->precompile = false;
   opts->lib_path = GetLibPath();
   opts->entry = 0;
   opts->manifest = 0;
   opts->source_ext = NewString(DEFAULT_EXT);
   opts->program_args = 0;
+  opts->gc_pause = 0;
+  opts->heap_profile = 0;
+  opts->mem_limit = 0;
+  opts->cache_path = GetCachePath();
   return opts;
 }
 
@@ -59,18 +79,61 @@ Opts *ParseOpts(int argc, char *argv[])
   Opts *opts = DefaultOpts();
   int ch, i;
 
-  while ((ch = getopt(argc, argv, "chvdL:m:")) >= 0) {
+  while ((ch = getopt(argc, argv, "chsovdg:p:M:L:m:C:")) >= 0) {
     switch (ch) {
     case 'c':
       opts->compile = true;
       break;
+    case 's':
+      opts->snapshot = true;
+      break;
+    case 'o':
+      opts->precompile = true;
+      break;
     case 'd':
       opts->debug = true;
       break;
+    case 'g': {
+      char *arg = optarg;
+      i32 pause;
+      if (!ParseInt(&arg, 10, &pause) || *arg || pause < 0) {
+        Usage();
+        FreeOpts(opts);
+        return 0;
+      }
+      opts->gc_pause = pause;
+      break;
+    }
+    case 'p': {
+      char *arg = optarg;
+      i32 interval;
+      if (!ParseInt(&arg, 10, &interval) || *arg || interval <= 0) {
+        Usage();
+        FreeOpts(opts);
+        return 0;
+      }
+      opts->heap_profile = interval;
+      break;
+    }
+    case 'M': {
+      char *arg = optarg;
+      i32 limit;
+      if (!ParseInt(&arg, 10, &limit) || *arg || limit <= 0) {
+        Usage();
+        FreeOpts(opts);
+        return 0;
+      }
+      opts->mem_limit = limit;
+      break;
+    }
     case 'L':
       free(opts->lib_path);
       opts->lib_path = NewString(optarg);
       break;
+    case 'C':
+      free(opts->cache_path);
+      opts->cache_path = *optarg ? NewString(optarg) : 0;
+      break;
     case 'v':
       PrintVersion();
       FreeOpts(opts);
@@ -98,6 +161,12 @@ Opts *ParseOpts(int argc, char *argv[])
   for (i = optind; i < argc; i++) {
     VecPush(opts->program_args, NewString(argv[i]));
   }
+
+  /* cached code can't be relocated, so precompiling always compiles */
+  if (opts->precompile && opts->cache_path) {
+    free(opts->cache_path);
+    opts->cache_path = 0;
+  }
   return opts;
 }
 
@@ -106,6 +175,7 @@ void FreeOpts(Opts *opts)
   if (opts->lib_path) free(opts->lib_path);
   if (opts->manifest) free(opts->manifest);
   if (opts->source_ext) free(opts->source_ext);
+  if (opts->cache_path) free(opts->cache_path);
   if (opts->program_args) {
     u32 i;
     for (i = 0; i < VecCount(opts->program_args); i++) {
@@ -20,11 +20,11 @@ typedef struct {
   Precedence prec;
 } CParseRule;
 
-#define Adv(p) (p)->token = NextToken((p)->text, (p)->token.pos + (p)->token.length)
+#define Adv(p) ((p)->index++, (p)->token = TokenAt((p)->tokens, (p)->index))
 #define AtEnd(p)            ((p)->token.type == eofToken)
 #define CheckToken(t, p)    ((p)->token.type == (t))
 #define Lexeme(token, p)    SymbolFrom((p)->text + (token).pos, (token).length)
-#define ParseFail(n,r)      ((n) ? FreeNode(n), (r) : (r))
+#define ParseFail(n,r)      (r) /* n is freed with the module's arena */
 #define Spacing(p)          MatchToken(spaceToken, p)
 #define MakeTerminal(type, value, p) \
   NewNode(type, (p)->token.pos, (p)->token.pos + (p)->token.length, value)
@@ -34,12 +34,12 @@ typedef struct {
 #define Expected(s, n, p)   ParseFail(n, ParseError("Expected \"" s "\"", p))
 #define ParseExpr(p)        ParsePrec(precExpr, p)
 
-void InitParser(Parser *p, char *text)
+void InitParser(Parser *p, TokenList *tokens)
 {
-  p->text = text;
-  p->token.pos = 0;
-  p->token.length = 0;
-  Adv(p);
+  p->text = tokens->text;
+  p->tokens = tokens;
+  p->index = 0;
+  p->token = TokenAt(tokens, 0);
 }
 
 static ASTNode *ParseError(char *msg, Parser *p)
@@ -259,7 +259,7 @@ static ASTNode *ParseOp(ASTNode *expr, Parser *p)
   node = MakeNode(opNode, p);
   node->start = token.pos;
   node->end = token.pos + token.length;
-  SetNodeAttr(node, "opCode", OpCodeFor(token.type));
+  SetNodeAttr(node, opCodeAttr, OpCodeFor(token.type));
   NodePush(node, expr);
   NodePush(node, arg);
   return node;
@@ -274,7 +274,7 @@ static ASTNode *ParseNegOp(ASTNode *expr, Parser *p)
 
   arg = VecPop(node->data.children);
   neg = MakeNode(opNode, p);
-  SetNodeAttr(neg, "opCode", opNeg);
+  SetNodeAttr(neg, opCodeAttr, opNeg);
   NodePush(neg, arg);
   NodePush(node, neg);
   return node;
@@ -287,7 +287,7 @@ static ASTNode *ParseNotOp(ASTNode *expr, Parser *p)
   ASTNode *not;
   if (IsErrorNode(node)) return node;
   not = MakeNode(opNode, p);
-  SetNodeAttr(not, "opCode", opNot);
+  SetNodeAttr(not, opCodeAttr, opNot);
   NodePush(not, node);
   return not;
 }
@@ -342,7 +342,7 @@ static ASTNode *ParsePair(ASTNode *expr, Parser *p)
   node = MakeNode(opNode, p);
   node->start = token.pos;
   node->end = token.pos + token.length;
-  SetNodeAttr(node, "opCode", opPair);
+  SetNodeAttr(node, opCodeAttr, opPair);
   NodePush(node, arg);
   NodePush(node, expr);
   return node;
@@ -377,7 +377,7 @@ static ASTNode *ParseAccess(ASTNode *expr, Parser *p)
   Adv(p);
   node = MakeNode(opNode, p);
   node->start = expr->start;
-  SetNodeAttr(node, "opCode", opGet);
+  SetNodeAttr(node, opCodeAttr, opGet);
   NodePush(node, expr);
   VSpacing(p);
 
@@ -387,7 +387,7 @@ static ASTNode *ParseAccess(ASTNode *expr, Parser *p)
 
   VSpacing(p);
   if (MatchToken(commaToken, p)) {
-    SetNodeAttr(node, "opCode", opSlice);
+    SetNodeAttr(node, opCodeAttr, opSlice);
     VSpacing(p);
     arg = ParseExpr(p);
     if (IsErrorNode(arg)) return ParseFail(node, arg);
@@ -522,7 +522,7 @@ static ASTNode *ParseNum(Parser *p)
     i32 d;
     if (lexeme[i] == '_') continue;
     d = lexeme[i] - '0';
-    if (n > (MaxIntVal - d)/10) return ParseError("Integer overflow", p);
+    if (n > (MaxConstInt - d)/10) return ParseError("Integer overflow", p);
     n = n*10 + d;
   }
   node = MakeTerminal(intNode, IntVal(n), p);
@@ -542,7 +542,7 @@ static ASTNode *ParseHex(Parser *p)
     i32 d;
     if (lexeme[i] == '_') continue;
     d = IsDigit(lexeme[i]) ? lexeme[i] - '0' : lexeme[i] - 'A' + 10;
-    if (n > (MaxIntVal - d)/16) return ParseError("Integer overflow", p);
+    if (n > (MaxConstInt - d)/16) return ParseError("Integer overflow", p);
     n = n*16 + d;
   }
   node = MakeTerminal(intNode, IntVal(n), p);
@@ -588,7 +588,7 @@ static ASTNode *ParseUnary(Parser *p)
   if (IsErrorNode(arg)) return arg;
   node = MakeNode(opNode, p);
   node->start = token.pos;
-  SetNodeAttr(node, "opCode", UnaryOpCodeFor(token.type));
+  SetNodeAttr(node, opCodeAttr, UnaryOpCodeFor(token.type));
   NodePush(node, arg);
   return node;
 }
@@ -704,7 +704,7 @@ static ASTNode *ParseAssigns(Parser *p)
     VSpacing(p);
     assign = ParseAssign(p);
     if (IsErrorNode(assign)) return ParseFail(node, assign);
-    SetNodeAttr(assign, "index", NodeCount(node));
+    SetNodeAttr(assign, indexAttr, NodeCount(node));
     NodePush(node, assign);
   } while (MatchToken(commaToken, p));
   return node;
@@ -728,7 +728,7 @@ static ASTNode *PanicNode(char *msg, Parser *p)
   ASTNode *panic = MakeNode(opNode, p);
   ASTNode *msgNode = MakeTerminal(symNode, IntVal(Symbol(msg)), p);
   NodePush(panic, msgNode);
-  SetNodeAttr(panic, "opCode", opPanic);
+  SetNodeAttr(panic, opCodeAttr, opPanic);
   return panic;
 }
 
@@ -741,7 +741,7 @@ static ASTNode *ParseGuard(Parser *p)
   test = ParseExpr(p);
   if (IsErrorNode(test)) return ParseFail(node, test);
   test = WrapNode(test, opNode);
-  SetNodeAttr(test, "opCode", opNot);
+  SetNodeAttr(test, opCodeAttr, opNot);
   NodePush(node, test);
   VSpacing(p);
   if (!MatchToken(elseToken, p)) return Expected("else", node, p);
@@ -750,7 +750,7 @@ static ASTNode *ParseGuard(Parser *p)
   if (IsErrorNode(alt)) return ParseFail(node, alt);
   NodePush(node, alt);
   NodePush(node, NilNode(p));
-  SetNodeAttr(node, "guard", 1);
+  SetNodeAttr(node, guardAttr, 1);
   return node;
 }
 
@@ -768,7 +768,7 @@ static ASTNode *RecordBody(ASTNode *params, Parser *p)
     ASTNode *param = NodeChild(params, i);
     ASTNode *sym = CloneNode(param);
     ASTNode *predicate = MakeNode(opNode, p);
-    SetNodeAttr(predicate, "opCode", opEq);
+    SetNodeAttr(predicate, opCodeAttr, opEq);
     NodePush(predicate, CloneNode(lambdaParam));
     sym->nodeType = symNode;
     NodePush(predicate, sym);
@@ -824,7 +824,7 @@ static ASTNode *ParseRecord(Parser *p)
   assert(MatchToken(recordToken, p));
   Spacing(p);
   id = ParseID(p);
-  if (IsErrorNode(id)) ParseFail(node, id);
+  if (IsErrorNode(id)) return ParseFail(node, id);
   NodePush(node, id);
   lambda = MakeNode(lambdaNode, p);
   NodePush(node, lambda);
@@ -848,7 +848,7 @@ static ASTNode *ParseDef(Parser *p)
   assert(MatchToken(defToken, p));
   Spacing(p);
   id = ParseID(p);
-  if (IsErrorNode(id)) ParseFail(node, id);
+  if (IsErrorNode(id)) return ParseFail(node, id);
   NodePush(node, id);
   lambda = MakeNode(lambdaNode, p);
   NodePush(node, lambda);
@@ -866,12 +866,11 @@ static ASTNode *ParseDef(Parser *p)
     if (IsErrorNode(test)) return ParseFail(node, test);
     Spacing(p);
     if (!(MatchToken(commaToken, p) || MatchToken(newlineToken, p))) {
-      FreeNode(test);
       return Expected(",", node, p);
     }
     VSpacing(p);
     guard = MakeNode(ifNode, p);
-    SetNodeAttr(guard, "guard", true);
+    SetNodeAttr(guard, guardAttr, true);
     NodePush(guard, test);
     NodePush(lambda, guard);
   }
@@ -904,17 +903,9 @@ static void InitStmtParser(StmtParser *sp)
 
 static void DestroyStmtParser(StmtParser *sp)
 {
-  u32 i, j;
-  for (i = 0; i < VecCount(sp->defs); i++) {
-    for (j = 0; j < VecCount(sp->defs[i]); j++) {
-      if (sp->defs[i][j]) FreeNode(sp->defs[i][j]);
-    }
-    FreeVec(sp->defs[i]);
-  }
+  u32 i;
+  for (i = 0; i < VecCount(sp->defs); i++) FreeVec(sp->defs[i]);
   FreeVec(sp->defs);
-  for (i = 0; i < VecCount(sp->stmts); i++) {
-    if (sp->stmts[i]) FreeNode(sp->stmts[i]);
-  }
   FreeVec(sp->stmts);
   DestroyHashMap(&sp->def_map);
 }
@@ -959,7 +950,7 @@ static ASTNode *CombineDefs(ASTNode **defs)
   for (i = 1; i < VecCount(defs); i++) {
     ASTNode *def = defs[i];
     ASTNode *body = NodeChild(NodeChild(def, 1), 1); /* lambda body */
-    if (GetNodeAttr(current, "guard")) {
+    if (NodeHasAttr(current, guardAttr)) {
       ASTNode *params = NodeChild(NodeChild(def, 1), 0);
       u32 j;
       if (NodeCount(params) != NodeCount(masterParams)) {
@@ -973,11 +964,8 @@ static ASTNode *CombineDefs(ASTNode **defs)
       }
       assert(current->nodeType == ifNode);
       /* replace alternative with next def body */
-      FreeNode(NodeChild(current, 2));
       NodeChild(current, 2) = body;
       current = body;
-    } else {
-      FreeNode(def);
     }
   }
   return master;
@@ -988,7 +976,7 @@ static void AppendDefs(StmtParser *sp, ASTNode *node)
   u32 i;
   for (i = 0; i < VecCount(sp->defs); i++) {
     ASTNode *def = CombineDefs(sp->defs[i]);
-    SetNodeAttr(def, "index", NodeCount(node));
+    SetNodeAttr(def, indexAttr, NodeCount(node));
     NodePush(node, def);
     FreeVec(sp->defs[i]);
   }
@@ -1006,15 +994,13 @@ static void AppendStmts(StmtParser *sp, u32 index, ASTNode *node)
     NodePush(node, stmt);
     if (stmt->nodeType == letNode) {
       node = NewNode(doNode, stmt->start, node->end, 0);
-      SetNodeAttr(node, "numAssigns", 0);
-      FreeNode(NodeChild(stmt, 1));
+      SetNodeAttr(node, numAssignsAttr, 0);
       NodeChild(stmt, 1) = node;
       AppendStmts(sp, i+1, node);
       return;
-    } else if (stmt->nodeType == ifNode && NodeHasAttr(stmt, "guard")) {
+    } else if (stmt->nodeType == ifNode && NodeHasAttr(stmt, guardAttr)) {
       node = NewNode(doNode, stmt->start, node->end, 0);
-      SetNodeAttr(node, "numAssigns", 0);
-      FreeNode(NodeChild(stmt, 2));
+      SetNodeAttr(node, numAssignsAttr, 0);
       NodeChild(stmt, 2) = node;
       AppendStmts(sp, i+1, node);
       return;
@@ -1068,7 +1054,7 @@ static ASTNode *ParseStmts(Parser *p)
 
   /* Add the defNodes, combining each group of the same name into one */
   AppendDefs(&sp, node);
-  SetNodeAttr(node, "numAssigns", NodeCount(node));
+  SetNodeAttr(node, numAssignsAttr, NodeCount(node));
 
   /* Add the rest of the statements, combining letNodes as necessary */
   AppendStmts(&sp, 0, node);
@@ -1181,7 +1167,7 @@ static ASTNode *FindExports(ASTNode *body, Parser *p)
   u32 i, count;
   if (body->nodeType != doNode) return EmptyNode(p);
 
-  count = GetNodeAttr(body, "numAssigns");
+  count = GetNodeAttr(body, numAssignsAttr);
   exports = MakeNode(tupleNode, p);
 
   /* depends on exported defs being first in body */
@@ -1193,11 +1179,11 @@ static ASTNode *FindExports(ASTNode *body, Parser *p)
   return exports;
 }
 
-ASTNode *ParseModuleHeader(char *source)
+ASTNode *ParseModuleHeader(TokenList *tokens)
 {
   Parser p;
   ASTNode *node, *name, *imports;
-  InitParser(&p, source);
+  InitParser(&p, tokens);
 
   VSpacing(&p);
   node = MakeNode(moduleNode, &p);
@@ -1210,14 +1196,16 @@ ASTNode *ParseModuleHeader(char *source)
   if (IsErrorNode(imports)) return ParseFail(node, imports);
   NodePush(node, imports);
 
+  /* the header ends where the module body starts */
+  node->end = p.token.pos;
   return node;
 }
 
-ASTNode *ParseModule(char *source)
+ASTNode *ParseModule(TokenList *tokens)
 {
   Parser p;
   ASTNode *node, *name, *imports, *exports, *body;
-  InitParser(&p, source);
+  InitParser(&p, tokens);
 
   VSpacing(&p);
   node = MakeNode(moduleNode, &p);
@@ -1,5 +1,8 @@
 #include "compile/project.h"
+#include "compile/cache.h"
 #include "compile/compile.h"
+#include "compile/index.h"
+#include "compile/object.h"
 #include "compile/parse.h"
 #include "runtime/mem.h"
 #include "runtime/ops.h"
@@ -7,6 +10,7 @@
 #include "runtime/vm.h"
 #include "univ/file.h"
 #include "univ/str.h"
+#include "univ/thread.h"
 #include "univ/vec.h"
 
 static Error *FileNotFound(char *filename)
@@ -30,14 +34,31 @@ static Error *BadImportList(char *imports)
   return error;
 }
 
-static void AddStrings(ASTNode *node, Program *program, HashMap *strings)
+/* Collects the symbols and strings used in a module, in order, so their names can be added to the
+ * program. A cached module isn't parsed, so its strings aren't interned otherwise. */
+static void CollectSymbols(ASTNode *node, Module *mod, HashMap *seen)
 {
   u32 i;
-  if (node->nodeType == symNode) {
-    u32 len, sym;
+  if (node->nodeType == symNode || node->nodeType == strNode) {
+    u32 sym = RawVal(NodeValue(node));
+    if (HashMapContains(seen, sym)) return;
+    HashMapSet(seen, sym, 1);
+    VecPush(mod->symbols, sym);
+    return;
+  }
+  if (IsTerminal(node)) return;
+  for (i = 0; i < NodeCount(node); i++) {
+    CollectSymbols(NodeChild(node, i), mod, seen);
+  }
+}
+
+static void AddStrings(Module *mod, Program *program, HashMap *strings)
+{
+  u32 i;
+  for (i = 0; i < VecCount(mod->symbols); i++) {
+    u32 len, sym = mod->symbols[i];
     char *name;
-    sym = RawVal(NodeValue(node));
-    if (HashMapContains(strings, sym)) return;
+    if (HashMapContains(strings, sym)) continue;
     HashMapSet(strings, sym, 1);
     name = SymbolName(sym);
     len = StrLen(name);
@@ -47,11 +68,6 @@ static void AddStrings(ASTNode *node, Program *program, HashMap *strings)
     GrowVec(program->strings, len);
     Copy(name, VecEnd(program->strings) - len, len);
     VecPush(program->strings, 0);
-    return;
-  }
-  if (IsTerminal(node)) return;
-  for (i = 0; i < NodeCount(node); i++) {
-    AddStrings(NodeChild(node, i), program, strings);
   }
 }
 
@@ -94,19 +110,23 @@ Error *AddProjectFile(Project *project, char *filename)
 {
   u32 i;
   Module mod;
-  char *source;
   for (i = 0; i < VecCount(project->modules); i++) {
     if (StrEq(project->modules[i].filename, filename)) return 0;
   }
-  source = ReadTextFile(filename);
-  if (!source) return FileNotFound(filename);
+  if (!FileExists(filename)) return FileNotFound(filename);
   InitModule(&mod);
   mod.filename = NewString(filename);
-  mod.source = source;
   VecPush(project->modules, mod);
   return 0;
 }
 
+/* Sources are read when they're needed, since most files' headers come from the module index */
+static bool LoadSource(Module *mod)
+{
+  if (!mod->source) mod->source = ReadTextFile(mod->filename);
+  return mod->source != 0;
+}
+
 void ScanProjectFolder(Project *project, char *path)
 {
   u32 i;
@@ -157,6 +177,7 @@ static Error *ScanModuleDeps(
   ASTNode *imports = ModuleImports(mod);
 
   mod->id = VecCount(project->build_list) + VecCount(*scan_list);
+  if (project->opts->precompile) mod->id++; /* no module is the entry module */
 
   if (NodeCount(imports) > 0) {
     VecPush(*scan_list, mod_index);
@@ -187,12 +208,23 @@ static Error *ScanModuleDeps(
   return 0;
 }
 
+/* When precompiling, every module with a name is built, starting from each in turn */
 static Error *ScanDeps(Project *project)
 {
   u32 *scan_list = 0; /* vec */
   HashMap build_set = EmptyHashMap;
   HashMap scan_set = EmptyHashMap;
-  Error *error = ScanModuleDeps(project->entry_index, &scan_list, &build_set, &scan_set, project);
+  Error *error = 0;
+  if (project->opts->precompile) {
+    u32 i;
+    for (i = 0; i < VecCount(project->modules) && !error; i++) {
+      if (HashMapContains(&build_set, i)) continue;
+      if (!NodeValue(ModuleName(&project->modules[i]))) continue;
+      error = ScanModuleDeps(i, &scan_list, &build_set, &scan_set, project);
+    }
+  } else {
+    error = ScanModuleDeps(project->entry_index, &scan_list, &build_set, &scan_set, project);
+  }
   FreeVec(scan_list);
   DestroyHashMap(&build_set);
   DestroyHashMap(&scan_set);
@@ -204,12 +236,15 @@ static void LinkModules(Project *project)
 {
   u32 i;
   Chunk *intro_chunk = 0;
+  Arena arena;
   u32 size;
   Program *program = NewProgram();
   HashMap strings = EmptyHashMap;
   u8 *cur;
 
   /* The intro chunk sets up the module register (if there are any imports) */
+  InitArena(&arena);
+  SetLocalArena(&arena);
   if (VecCount(project->build_list) > 1) {
     intro_chunk = NewChunk(0);
     Emit(opTuple, intro_chunk);
@@ -232,15 +267,18 @@ static void LinkModules(Project *project)
   if (intro_chunk) {
     AddChunkSource(intro_chunk, 0, &program->srcmap);
     cur = SerializeChunk(intro_chunk, cur);
-    FreeChunk(intro_chunk);
   }
+  SetLocalArena(0);
+  DestroyArena(&arena);
 
   /* serialize each module chunk */
   for (i = 0; i < VecCount(project->build_list); i++) {
     Module *mod = &project->modules[project->build_list[i]];
     AddChunkSource(mod->code, mod->filename, &program->srcmap);
-    AddStrings(mod->ast, program, &strings);
+    AddStrings(mod, program, &strings);
+    program->entry = cur - program->code;
     cur = SerializeChunk(mod->code, cur);
+    if (mod->precompiled) RelocateModule(mod, program->code + program->entry, project);
   }
 
   DestroyHashMap(&strings);
@@ -248,49 +286,253 @@ static void LinkModules(Project *project)
   project->program = program;
 }
 
-Error *BuildProject(Project *project)
+/* Shared state for parsing and compiling modules in parallel. Each task only touches its own
+ * module, symbol set and error. */
+typedef struct {
+  Project *project;
+  SymbolSet *symbols;
+  Error **errors;
+  ModuleIndex *index; /* read-only while tasks run */
+  IndexEntry *files; /* each header task's file; the header is set if the file was read */
+} BuildTasks;
+
+static void ParseHeaderTask(u32 index, void *data)
 {
-  u32 i;
-  Error *error;
+  BuildTasks *tasks = data;
+  Module *mod = &tasks->project->modules[index];
+  IndexEntry *file = &tasks->files[index];
+  Project *project = tasks->project;
+  char *header = 0;
+  SetLocalSymbols(&tasks->symbols[index]);
+  SetLocalArena(&mod->arena);
+  if (index != project->entry_index && !project->opts->precompile && ReadModuleObject(mod)) {
+    SetLocalSymbols(0);
+    SetLocalArena(0);
+    return;
+  }
+  file->path = AbsolutePath(mod->filename);
+  if (file->path && FileStat(file->path, &file->mtime, &file->size)) {
+    header = IndexedHeader(tasks->index, file->path, file->mtime, file->size);
+  }
+  if (header) {
+    TokenList tokens;
+    InitTokenList(&tokens, header);
+    mod->ast = ParseModuleHeader(&tokens);
+    DestroyTokenList(&tokens);
+  } else if (LoadSource(mod)) {
+    InitTokenList(&mod->tokens, mod->source);
+    mod->ast = ParseModuleHeader(&mod->tokens);
+    file->header = mod->source;
+  } else {
+    tasks->errors[index] = FileNotFound(mod->filename);
+  }
+  SetLocalSymbols(0);
+  SetLocalArena(0);
+}
+
+static void ParseModuleTask(u32 index, void *data)
+{
+  BuildTasks *tasks = data;
+  Module *mod = &tasks->project->modules[tasks->project->build_list[index]];
+  if (mod->cached) return;
+  SetLocalSymbols(&tasks->symbols[index]);
+  /* the arena only holds the module's header so far */
+  DestroyArena(&mod->arena);
+  SetLocalArena(&mod->arena);
+  /* the header's tokens are reused if the header was parsed from the source */
+  if (!mod->tokens.text) InitTokenList(&mod->tokens, mod->source);
+  mod->ast = SimplifyNode(ParseModule(&mod->tokens), 0);
+  DestroyTokenList(&mod->tokens);
+  SetLocalSymbols(0);
+  SetLocalArena(0);
+}
+
+/* Modules only read each other's export tables, so they can all be compiled at once */
+static void CompileTask(u32 index, void *data)
+{
+  BuildTasks *tasks = data;
+  u32 mod_index = tasks->project->build_list[index];
+  Module *mod = &tasks->project->modules[mod_index];
+  char *cache_path = tasks->project->opts->cache_path;
   Compiler c;
+  if (mod->cached) return;
+  SetLocalSymbols(&tasks->symbols[index]);
+  SetLocalArena(&mod->arena);
+  InitCompiler(&c, tasks->project);
+  c.current_mod = mod_index;
+  tasks->errors[index] = Compile(&c, mod);
+  DestroyCompiler(&c);
+  if (!tasks->errors[index]) {
+    HashMap seen = EmptyHashMap;
+    CollectSymbols(mod->ast, mod, &seen);
+    DestroyHashMap(&seen);
+    if (cache_path) WriteCachedModule(mod, cache_path);
+  }
+  SetLocalSymbols(0);
+  SetLocalArena(0);
+}
 
-  SetSymbolSize(valBits);
+static Error *ModuleParseError(Module *mod)
+{
+  char *msg = SymbolName(mod->ast->data.value);
+  u32 len = mod->ast->end - mod->ast->start;
+  return NewError(msg, mod->filename, mod->ast->start, len);
+}
 
-  /* parse each source file and add it to mod_map */
-  for (i = 0; i < VecCount(project->modules); i++) {
+/* A precompiled module whose imports' exports have changed is compiled from its source instead.
+ * It's out of date only if there's no source. */
+static Error *CheckPrecompiled(Module *mod, Project *project)
+{
+  Error *error = CheckModuleObject(mod, project);
+  if (!error || !LoadSource(mod)) return error;
+  FreeError(error);
+
+  mod->precompiled = false;
+  mod->cached = false;
+  mod->code = 0;
+  FreeVec(mod->symbols);
+  FreeVec(mod->relocs);
+  FreeVec(mod->import_keys);
+  mod->symbols = 0;
+  mod->relocs = 0;
+  mod->import_keys = 0;
+  if (project->opts->cache_path) ModuleCacheKey(mod, project);
+
+  DestroyArena(&mod->arena);
+  SetLocalArena(&mod->arena);
+  InitTokenList(&mod->tokens, mod->source);
+  mod->ast = SimplifyNode(ParseModule(&mod->tokens), 0);
+  DestroyTokenList(&mod->tokens);
+  SetLocalArena(0);
+  if (IsErrorNode(mod->ast)) return ModuleParseError(mod);
+  return 0;
+}
+
+static void InitBuildTasks(BuildTasks *tasks, Project *project, u32 count)
+{
+  u32 i;
+  tasks->project = project;
+  tasks->symbols = malloc(count*sizeof(SymbolSet));
+  tasks->errors = malloc(count*sizeof(Error*));
+  tasks->index = 0;
+  tasks->files = 0;
+  for (i = 0; i < count; i++) {
+    InitSymbolSet(&tasks->symbols[i]);
+    tasks->errors[i] = 0;
+  }
+}
+
+/* Merges each task's symbols in task order, so the symbol table doesn't depend on scheduling */
+static void FinishBuildTasks(BuildTasks *tasks, u32 count)
+{
+  u32 i;
+  for (i = 0; i < count; i++) MergeSymbols(&tasks->symbols[i]);
+}
+
+static void DestroyBuildTasks(BuildTasks *tasks)
+{
+  free(tasks->symbols);
+  free(tasks->errors);
+}
+
+/* Parses each project file's header and adds it to mod_map. Headers of files that haven't changed
+ * come from the module index, and the headers of files that were read are added to it. */
+static Error *ScanHeaders(Project *project)
+{
+  u32 i;
+  Error *error = 0;
+  BuildTasks tasks;
+  ModuleIndex index;
+  u32 num_modules = VecCount(project->modules);
+
+  LoadModuleIndex(&index, project->opts->cache_path);
+  InitBuildTasks(&tasks, project, num_modules);
+  tasks.index = &index;
+  tasks.files = malloc(num_modules*sizeof(IndexEntry));
+  for (i = 0; i < num_modules; i++) {
+    tasks.files[i].path = 0;
+    tasks.files[i].header = 0;
+  }
+  RunTasks(ParseHeaderTask, num_modules, &tasks);
+  FinishBuildTasks(&tasks, num_modules);
+
+  for (i = 0; i < num_modules; i++) {
     Module *mod = &project->modules[i];
+    IndexEntry *file = &tasks.files[i];
     u32 name;
 
-    mod->ast = ParseModuleHeader(mod->source);
-
-    if (IsErrorNode(mod->ast)) {
-      char *msg = SymbolName(mod->ast->data.value);
-      u32 len = mod->ast->end - mod->ast->start;
-      return NewError(msg, mod->filename, mod->ast->start, len);
+    if (tasks.errors[i]) {
+      if (error) {
+        FreeError(tasks.errors[i]);
+      } else {
+        error = tasks.errors[i];
+      }
+    } else if (!error && IsErrorNode(mod->ast)) {
+      error = ModuleParseError(mod);
     }
 
-    name = NodeValue(ModuleName(mod));
-    if (name) HashMapSet(&project->mod_map, name, i);
+    if (!error) {
+      name = NodeValue(ModuleName(mod));
+      if (name) HashMapSet(&project->mod_map, name, i);
+      if (file->header) {
+        IndexModule(&index, file->path, file->mtime, file->size, file->header, mod->ast->end);
+      }
+    }
+    free(file->path);
   }
 
+  if (!error) SaveModuleIndex(&index, project->opts->cache_path);
+  free(tasks.files);
+  DestroyBuildTasks(&tasks);
+  DestroyModuleIndex(&index);
+  return error;
+}
+
+Error *BuildProject(Project *project)
+{
+  u32 i;
+  Error *error = 0;
+  BuildTasks tasks;
+
+  SetSymbolSize(symBits);
+
+  /* parse each project file's header and add it to mod_map */
+  error = ScanHeaders(project);
+  if (error) return error;
+
   /* create the build list */
   error = ScanDeps(project);
   if (error) return error;
 
-  /* parse each module in the build list */
+  /* read each module in the build list and look it up in the compile cache; a module's imports
+   * come before it in the build list, so their keys are already known */
+  for (i = 0; i < VecCount(project->build_list); i++) {
+    Module *mod = &project->modules[project->build_list[i]];
+    if (!mod->precompiled && !LoadSource(mod)) return FileNotFound(mod->filename);
+    if (project->opts->cache_path) {
+      ModuleCacheKey(mod, project);
+      if (!mod->cached) {
+        SetLocalArena(&mod->arena);
+        ReadCachedModule(mod, project->opts->cache_path);
+        SetLocalArena(0);
+      }
+    }
+  }
+
+  /* parse each module in the build list that wasn't cached */
+  InitBuildTasks(&tasks, project, VecCount(project->build_list));
+  RunTasks(ParseModuleTask, VecCount(project->build_list), &tasks);
+  FinishBuildTasks(&tasks, VecCount(project->build_list));
+  DestroyBuildTasks(&tasks);
   for (i = 0; i < VecCount(project->build_list); i++) {
-    u32 mod_index = project->build_list[i];
-    Module *mod = &project->modules[mod_index];
+    Module *mod = &project->modules[project->build_list[i]];
     ASTNode *exports;
     u32 j;
 
-    FreeNode(mod->ast);
-    mod->ast = SimplifyNode(ParseModule(mod->source), 0);
-
-    if (IsErrorNode(mod->ast)) {
-      char *msg = SymbolName(mod->ast->data.value);
-      u32 len = mod->ast->end - mod->ast->start;
-      return NewError(msg, mod->filename, mod->ast->start, len);
+    if (IsErrorNode(mod->ast)) return ModuleParseError(mod);
+    if (mod->precompiled) {
+      error = CheckPrecompiled(mod, project);
+      if (error) return error;
     }
 
     /* index the module's exports */
@@ -301,20 +543,24 @@ Error *BuildProject(Project *project)
     }
   }
 
-  /* compile each module in the build list */
-  InitCompiler(&c, project);
+  /* compile each module in the build list, reporting the first error in build order. When
+   * precompiling, each module that compiles is written to an object file, even if others fail. */
+  InitBuildTasks(&tasks, project, VecCount(project->build_list));
+  RunTasks(CompileTask, VecCount(project->build_list), &tasks);
+  FinishBuildTasks(&tasks, VecCount(project->build_list));
   for (i = 0; i < VecCount(project->build_list); i++) {
-    u32 mod_index = project->build_list[i];
-    Module *mod = &project->modules[mod_index];
-    c.current_mod = mod_index;
-
-    error = Compile(&c, mod);
+    if (!tasks.errors[i] && project->opts->precompile) {
+      tasks.errors[i] = WriteModuleObject(&project->modules[project->build_list[i]], project);
+    }
+    if (!tasks.errors[i]) continue;
     if (error) {
-      DestroyCompiler(&c);
-      return error;
+      FreeError(tasks.errors[i]);
+    } else {
+      error = tasks.errors[i];
     }
   }
-  DestroyCompiler(&c);
+  DestroyBuildTasks(&tasks);
+  if (error || project->opts->precompile) return error;
 
   /* generate program from compiled modules */
   LinkModules(project);
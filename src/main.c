@@ -5,14 +5,19 @@
 #include "univ/str.h"
 
 /* This file is the command-line interface to Cassette. It's job is to build and/or run Cassette
- * programs based on the given options. There are three * basic modes:
+ * programs based on the given options. There are five basic modes:
  *
  * 1. Compile and run a project from source files (default).
  * 2. Compile a project to an image to run later (-c option).
- * 3. Run a previously-compiled image.
+ * 3. Compile a project and save a snapshot after its imports have loaded (-s option).
+ * 4. Run a previously-compiled image.
+ * 5. Resume a snapshot (a ".snap" file).
  *
- * The entry file must always be specified. This is either the entry source file for a program or a
- * compiled image file. See "opts.h" for a description of all options.
+ * The entry file must always be specified. This is either the entry source file for a program, a
+ * compiled image file, or a snapshot. See "opts.h" for a description of all options.
+ *
+ * Separately, a library folder can be precompiled into object files (-o option), which later builds
+ * link instead of compiling those modules.
  */
 
 int main(int argc, char *argv[])
@@ -24,6 +29,20 @@ int main(int argc, char *argv[])
   opts = ParseOpts(argc, argv);
   if (!opts) return 1;
 
+  if (opts->precompile) {
+    Project *project = NewProject(opts);
+    ScanProjectFolder(project, opts->entry);
+    error = BuildProject(project);
+    FreeProject(project);
+    FreeOpts(opts);
+    if (error) {
+      PrintError(error);
+      FreeError(error);
+      return 1;
+    }
+    return 0;
+  }
+
   if (opts->manifest || StrEq(FileExt(opts->entry), opts->source_ext)) {
     Project *project = NewProject(opts);
     if (opts->manifest) {
@@ -54,8 +73,32 @@ int main(int argc, char *argv[])
       return 0;
     }
 
+    if (opts->snapshot) {
+      char *path = opts->entry ? opts->entry : opts->manifest;
+      path = ReplaceExt(path, ".snap");
+      error = VMSnapshot(project->program, opts, path);
+      FreeProgram(project->program);
+      FreeProject(project);
+      FreeOpts(opts);
+      free(path);
+      if (error) {
+        PrintError(error);
+        FreeError(error);
+        return 1;
+      }
+      return 0;
+    }
+
     program = project->program;
     FreeProject(project);
+  } else if (StrEq(FileExt(opts->entry), ".snap")) {
+    error = VMResume(opts->entry, opts);
+    if (error) {
+      PrintError(error);
+      FreeError(error);
+    }
+    FreeOpts(opts);
+    return 0;
   } else {
     Error *error = ReadProgramFile(opts->entry, &program);
     if (error) {
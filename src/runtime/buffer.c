@@ -0,0 +1,90 @@
+#include "runtime/buffer.h"
+#include "runtime/symbol.h"
+#include "univ/math.h"
+#include "univ/str.h"
+
+#define MinCapacity 16
+
+enum {bufTag, bufLength, bufData};
+#define BufferFields 3
+
+bool IsBuffer(val value)
+{
+  return IsTuple(value) && ObjLength(value) == BufferFields &&
+    TupleGet(value, bufTag) == IntVal(Symbol("Buffer"));
+}
+
+val NewBuffer(u32 capacity)
+{
+  val data = NewBinary(Max(capacity, MinCapacity)), buffer;
+  StackPush(data);
+  buffer = Tuple(BufferFields);
+  data = StackPop();
+  TupleSet(buffer, bufTag, IntVal(Symbol("Buffer")));
+  TupleSet(buffer, bufLength, IntVal(0));
+  TupleSet(buffer, bufData, data);
+  return buffer;
+}
+
+u32 BufferLength(val buffer)
+{
+  return (u32)RawVal(TupleGet(buffer, bufLength));
+}
+
+bool BufferFinished(val buffer)
+{
+  return TupleGet(buffer, bufData) == 0;
+}
+
+/* Makes room for count more bytes, growing the data by at least double */
+static val BufferReserve(val buffer, u32 count)
+{
+  u32 length = BufferLength(buffer);
+  u32 capacity = ObjLength(TupleGet(buffer, bufData));
+  val data;
+
+  if (length + count <= capacity) return buffer;
+  StackPush(buffer);
+  data = NewBinary(Max(2*capacity, length + count));
+  buffer = StackPop();
+  Copy(BinaryData(TupleGet(buffer, bufData)), BinaryData(data), length);
+  TupleSet(buffer, bufData, data);
+  return buffer;
+}
+
+val BufferWrite(val buffer, val iolist)
+{
+  u32 size = IOListSize(iolist), length;
+  StackPush(iolist);
+  buffer = BufferReserve(buffer, size);
+  iolist = StackPop();
+
+  length = BufferLength(buffer);
+  FormatValTo(iolist, BinaryData(TupleGet(buffer, bufData)) + length);
+  TupleSet(buffer, bufLength, IntVal(length + size));
+  return buffer;
+}
+
+val BufferWriteInt(val buffer, ival value, u32 size, bool little_endian)
+{
+  u32 i, length;
+  char *bytes;
+  buffer = BufferReserve(buffer, size);
+  length = BufferLength(buffer);
+  bytes = BinaryData(TupleGet(buffer, bufData)) + length;
+  for (i = 0; i < size; i++) {
+    u32 shift = 8*(little_endian ? i : size - 1 - i);
+    bytes[i] = shift < 8*sizeof(ival) ? (value >> shift) & 0xFF : (value < 0 ? 0xFF : 0);
+  }
+  TupleSet(buffer, bufLength, IntVal(length + size));
+  return buffer;
+}
+
+val FinishBuffer(val buffer)
+{
+  val data = TupleGet(buffer, bufData);
+  u32 length = BufferLength(buffer);
+  TupleSet(buffer, bufLength, IntVal(0));
+  TupleSet(buffer, bufData, 0);
+  return BinaryTruncate(data, length);
+}
@@ -0,0 +1,80 @@
+#include "runtime/builder.h"
+#include "runtime/map.h"
+#include "runtime/symbol.h"
+
+enum {builderTag, builderKind, builderValue};
+#define BuilderFields 3
+
+bool IsBuilder(val value)
+{
+  return IsTuple(value) && ObjLength(value) == BuilderFields &&
+    TupleGet(value, builderTag) == IntVal(Symbol("Builder"));
+}
+
+val BuilderKind(val builder)
+{
+  return TupleGet(builder, builderKind);
+}
+
+u32 BuilderLength(val builder)
+{
+  return ObjLength(TupleGet(builder, builderValue));
+}
+
+val NewBuilder(val kind, u32 length)
+{
+  val value = 0, builder;
+  u32 i;
+  if (kind == IntVal(Symbol("tuple"))) {
+    value = Tuple(length);
+  } else if (kind == IntVal(Symbol("binary"))) {
+    char *data;
+    value = NewBinary(length);
+    data = BinaryData(value);
+    for (i = 0; i < length; i++) data[i] = 0;
+  }
+
+  StackPush(value);
+  builder = Tuple(BuilderFields);
+  value = StackPop();
+  TupleSet(builder, builderTag, IntVal(Symbol("Builder")));
+  TupleSet(builder, builderKind, kind);
+  TupleSet(builder, builderValue, value);
+  return builder;
+}
+
+void BuilderSet(val builder, u32 index, val value)
+{
+  val object = TupleGet(builder, builderValue);
+  if (BuilderKind(builder) == IntVal(Symbol("binary"))) {
+    BinarySet(object, index, RawInt(value));
+  } else {
+    TupleSet(object, index, value);
+  }
+}
+
+val BuilderPut(val builder, val key, val value)
+{
+  val entries;
+  StackPush(builder);
+  StackPush(key);
+  StackPush(value);
+  ReserveMem(4);
+  value = StackPop();
+  key = StackPop();
+  builder = StackPop();
+
+  entries = Pair(Pair(key, value), TupleGet(builder, builderValue));
+  TupleSet(builder, builderValue, entries);
+  return builder;
+}
+
+val FreezeBuilder(val builder)
+{
+  val kind = BuilderKind(builder);
+  val value = TupleGet(builder, builderValue);
+  TupleSet(builder, builderKind, 0);
+  TupleSet(builder, builderValue, 0);
+  if (kind == IntVal(Symbol("map"))) return StackToMap(value);
+  return value;
+}
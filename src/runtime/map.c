@@ -0,0 +1,505 @@
+#include "runtime/map.h"
+#include "runtime/symbol.h"
+#include "univ/math.h"
+#include "univ/str.h"
+
+#define MapBits     5
+#define MapWidth    (1 << MapBits)
+#define MapLevels   7 /* levels of branch nodes; enough to use every hash bit */
+
+/* Cells to copy a node with an extra slot, at each level and in a collision node */
+#define LevelCells      (MapWidth + 3)
+/* Cells to split two entries into a path of new nodes, down to a collision node */
+#define SplitCells      (MapLevels*4 + 3)
+#define RecordCells     4
+#define EntryCells      2
+
+enum {mapTag, mapCount, mapRoot};
+#define MapFields   3
+
+#define NodeBits(n)       ((u32)RawVal(TupleGet(n, 0)) | ((u32)RawVal(TupleGet(n, 1)) << 16))
+#define NodeSlots(n)      (ObjLength(n) - 2)
+#define NodeSlot(n, i)    TupleGet(n, (i) + 2)
+#define HashChunk(h, depth) (((h) >> (MapBits*(depth))) & (MapWidth - 1))
+#define HashBit(h, depth) ((u32)1 << HashChunk(h, depth))
+#define BitIndex(bits, bit) PopCount((bits) & ((bit) - 1))
+
+#define KeyHash(key)      ((u32)RawVal(HashVal(key)))
+#define EntryKey(e)       Head(e)
+
+bool IsMap(val value)
+{
+  return IsTuple(value) && ObjLength(value) == MapFields &&
+    TupleGet(value, mapTag) == IntVal(Symbol("Map"));
+}
+
+static val MakeMap(u32 count, val root)
+{
+  val map = Tuple(MapFields);
+  TupleSet(map, mapTag, IntVal(Symbol("Map")));
+  TupleSet(map, mapCount, IntVal(count));
+  TupleSet(map, mapRoot, root);
+  return map;
+}
+
+static val NewNode(u32 bits, u32 count)
+{
+  val node = Tuple(count + 2);
+  TupleSet(node, 0, IntVal(bits & 0xFFFF));
+  TupleSet(node, 1, IntVal(bits >> 16));
+  return node;
+}
+
+/* Copies a node with a slot inserted at index */
+static val InsertSlot(val node, u32 bits, u32 index, val slot)
+{
+  u32 i, count = NodeSlots(node);
+  val copy = NewNode(bits, count + 1);
+  for (i = 0; i < index; i++) TupleSet(copy, i + 2, NodeSlot(node, i));
+  TupleSet(copy, index + 2, slot);
+  for (i = index; i < count; i++) TupleSet(copy, i + 3, NodeSlot(node, i));
+  return copy;
+}
+
+/* Copies a node with the slot at index removed */
+static val RemoveSlot(val node, u32 bits, u32 index)
+{
+  u32 i, count = NodeSlots(node);
+  val copy = NewNode(bits, count - 1);
+  for (i = 0; i < index; i++) TupleSet(copy, i + 2, NodeSlot(node, i));
+  for (i = index + 1; i < count; i++) TupleSet(copy, i + 1, NodeSlot(node, i));
+  return copy;
+}
+
+/* Copies a tuple with the item at index replaced */
+static val ReplaceItem(val tuple, u32 index, val item)
+{
+  u32 i, count = ObjLength(tuple);
+  val copy = Tuple(count);
+  for (i = 0; i < count; i++) TupleSet(copy, i, TupleGet(tuple, i));
+  TupleSet(copy, index, item);
+  return copy;
+}
+
+/* Returns the index of a key's entry in a collision node, or its length if it's missing */
+static u32 CollisionIndex(val node, val key)
+{
+  u32 i, count = ObjLength(node);
+  for (i = 0; i < count; i++) {
+    if (ValEq(EntryKey(TupleGet(node, i)), key)) break;
+  }
+  return i;
+}
+
+/* Returns the key's entry, or nil */
+static val FindEntry(val map, val key)
+{
+  u32 hash = KeyHash(key), depth;
+  val node = TupleGet(map, mapRoot);
+  if (!node) return 0;
+
+  for (depth = 0; depth < MapLevels; depth++) {
+    u32 bits = NodeBits(node), bit = HashBit(hash, depth);
+    val slot;
+    if (!(bits & bit)) return 0;
+    slot = NodeSlot(node, BitIndex(bits, bit));
+    if (!IsTuple(slot)) return ValEq(EntryKey(slot), key) ? slot : 0;
+    node = slot;
+  }
+
+  depth = CollisionIndex(node, key);
+  return depth < ObjLength(node) ? TupleGet(node, depth) : 0;
+}
+
+/* The most cells changing a key can allocate: a copy of each node on its path, plus a split */
+static u32 UpdateCells(val map, u32 hash)
+{
+  u32 depth, cells = RecordCells + EntryCells + SplitCells;
+  val node = TupleGet(map, mapRoot);
+  if (!node) return cells + LevelCells;
+
+  for (depth = 0; depth < MapLevels; depth++) {
+    u32 bits = NodeBits(node), bit = HashBit(hash, depth);
+    cells += LevelCells;
+    if (!(bits & bit)) return cells;
+    node = NodeSlot(node, BitIndex(bits, bit));
+    if (!IsTuple(node)) return cells;
+  }
+
+  return cells + ObjLength(node) + 2;
+}
+
+/* Makes the smallest subtree at depth holding two entries with different keys */
+static val SplitEntries(val a, u32 a_hash, val b, u32 b_hash, u32 depth)
+{
+  u32 a_bit, b_bit;
+  val node;
+
+  if (depth == MapLevels) {
+    node = Tuple(2);
+    TupleSet(node, 0, a);
+    TupleSet(node, 1, b);
+    return node;
+  }
+
+  a_bit = HashBit(a_hash, depth);
+  b_bit = HashBit(b_hash, depth);
+  if (a_bit == b_bit) {
+    node = NewNode(a_bit, 1);
+    TupleSet(node, 2, SplitEntries(a, a_hash, b, b_hash, depth + 1));
+  } else {
+    node = NewNode(a_bit | b_bit, 2);
+    TupleSet(node, a_bit < b_bit ? 2 : 3, a);
+    TupleSet(node, a_bit < b_bit ? 3 : 2, b);
+  }
+  return node;
+}
+
+/* Returns the node with the key set, or the same node if it already holds the same value */
+static val PutNode(val node, u32 depth, u32 hash, val key, val value, bool *added)
+{
+  u32 bits, bit, index;
+  val slot;
+
+  if (depth == MapLevels) {
+    index = CollisionIndex(node, key);
+    if (index == ObjLength(node)) {
+      val copy = Tuple(index + 1);
+      u32 i;
+      for (i = 0; i < index; i++) TupleSet(copy, i, TupleGet(node, i));
+      TupleSet(copy, index, Pair(key, value));
+      *added = true;
+      return copy;
+    }
+    if (Tail(TupleGet(node, index)) == value) return node;
+    return ReplaceItem(node, index, Pair(key, value));
+  }
+
+  bits = NodeBits(node);
+  bit = HashBit(hash, depth);
+  index = BitIndex(bits, bit);
+  if (!(bits & bit)) {
+    *added = true;
+    return InsertSlot(node, bits | bit, index, Pair(key, value));
+  }
+
+  slot = NodeSlot(node, index);
+  if (IsTuple(slot)) {
+    val child = PutNode(slot, depth + 1, hash, key, value, added);
+    if (child == slot) return node;
+    return ReplaceItem(node, index + 2, child);
+  }
+
+  if (ValEq(EntryKey(slot), key)) {
+    if (Tail(slot) == value) return node;
+    return ReplaceItem(node, index + 2, Pair(key, value));
+  }
+
+  *added = true;
+  slot = SplitEntries(slot, KeyHash(EntryKey(slot)), Pair(key, value), hash, depth + 1);
+  return ReplaceItem(node, index + 2, slot);
+}
+
+/*
+ * Returns the node without the key, or the same node if the key is missing. Below the root, a node
+ * left with a single entry is replaced by the entry. At the root, an empty node becomes nil.
+ */
+static val DeleteNode(val node, u32 depth, u32 hash, val key)
+{
+  u32 bits, bit, index;
+  val slot;
+
+  if (depth == MapLevels) {
+    u32 i, count = ObjLength(node);
+    val copy;
+    index = CollisionIndex(node, key);
+    if (index == count) return node;
+    if (count == 2) return TupleGet(node, 1 - index);
+    copy = Tuple(count - 1);
+    for (i = 0; i < index; i++) TupleSet(copy, i, TupleGet(node, i));
+    for (i = index + 1; i < count; i++) TupleSet(copy, i - 1, TupleGet(node, i));
+    return copy;
+  }
+
+  bits = NodeBits(node);
+  bit = HashBit(hash, depth);
+  if (!(bits & bit)) return node;
+  index = BitIndex(bits, bit);
+  slot = NodeSlot(node, index);
+
+  if (IsTuple(slot)) {
+    val child = DeleteNode(slot, depth + 1, hash, key);
+    if (child == slot) return node;
+    if (!IsTuple(child) && NodeSlots(node) == 1 && depth > 0) return child;
+    return ReplaceItem(node, index + 2, child);
+  }
+
+  if (!ValEq(EntryKey(slot), key)) return node;
+  if (NodeSlots(node) == 1) return 0;
+  if (NodeSlots(node) == 2 && depth > 0 && !IsTuple(NodeSlot(node, 1 - index))) {
+    return NodeSlot(node, 1 - index);
+  }
+  return RemoveSlot(node, bits & ~bit, index);
+}
+
+val NewMap(void)
+{
+  ReserveMem(RecordCells);
+  return MakeMap(0, 0);
+}
+
+u32 MapCount(val map)
+{
+  return (u32)RawVal(TupleGet(map, mapCount));
+}
+
+bool MapContains(val map, val key)
+{
+  return FindEntry(map, key) != 0;
+}
+
+val MapGet(val map, val key, val missing)
+{
+  val entry = FindEntry(map, key);
+  return entry ? Tail(entry) : missing;
+}
+
+val MapPut(val map, val key, val value)
+{
+  u32 hash = KeyHash(key);
+  bool added = false;
+  val root;
+
+  StackPush(value);
+  StackPush(key);
+  StackPush(map);
+  ReserveMem(UpdateCells(map, hash));
+  map = StackPop();
+  key = StackPop();
+  value = StackPop();
+
+  root = TupleGet(map, mapRoot);
+  if (!root) {
+    root = NewNode(HashBit(hash, 0), 1);
+    TupleSet(root, 2, Pair(key, value));
+    added = true;
+  } else {
+    root = PutNode(root, 0, hash, key, value, &added);
+    if (root == TupleGet(map, mapRoot)) return map;
+  }
+  return MakeMap(MapCount(map) + added, root);
+}
+
+val MapDelete(val map, val key)
+{
+  u32 hash = KeyHash(key);
+  val root;
+
+  if (!TupleGet(map, mapRoot)) return map;
+  StackPush(key);
+  StackPush(map);
+  ReserveMem(UpdateCells(map, hash));
+  map = StackPop();
+  key = StackPop();
+
+  root = DeleteNode(TupleGet(map, mapRoot), 0, hash, key);
+  if (root == TupleGet(map, mapRoot)) return map;
+  return MakeMap(MapCount(map) - 1, root);
+}
+
+/*
+ * Maps are loaded from a list of entries in one pass. The entries are sorted by their hash chunks,
+ * level by level, so each subtree's entries are together. Entries replaced by another with the same
+ * key are marked, then each node is built once, at its final size.
+ */
+typedef struct {
+  u32 hash;
+  u32 order; /* position in the list */
+  bool replaced;
+} MapItem;
+
+static u32 LiveItems(MapItem *items, u32 count)
+{
+  u32 i, live = 0;
+  for (i = 0; i < count; i++) live += !items[i].replaced;
+  return live;
+}
+
+static u32 ChunkEnd(MapItem *items, u32 count, u32 start, u32 depth)
+{
+  u32 end, chunk = HashChunk(items[start].hash, depth);
+  for (end = start + 1; end < count; end++) {
+    if (HashChunk(items[end].hash, depth) != chunk) break;
+  }
+  return end;
+}
+
+/* Marks items whose key is repeated, keeping the first or last in list order */
+static void MarkReplaced(MapItem *items, u32 count, val *entries, bool keep_first)
+{
+  u32 i, j;
+  for (i = 0; i < count; i++) {
+    MapItem *item = keep_first ? &items[i] : &items[count - 1 - i];
+    val key = EntryKey(entries[item->order]);
+    for (j = 0; j < i; j++) {
+      MapItem *kept = keep_first ? &items[j] : &items[count - 1 - j];
+      if (!kept->replaced && ValEq(EntryKey(entries[kept->order]), key)) {
+        item->replaced = true;
+        break;
+      }
+    }
+  }
+}
+
+/* Stably sorts items by each level's hash chunk in turn */
+static void SortItems(MapItem *items, MapItem *scratch, u32 count, u32 depth, val *entries,
+    bool keep_first)
+{
+  u32 ends[MapWidth], i, start;
+  if (count < 2) return;
+  if (depth == MapLevels) {
+    MarkReplaced(items, count, entries, keep_first);
+    return;
+  }
+
+  for (i = 0; i < MapWidth; i++) ends[i] = 0;
+  for (i = 0; i < count; i++) ends[HashChunk(items[i].hash, depth)]++;
+  for (i = 1; i < MapWidth; i++) ends[i] += ends[i - 1];
+  for (i = count; i > 0; i--) scratch[--ends[HashChunk(items[i - 1].hash, depth)]] = items[i - 1];
+  Copy(scratch, items, count*sizeof(MapItem));
+
+  for (start = 0; start < count; start = i) {
+    i = ChunkEnd(items, count, start, depth);
+    SortItems(items + start, scratch, i - start, depth + 1, entries, keep_first);
+  }
+}
+
+/* Cells to load sorted items into a subtree; a single entry below the root is used as is */
+static u32 LoadCells(MapItem *items, u32 count, u32 depth)
+{
+  u32 start, end, cells, live = LiveItems(items, count);
+  if (live < 2 && depth > 0) return 0;
+  if (depth == MapLevels) return live + 1;
+
+  cells = 3;
+  for (start = 0; start < count; start = end) {
+    end = ChunkEnd(items, count, start, depth);
+    if (LiveItems(items + start, end - start) == 0) continue;
+    cells += 1 + LoadCells(items + start, end - start, depth + 1);
+  }
+  return cells;
+}
+
+static val LiveEntry(MapItem *items, u32 count, val *entries)
+{
+  u32 i;
+  for (i = 0; i < count; i++) {
+    if (!items[i].replaced) return entries[items[i].order];
+  }
+  return 0;
+}
+
+/* Builds a node from sorted items with at least two live entries, or any at the root */
+static val LoadNode(MapItem *items, u32 count, u32 depth, val *entries)
+{
+  val slots[MapWidth], node;
+  u32 i, start, end, bits = 0, num_slots = 0;
+
+  if (depth == MapLevels) {
+    node = Tuple(LiveItems(items, count));
+    for (i = 0; i < count; i++) {
+      if (!items[i].replaced) TupleSet(node, num_slots++, entries[items[i].order]);
+    }
+    return node;
+  }
+
+  for (start = 0; start < count; start = end) {
+    u32 live;
+    end = ChunkEnd(items, count, start, depth);
+    live = LiveItems(items + start, end - start);
+    if (live == 0) continue;
+    bits |= HashBit(items[start].hash, depth);
+    if (live == 1) {
+      slots[num_slots++] = LiveEntry(items + start, end - start, entries);
+    } else {
+      slots[num_slots++] = LoadNode(items + start, end - start, depth + 1, entries);
+    }
+  }
+
+  node = NewNode(bits, num_slots);
+  for (i = 0; i < num_slots; i++) TupleSet(node, i + 2, slots[i]);
+  return node;
+}
+
+static val LoadMap(val list, bool keep_first)
+{
+  MapItem *items, *scratch;
+  val *entries, map, rest;
+  u32 i, count = 0;
+
+  for (rest = list; rest; rest = Tail(rest)) count++;
+  if (count == 0) return NewMap();
+
+  items = malloc(count*sizeof(MapItem));
+  scratch = malloc(count*sizeof(MapItem));
+  entries = malloc(count*sizeof(val));
+  for (i = 0, rest = list; i < count; i++, rest = Tail(rest)) {
+    entries[i] = Head(rest);
+    items[i].hash = KeyHash(EntryKey(entries[i]));
+    items[i].order = i;
+    items[i].replaced = false;
+  }
+  SortItems(items, scratch, count, 0, entries, keep_first);
+
+  /* collecting garbage moves the entries, so they're read again afterwards */
+  StackPush(list);
+  ReserveMem(RecordCells + LoadCells(items, count, 0));
+  list = StackPop();
+  for (i = 0, rest = list; i < count; i++, rest = Tail(rest)) entries[i] = Head(rest);
+
+  map = MakeMap(LiveItems(items, count), LoadNode(items, count, 0, entries));
+  free(items);
+  free(scratch);
+  free(entries);
+  return map;
+}
+
+val ListToMap(val list)
+{
+  return LoadMap(list, false);
+}
+
+val StackToMap(val list)
+{
+  return LoadMap(list, true);
+}
+
+static val NodeEntries(val node, u32 depth, val list)
+{
+  u32 i, count;
+  if (depth == MapLevels) {
+    count = ObjLength(node);
+    for (i = 0; i < count; i++) list = Pair(TupleGet(node, i), list);
+    return list;
+  }
+
+  count = NodeSlots(node);
+  for (i = 0; i < count; i++) {
+    val slot = NodeSlot(node, i);
+    if (IsTuple(slot)) {
+      list = NodeEntries(slot, depth + 1, list);
+    } else {
+      list = Pair(slot, list);
+    }
+  }
+  return list;
+}
+
+val MapEntries(val map)
+{
+  StackPush(map);
+  ReserveMem(2*MapCount(map));
+  map = StackPop();
+  if (!TupleGet(map, mapRoot)) return 0;
+  return NodeEntries(TupleGet(map, mapRoot), 0, 0);
+}
@@ -1,40 +1,147 @@
 #include "runtime/mem.h"
+#include "runtime/profile.h"
 #include "runtime/symbol.h"
-#include "univ/hashmap.h"
 #include "univ/math.h"
 #include "univ/str.h"
+#include "univ/time.h"
 #include "univ/vec.h"
+#include <string.h>
 
 #define MIN_CAPACITY  1000000
+#define GC_WORK_RATIO 4     /* cells scanned per cell allocated during incremental collection */
+#define MIN_QUANTUM   256
+#define MAX_QUANTUM   (1 << 20)
+#define OOM_RESERVE   (1 << 16) /* cells held back to finish an instruction after running out */
+#define COMPACT_LIMIT 2         /* compact in place once the heap is over 1/N of the memory limit */
+#define MIN_RECLAIM   16        /* the heap is exhausted if compaction frees less than 1/N of it */
+#define MAX_RUN       MIN_QUANTUM /* pairs copied per cdr-coded run during incremental collection */
 
 static Mem mem = {0};
 
+static void OutOfMemory(void)
+{
+  fprintf(stderr, "Out of memory\n");
+  exit(1);
+}
+
+#define IsCollecting()  (mem.from_end > mem.from_start)
+#define IsFromSpace(v)  (IsObj(v) && RawVal(v) - mem.from_start < mem.from_end - mem.from_start)
+
+/* Side bitmaps have one bit per heap cell */
+#define BitmapWords(n)  (((n) + 31) / 32)
+#define GetBit(map, i)  ((map)[(i) >> 5] & ((u32)1 << ((i) & 31)))
+#define SetBit(map, i)  ((map)[(i) >> 5] |= (u32)1 << ((i) & 31))
+#define ClearBit(map, i) ((map)[(i) >> 5] &= ~((u32)1 << ((i) & 31)))
+#define CdrTail(cells, cdr, i)  (GetBit(cdr, i) ? ObjVal((i) + 1) : (cells)[(i) + 1])
+
+static void ClearBits(u32 *map, u32 start, u32 end)
+{
+  for (; start < end && (start & 31); start++) ClearBit(map, start);
+  for (; start + 32 <= end; start += 32) map[start >> 5] = 0;
+  for (; start < end; start++) ClearBit(map, start);
+}
+
+static u32 CountBits(u32 *map, u32 start, u32 end)
+{
+  u32 count = 0;
+  for (; start < end && (start & 31); start++) count += GetBit(map, start) != 0;
+  for (; start + 32 <= end; start += 32) count += PopCount(map[start >> 5]);
+  for (; start < end; start++) count += GetBit(map, start) != 0;
+  return count;
+}
+
+/* Resizes a bitmap from old_size cells to size cells; the bits of new cells are clear */
+static u32 *SizeBitmap(u32 *map, u32 old_size, u32 size)
+{
+  u32 *bits = realloc(map, BitmapWords(size)*sizeof(u32));
+  if (bits && size > old_size) ClearBits(bits, old_size, size);
+  return bits;
+}
+
 void InitMem(u32 size)
 {
   size = Max(size, MIN_CAPACITY);
-  mem.data = malloc(size*sizeof(u32));
+  mem.data = malloc(size*sizeof(val));
+  mem.cdr = calloc(BitmapWords(size), sizeof(u32));
+  mem.moved = calloc(BitmapWords(size), sizeof(u32));
+  if (!mem.data || !mem.cdr || !mem.moved) OutOfMemory();
   mem.capacity = size;
+  mem.size = size;
   mem.free = 2;
   mem.stack = 0;
   mem.data[0] = 0;
   mem.data[1] = 0;
   mem.roots = 0;
   mem.num_roots = 0;
+  mem.incremental = false;
+  mem.base = 2;
+  mem.from_start = 0;
+  mem.from_end = 0;
+  mem.scan = 0;
+  mem.uncopied = 0;
+  mem.pause = 0;
+  mem.quantum = MIN_QUANTUM;
+  mem.debt = 0;
+  mem.live = 0;
+  mem.profile = false;
+  mem.limit = 0;
+  mem.exhausted = false;
 }
 
 void DestroyMem(void)
 {
   if (mem.data) free(mem.data);
+  if (mem.cdr) free(mem.cdr);
+  if (mem.moved) free(mem.moved);
   mem.capacity = 0;
+  mem.size = 0;
   mem.data = 0;
+  mem.cdr = 0;
+  mem.moved = 0;
   mem.free = 0;
   mem.stack = 0;
+  mem.from_start = 0;
+  mem.from_end = 0;
+  mem.uncopied = 0;
+}
+
+/* Resizes the block of cells and its bitmaps; returns false if the memory can't be allocated */
+static bool SizeBlock(u32 size)
+{
+  val *data;
+  u32 *cdr, *moved;
+
+  /* bitmaps grow first and shrink last, so they always cover the block */
+  if (size > mem.size) {
+    cdr = SizeBitmap(mem.cdr, mem.size, size);
+    if (!cdr) return false;
+    mem.cdr = cdr;
+    moved = SizeBitmap(mem.moved, mem.size, size);
+    if (!moved) return false;
+    mem.moved = moved;
+  }
+
+  data = realloc(mem.data, sizeof(val)*size);
+  if (!data) return false;
+  mem.data = data;
+
+  if (size < mem.size) {
+    cdr = SizeBitmap(mem.cdr, mem.size, size);
+    if (cdr) mem.cdr = cdr;
+    moved = SizeBitmap(mem.moved, mem.size, size);
+    if (moved) mem.moved = moved;
+  }
+  mem.size = size;
+  return true;
 }
 
-static void SizeMem(u32 size)
+/* Resizes the heap, up to the memory limit; returns false if the memory can't be allocated */
+static bool SizeMem(u32 size)
 {
-  mem.data = realloc(mem.data, sizeof(u32)*size);
+  if (mem.limit) size = Min(size, Max(mem.limit, mem.free));
+  if (!SizeBlock(size)) return false;
   mem.capacity = size;
+  return true;
 }
 
 static u32 MemCapacity(void)
@@ -48,124 +155,249 @@ static u32 MemFree(void)
   return mem.capacity - mem.free;
 }
 
+/* During an incremental collection, enough space is held back to copy the rest of from-space.
+ * The out-of-memory reserve is held back until the heap is exhausted. */
+static bool MemHasRoom(u32 count)
+{
+  return MemFree() >= count + mem.uncopied + (mem.exhausted ? 0 : OOM_RESERVE);
+}
+
+/* Whether the heap is so full, even grown to the memory limit, that collections would run back to
+ * back */
+static bool LowOnMemory(void)
+{
+  u32 ceiling = Max(MemCapacity(), mem.limit);
+  return ceiling - mem.free < OOM_RESERVE + ceiling/MIN_RECLAIM;
+}
+
+static void StartCollection(u32 count);
+static void ScanCells(u32 budget);
+static void ReserveIncremental(u32 count);
+static void PayGCDebt(u32 count);
+static void CompactGarbage(void);
+
+/* Collects garbage and/or grows the heap until there's room for count cells */
+static void MemReserve(u32 count)
+{
+  if (mem.incremental) {
+    ReserveIncremental(count);
+  } else {
+    CollectGarbage();
+    if (!MemHasRoom(count)) {
+      u32 needed = mem.free + count + OOM_RESERVE;
+      if (!SizeMem(Max(2*MemCapacity(), needed))) SizeMem(needed);
+    }
+  }
+
+  if (!MemHasRoom(count)) {
+    mem.exhausted = true;
+    if (!MemHasRoom(count)) OutOfMemory();
+  }
+}
+
 static u32 MemAlloc(u32 count)
 {
   u32 index;
   if (!mem.data) InitMem(MIN_CAPACITY);
   count = Max(2, count);
 
-  if (MemFree() < count) CollectGarbage();
-  if (MemFree() < count) {
-    u32 needed = MemCapacity() + count - MemFree();
-    SizeMem(Max(2*MemCapacity(), needed));
-  }
+  if (!MemHasRoom(count)) MemReserve(count);
+  if (IsCollecting()) PayGCDebt(count);
   assert(MemFree() >= count);
 
   index = mem.free;
   mem.free += count;
+  if (mem.profile) ProfileAlloc(index, count);
   return index;
 }
 
-static u32 MemGet(u32 index)
+static val MemGet(u32 index)
 {
   assert(index < mem.free);
   return mem.data[index];
 }
 
-static void MemSet(u32 index, u32 value)
+static void MemSet(u32 index, val value)
 {
   assert(index < mem.free);
   mem.data[index] = value;
 }
 
-void SetMemRoots(u32 *roots, u32 num_roots)
+void ReserveMem(u32 count)
+{
+  if (!mem.data) InitMem(MIN_CAPACITY);
+  if (!MemHasRoom(count)) MemReserve(count);
+}
+
+void SetMemRoots(val *roots, u32 num_roots)
 {
   mem.roots = roots;
   mem.num_roots = num_roots;
 }
 
-static u32 CopyObj(u32 value, u32 *oldmem, u32 *newmem, u32 *free)
+/*
+ * Lists are cdr-coded: when a list is copied, its spine is laid out in consecutive cells, one per
+ * item. A cell whose pair's tail is the next cell has its bit set in the `cdr` bitmap, and the last
+ * pair of such a run is an ordinary two-cell pair. Only Tail needs to know about this. The bits of
+ * cells that aren't in a run are always clear.
+ *
+ * A copied object has its bit set in the `moved` bitmap, and its first cell holds its new value.
+ *
+ * Copying a run can take more space than it did before: if an item in the middle of a run was
+ * copied first, the item before it becomes a two-cell pair. So a copy can need up to one extra cell
+ * per run cell.
+ *
+ * During an incremental collection, a copy happens in the read barrier, so a run stops after
+ * MAX_RUN pairs. The rest of the spine is copied when the scan reaches the run's last tail.
+ */
+
+static bool IsPairCell(val first)
+{
+  return !IsTupleHdr(first) && !IsBinHdr(first);
+}
+
+static val CopyObj(val value, val *oldmem, u32 *oldcdr, val *newmem, u32 *newcdr, u32 *free)
 {
-  static u32 moved = 0;
   u32 index;
 
-  if (!moved) moved = IntVal(Symbol("*moved*"));
   if (value == 0 || !IsObj(value)) return value;
 
   index = RawVal(value);
 
-  if (oldmem[index] == moved) return oldmem[index+1];
+  if (GetBit(mem.moved, index)) return oldmem[index];
 
   if (IsBinHdr(oldmem[index])) {
     u32 obj_index;
-    u32 len = RawVal(oldmem[index]);
+    u32 len = HdrLength(oldmem[index]);
     obj_index = *free;
-    *free += Max(1, BinSpace(len)) + 1;
-    newmem[obj_index] = BinHeader(len);
+    *free += BinCells(len);
+    Copy(oldmem+index, newmem+obj_index, BinCells(len)*sizeof(val));
     value = ObjVal(obj_index);
-    Copy(oldmem+index+1, newmem+obj_index+1, len);
   } else if (IsTupleHdr(oldmem[index])) {
     u32 obj_index = *free;
     u32 len = Max(1, RawVal(oldmem[index]));
     *free += len + 1;
-    Copy(oldmem+index, newmem+obj_index, (len+1)*sizeof(u32));
+    Copy(oldmem+index, newmem+obj_index, (len+1)*sizeof(val));
     value = ObjVal(obj_index);
   } else {
-    u32 obj_index = *free;
-    *free += 2;
-    newmem[obj_index] = oldmem[index];
-    newmem[obj_index+1] = oldmem[index+1];
-    value = ObjVal(obj_index);
+    /* the spine is followed until it reaches a copied pair or something else */
+    u32 run = 0;
+    value = ObjVal(*free);
+    while (true) {
+      u32 cell = *free;
+      val tail = CdrTail(oldmem, oldcdr, index);
+      newmem[cell] = oldmem[index];
+      SetBit(mem.moved, index);
+      oldmem[index] = ObjVal(cell);
+      run++;
+      if (tail == 0 || !IsObj(tail) ||
+          (IsCollecting() && (!IsFromSpace(tail) || run >= MAX_RUN)) ||
+          GetBit(mem.moved, RawVal(tail)) || !IsPairCell(oldmem[RawVal(tail)])) {
+        newmem[cell+1] = tail;
+        *free += 2;
+        break;
+      }
+      SetBit(newcdr, cell);
+      *free += 1;
+      index = RawVal(tail);
+    }
+    return value;
   }
 
-  oldmem[index] = moved;
-  oldmem[index+1] = value;
+  SetBit(mem.moved, index);
+  oldmem[index] = value;
   return value;
 }
 
-void CollectGarbage(void)
+/* Returns the new index of an object that was copied, or 0 if it wasn't */
+static u32 Forwarded(u32 index)
 {
-  u32 i, scan;
-  u32 *oldmem = mem.data;
-
-  if (!mem.data) {
-    InitMem(MIN_CAPACITY);
-    return;
-  }
+  return GetBit(mem.moved, index) ? RawVal(mem.data[index]) : 0;
+}
 
-  /* fprintf(stderr, "GARBAGE DAY!!!\n"); */
+static void CopyGarbage(val *newmem, u32 *newcdr, u32 size)
+{
+  u32 i, scan;
+  u32 top = 2;
+  u32 *moved;
 
-  mem.data = malloc(mem.capacity*sizeof(u32));
-  mem.data[0] = 0;
-  mem.data[1] = 0;
-  mem.free = 2;
+  newmem[0] = 0;
+  newmem[1] = 0;
 
   for (i = 0; i < mem.num_roots; i++) {
-    mem.roots[i] = CopyObj(mem.roots[i], oldmem, mem.data, &mem.free);
+    mem.roots[i] = CopyObj(mem.roots[i], mem.data, mem.cdr, newmem, newcdr, &top);
   }
 
   for (i = 0; i < VecCount(mem.stack); i++) {
-    mem.stack[i] = CopyObj(mem.stack[i], oldmem, mem.data, &mem.free);
+    mem.stack[i] = CopyObj(mem.stack[i], mem.data, mem.cdr, newmem, newcdr, &top);
   }
 
   scan = 2;
-  while (scan < mem.free) {
-    u32 next = mem.data[scan];
-    if (IsBinHdr(next)) {
-      scan += Max(2, BinSpace(RawVal(next)) + 1);
+  while (scan < top) {
+    val next = newmem[scan];
+    if (GetBit(newcdr, scan)) {
+      newmem[scan] = CopyObj(next, mem.data, mem.cdr, newmem, newcdr, &top);
+      scan++;
+    } else if (IsBinHdr(next)) {
+      scan += BinCells(HdrLength(next));
     } else if (IsTupleHdr(next)) {
       for (i = 0; i < RawVal(next); i++) {
-        mem.data[scan+i+1] = CopyObj(mem.data[scan+i+1], oldmem, mem.data, &mem.free);
+        newmem[scan+i+1] = CopyObj(newmem[scan+i+1], mem.data, mem.cdr, newmem, newcdr, &top);
       }
       scan += Max(2, RawVal(next) + 1);
     } else {
-      mem.data[scan] = CopyObj(mem.data[scan], oldmem, mem.data, &mem.free);
-      mem.data[scan+1] = CopyObj(mem.data[scan+1], oldmem, mem.data, &mem.free);
+      newmem[scan] = CopyObj(newmem[scan], mem.data, mem.cdr, newmem, newcdr, &top);
+      newmem[scan+1] = CopyObj(newmem[scan+1], mem.data, mem.cdr, newmem, newcdr, &top);
       scan += 2;
     }
   }
 
-  free(oldmem);
+  if (mem.profile) ProfileCollection(2, mem.free, Forwarded);
+
+  ClearBits(mem.moved, 2, mem.free);
+  moved = SizeBitmap(mem.moved, mem.size, size);
+  if (!moved) OutOfMemory();
+  free(mem.data);
+  free(mem.cdr);
+  mem.data = newmem;
+  mem.cdr = newcdr;
+  mem.moved = moved;
+  mem.free = top;
+  mem.capacity = size;
+  mem.size = size;
+}
+
+void CollectGarbage(void)
+{
+  val *newmem = 0;
+  u32 *newcdr = 0;
+  u32 size;
+
+  if (!mem.data) {
+    InitMem(MIN_CAPACITY);
+    return;
+  }
+
+  if (mem.incremental) {
+    if (!IsCollecting()) StartCollection(0);
+    if (IsCollecting()) ScanCells(MaxUInt);
+    return;
+  }
+
+  /* fprintf(stderr, "GARBAGE DAY!!!\n"); */
+
+  size = Max(mem.capacity, mem.free + CountBits(mem.cdr, 2, mem.free));
+  if (!mem.limit || size <= mem.limit/COMPACT_LIMIT) {
+    newmem = malloc(size*sizeof(val));
+    newcdr = calloc(BitmapWords(size), sizeof(u32));
+  }
+  if (newmem && newcdr) {
+    CopyGarbage(newmem, newcdr, size);
+  } else {
+    if (newmem) free(newmem);
+    if (newcdr) free(newcdr);
+    CompactGarbage();
+  }
 
   if (MemFree() < MemCapacity()/4) {
     SizeMem(2*MemCapacity());
@@ -173,21 +405,383 @@ void CollectGarbage(void)
       MemFree() > MemCapacity()/4 + MemCapacity()/2) {
     SizeMem(MemCapacity()/2);
   }
+  mem.exhausted = LowOnMemory();
+}
+
+/*
+ * When there isn't memory for a second space, garbage is collected in place by a sliding
+ * mark-compact collector. Marking sets a bit for every cell of each live object, so a live cell's
+ * new index is the count of live cells below it: a running count per 32-cell block, plus the marked
+ * bits below it in its block. Once every reference has been updated, live objects slide down in
+ * order.
+ *
+ * Compaction starts from the current space, and needs no collection to be in progress.
+ */
+
+static struct {
+  u32 *marks;
+  u32 *counts;
+} compact = {0, 0};
+
+static u32 ObjCells(u32 index)
+{
+  val first = mem.data[index];
+  if (GetBit(mem.cdr, index)) return 1;
+  if (IsBinHdr(first)) return BinCells(HdrLength(first));
+  if (IsTupleHdr(first)) return Max(2, RawVal(first) + 1);
+  return 2;
+}
+
+static void MarkObj(val value, u32 **stack)
+{
+  u32 index, end;
+  if (value == 0 || !IsObj(value)) return;
+  index = RawVal(value);
+  if (GetBit(compact.marks, index)) return;
+  end = index + ObjCells(index);
+  for (; index < end; index++) SetBit(compact.marks, index);
+  VecPush(*stack, RawVal(value));
+}
+
+static void MarkLive(void)
+{
+  u32 i, *stack = 0;
+
+  for (i = 0; i < mem.num_roots; i++) MarkObj(mem.roots[i], &stack);
+  for (i = 0; i < VecCount(mem.stack); i++) MarkObj(mem.stack[i], &stack);
+
+  /* a list's tail is marked last, so the stack stays shallow */
+  while (VecCount(stack) > 0) {
+    u32 index = VecPop(stack);
+    val next = mem.data[index];
+    if (GetBit(mem.cdr, index) || IsPairCell(next)) {
+      MarkObj(next, &stack);
+      MarkObj(CdrTail(mem.data, mem.cdr, index), &stack);
+    } else if (IsTupleHdr(next)) {
+      for (i = 0; i < RawVal(next); i++) MarkObj(mem.data[index+i+1], &stack);
+    }
+  }
+  FreeVec(stack);
+}
+
+/* Returns the new index of a live object, or 0 if it's garbage */
+static u32 Relocate(u32 index)
+{
+  u32 block = index >> 5;
+  u32 below = compact.marks[block] & (((u32)1 << (index & 31)) - 1);
+  if (!GetBit(compact.marks, index)) return 0;
+  return 2 + compact.counts[block] + PopCount(below);
+}
+
+static val RelocateVal(val value)
+{
+  if (value == 0 || !IsObj(value)) return value;
+  return ObjVal(Relocate(RawVal(value)));
+}
+
+/* Since the items of a cdr-coded run are each other's tails, a run's live items are the ones after
+ * its last dead item, and they stay adjacent. */
+static void CompactGarbage(void)
+{
+  u32 i, index, live = 0;
+  u32 blocks = BitmapWords(mem.free);
+
+  compact.marks = calloc(blocks, sizeof(u32));
+  compact.counts = malloc(blocks*sizeof(u32));
+  if (!compact.marks || !compact.counts) OutOfMemory();
+
+  MarkLive();
+  for (i = 0; i < blocks; i++) {
+    compact.counts[i] = live;
+    live += PopCount(compact.marks[i]);
+  }
+  if (mem.profile) ProfileCollection(mem.base, mem.free, Relocate);
+
+  for (i = 0; i < mem.num_roots; i++) mem.roots[i] = RelocateVal(mem.roots[i]);
+  for (i = 0; i < VecCount(mem.stack); i++) mem.stack[i] = RelocateVal(mem.stack[i]);
+
+  index = mem.base;
+  while (index < mem.free) {
+    val next = mem.data[index];
+    u32 cells = ObjCells(index);
+    if (!GetBit(compact.marks, index)) {
+      /* skip it */
+    } else if (cells == 1) {
+      mem.data[index] = RelocateVal(next);
+    } else if (IsTupleHdr(next)) {
+      for (i = 0; i < RawVal(next); i++) {
+        mem.data[index+i+1] = RelocateVal(mem.data[index+i+1]);
+      }
+    } else if (!IsBinHdr(next)) {
+      mem.data[index] = RelocateVal(mem.data[index]);
+      mem.data[index+1] = RelocateVal(mem.data[index+1]);
+    }
+    index += cells;
+  }
+
+  /* objects only move down, so one in front of the cursor is never overwritten */
+  index = mem.base;
+  while (index < mem.free) {
+    u32 cells = ObjCells(index);
+    bool cdr = GetBit(mem.cdr, index) != 0;
+    ClearBit(mem.cdr, index);
+    if (GetBit(compact.marks, index)) {
+      u32 dest = Relocate(index);
+      Copy(mem.data + index, mem.data + dest, cells*sizeof(val));
+      if (cdr) SetBit(mem.cdr, dest);
+    }
+    index += cells;
+  }
+
+  free(compact.marks);
+  free(compact.counts);
+  compact.marks = 0;
+  compact.counts = 0;
+
+  mem.base = 2;
+  mem.free = 2 + live;
+  mem.live = live;
+  mem.capacity = mem.size;
+}
+
+/*
+ * Incremental collection is a Baker-style copying collector. Both semispaces live in the same
+ * block at disjoint index ranges, so a value can be checked against from-space with one
+ * comparison.
+ *
+ * A collection starts with a flip: a new to-space is placed in the block, and the roots and stack
+ * are copied into it. After that, each allocation scans a few to-space cells, copying the objects
+ * they refer to. Head, Tail, and TupleGet act as a read barrier: a from-space value read from the
+ * heap is copied first, so the program only ever sees to-space values. Once the scan catches up to
+ * the end of to-space, the collection is done and from-space is dead.
+ *
+ * Scanning is batched into steps of `quantum` cells, which is adjusted so that a step takes about
+ * as long as the pause target.
+ */
+
+static val Forward(val value)
+{
+  u32 start = mem.free;
+  value = CopyObj(value, mem.data, mem.cdr, mem.data, mem.cdr, &mem.free);
+  mem.uncopied -= mem.free - start;
+  return value;
+}
+
+static val ReadCell(val *cell)
+{
+  if (IsFromSpace(*cell)) *cell = Forward(*cell);
+  return *cell;
+}
+
+/* Returns false if the block would be over the memory limit, or can't be allocated */
+static bool ResizeBlock(u32 size)
+{
+  if (mem.limit && size > mem.limit) return false;
+  return SizeBlock(size);
+}
+
+static void EndCollection(void)
+{
+  if (mem.profile) ProfileCollection(mem.from_start, mem.from_end, Forwarded);
+  ClearBits(mem.cdr, mem.from_start, mem.from_end);
+  ClearBits(mem.moved, mem.from_start, mem.from_end);
+  mem.live = mem.free - mem.base;
+  mem.from_start = 0;
+  mem.from_end = 0;
+  mem.uncopied = 0;
+  mem.debt = 0;
+  /* release the block above to-space if from-space was there */
+  if (mem.size > mem.capacity && mem.base == 2) ResizeBlock(mem.capacity);
+  if (mem.exhausted) mem.exhausted = LowOnMemory();
+}
+
+static void ScanCells(u32 budget)
+{
+  while (mem.scan < mem.free && budget > 0) {
+    val next = mem.data[mem.scan];
+    u32 i, cells;
+    if (GetBit(mem.cdr, mem.scan)) {
+      ReadCell(mem.data + mem.scan);
+      cells = 1;
+    } else if (IsBinHdr(next)) {
+      cells = BinCells(HdrLength(next));
+    } else if (IsTupleHdr(next)) {
+      for (i = 0; i < RawVal(next); i++) ReadCell(mem.data + mem.scan + i + 1);
+      cells = Max(2, RawVal(next) + 1);
+    } else {
+      ReadCell(mem.data + mem.scan);
+      ReadCell(mem.data + mem.scan + 1);
+      cells = 2;
+    }
+    mem.scan += cells;
+    budget -= Min(budget, cells);
+  }
+  if (mem.scan >= mem.free) EndCollection();
+}
+
+/* Compacts in place, then grows the block, up to the memory limit, if it's still mostly full */
+static void CompactSpace(u32 count)
+{
+  u32 needed;
+  CompactGarbage();
+  needed = mem.free + count + OOM_RESERVE;
+  if (MemFree() < MemCapacity()/4 || MemFree() < count + OOM_RESERVE) {
+    u32 size = Max(2*mem.free, needed);
+    if (mem.limit) size = Max(Min(size, mem.limit), needed);
+    if (ResizeBlock(size) || ResizeBlock(needed)) mem.capacity = mem.size;
+  }
+  mem.exhausted = LowOnMemory();
+}
+
+static void StartCollection(u32 count)
+{
+  u32 i;
+  u32 cdrs = CountBits(mem.cdr, mem.base, mem.free);
+  u32 used = mem.free - mem.base;
+  u32 size = Max(MIN_CAPACITY, Max(used + cdrs, 2*mem.live) + count + OOM_RESERVE);
+  u32 start;
+
+  /* to-space fits all of from-space, plus room to grow if the last collection found a lot of live
+   * data. It goes below from-space if it fits, otherwise above it, or the heap is compacted
+   * instead if the block can't grow. */
+  if (2 + size <= mem.base) {
+    start = 2;
+  } else {
+    start = mem.free;
+    if (start + size > mem.size && !ResizeBlock(start + size)) {
+      CompactSpace(count);
+      return;
+    }
+  }
+
+  mem.from_start = mem.base;
+  mem.from_end = mem.free;
+  mem.uncopied = used + cdrs;
+  mem.base = start;
+  mem.free = start;
+  mem.scan = start;
+  mem.capacity = start + size;
+  mem.debt = 0;
+
+  for (i = 0; i < mem.num_roots; i++) ReadCell(mem.roots + i);
+  for (i = 0; i < VecCount(mem.stack); i++) ReadCell(mem.stack + i);
+  if (mem.scan >= mem.free) EndCollection();
+}
+
+static void GCWork(u32 budget)
+{
+  u64 start = Microtime();
+  u64 elapsed;
+  ScanCells(budget);
+  elapsed = Microtime() - start;
+  if (budget == mem.quantum && mem.pause > 0) {
+    u64 quantum = (u64)mem.quantum * mem.pause / Max(1, elapsed);
+    mem.quantum = Max(MIN_QUANTUM, Min(MAX_QUANTUM, quantum));
+  }
+}
+
+static void PayGCDebt(u32 count)
+{
+  mem.debt += count*GC_WORK_RATIO;
+  if (mem.debt < mem.quantum) return;
+  mem.debt -= mem.quantum;
+  GCWork(mem.quantum);
 }
 
-u32 StackPush(u32 value)
+static void ReserveIncremental(u32 count)
+{
+  if (IsCollecting()) {
+    /* the collection fell behind; finish it, then grow to-space in place if needed */
+    ScanCells(MaxUInt);
+    if (MemHasRoom(count)) return;
+    if (ResizeBlock(Max(mem.base + 2*(MemCapacity() - mem.base), mem.free + count + OOM_RESERVE))) {
+      mem.capacity = mem.size;
+    } else {
+      CompactSpace(count);
+    }
+    return;
+  }
+  StartCollection(count);
+}
+
+void SetMemProfile(bool profile)
+{
+  mem.profile = profile;
+}
+
+void SetGCPause(u32 pause)
+{
+  if (!mem.data) InitMem(MIN_CAPACITY);
+  mem.incremental = pause > 0;
+  mem.pause = pause;
+  mem.base = 2;
+}
+
+void SetMemLimit(u32 megabytes)
+{
+  u64 cells = (u64)megabytes * 1024 * 1024 / sizeof(val);
+  mem.limit = (u32)Min(cells, MaxUInt);
+  if (mem.limit && mem.capacity > mem.limit && !mem.incremental) SizeMem(mem.limit);
+}
+
+bool MemExhausted(void)
+{
+  return mem.exhausted;
+}
+
+bool GCStep(u32 budget)
+{
+  u64 deadline;
+  if (!mem.incremental || !mem.data) return false;
+  if (!IsCollecting()) {
+    /* don't start early unless half of the space is used */
+    if (mem.free - mem.base < (MemCapacity() - mem.base)/2) return false;
+    StartCollection(0);
+  }
+  deadline = Microtime() + budget;
+  while (IsCollecting() && Microtime() < deadline) ScanCells(mem.quantum);
+  mem.debt = 0;
+  return IsCollecting();
+}
+
+/* Snapshots are taken without incremental collection, so the collected heap starts at cell 2. */
+val *HeapImage(u32 *count, u32 **cdr)
+{
+  assert(!mem.incremental);
+  CollectGarbage();
+  *count = mem.free;
+  *cdr = mem.cdr;
+  return mem.data;
+}
+
+void LoadHeapImage(val *cells, u32 count, u32 *cdr, val *stack, u32 stack_count)
+{
+  FreeVec(mem.stack);
+  DestroyMem();
+  InitMem(2*count);
+  Copy(cells, mem.data, count*sizeof(val));
+  Copy(cdr, mem.cdr, BitmapWords(count)*sizeof(u32));
+  ClearBits(mem.cdr, count, 32*BitmapWords(count));
+  mem.free = count;
+  if (stack_count > 0) {
+    GrowVec(mem.stack, stack_count);
+    Copy(stack, mem.stack, stack_count*sizeof(val));
+  }
+}
+
+val StackPush(val value)
 {
   VecPush(mem.stack, value);
   return value;
 }
 
-u32 StackPop(void)
+val StackPop(void)
 {
   assert(StackSize() > 0);
   return VecPop(mem.stack);
 }
 
-u32 StackPeek(u32 index)
+val StackPeek(u32 index)
 {
   assert(StackSize() > index);
   return mem.stack[VecCount(mem.stack) - 1 - index];
@@ -198,13 +792,13 @@ u32 StackSize(void)
   return VecCount(mem.stack);
 }
 
-u32 Pair(u32 head, u32 tail)
+val Pair(val head, val tail)
 {
   i32 index;
-  if (MemFree() < 2) {
+  if (!MemHasRoom(2)) {
     StackPush(head);
     StackPush(tail);
-    CollectGarbage();
+    MemReserve(2);
     tail = StackPop();
     head = StackPop();
   }
@@ -214,22 +808,25 @@ u32 Pair(u32 head, u32 tail)
   return ObjVal(index);
 }
 
-u32 Head(u32 pair)
+val Head(val pair)
 {
-  return MemGet(RawVal(pair));
+  assert(RawVal(pair) < mem.free);
+  return ReadCell(mem.data + RawVal(pair));
 }
 
-u32 Tail(u32 pair)
+val Tail(val pair)
 {
-  return MemGet(RawVal(pair)+1);
+  assert(RawVal(pair)+1 < mem.free);
+  if (GetBit(mem.cdr, RawVal(pair))) return ObjVal(RawVal(pair) + 1);
+  return ReadCell(mem.data + RawVal(pair) + 1);
 }
 
-u32 ObjLength(u32 obj)
+u32 ObjLength(val obj)
 {
-  return RawVal(mem.data[RawVal(obj)]);
+  return HdrLength(mem.data[RawVal(obj)]);
 }
 
-u32 Tuple(u32 length)
+val Tuple(u32 length)
 {
   u32 i;
   u32 index = MemAlloc(length+1);
@@ -238,22 +835,22 @@ u32 Tuple(u32 length)
   return ObjVal(index);
 }
 
-u32 TupleGet(u32 tuple, u32 index)
+val TupleGet(val tuple, u32 index)
 {
   if (index < 0 || index >= ObjLength(tuple)) return 0;
-  return MemGet(RawVal(tuple)+index+1);
+  return ReadCell(mem.data + RawVal(tuple) + index + 1);
 }
 
-void TupleSet(u32 tuple, u32 index, u32 value)
+void TupleSet(val tuple, u32 index, val value)
 {
   if (index < 0 || index >= ObjLength(tuple)) return;
   MemSet(RawVal(tuple)+index+1, value);
 }
 
-u32 TupleJoin(u32 left, u32 right)
+val TupleJoin(val left, val right)
 {
   u32 i;
-  u32 tuple;
+  val tuple;
   StackPush(left);
   StackPush(right);
   tuple = Tuple(ObjLength(left) + ObjLength(right));
@@ -269,11 +866,11 @@ u32 TupleJoin(u32 left, u32 right)
   return tuple;
 }
 
-u32 TupleSlice(u32 tuple, u32 start, u32 end)
+val TupleSlice(val tuple, u32 start, u32 end)
 {
   u32 i;
   u32 len = (end > start) ? end - start : 0;
-  u32 slice;
+  val slice;
 
   StackPush(tuple);
   slice = Tuple(Min(len, ObjLength(tuple)));
@@ -285,46 +882,47 @@ u32 TupleSlice(u32 tuple, u32 start, u32 end)
   return slice;
 }
 
-u32 NewBinary(u32 length)
+val NewBinary(u32 length)
 {
-  u32 index = MemAlloc(BinSpace(length) + 1);
+  u32 index = MemAlloc(BinCells(length));
   MemSet(index, BinHeader(length));
   return ObjVal(index);
 }
 
-u32 Binary(char *str)
+val Binary(char *str)
 {
   return BinaryFrom(str, StrLen(str));
 }
 
-u32 BinaryFrom(char *str, u32 length)
+val BinaryFrom(char *str, u32 length)
 {
-  u32 bin = NewBinary(length);
+  val bin = NewBinary(length);
   char *binData = BinaryData(bin);
   Copy(str, binData, length);
   return bin;
 }
 
-char *BinaryData(u32 bin)
+char *BinaryData(val bin)
 {
   return (char*)(mem.data + RawVal(bin) + 1);
 }
 
-u32 BinaryGet(u32 bin, u32 index)
+u32 BinaryGet(val bin, u32 index)
 {
   if (index < 0 || index >= ObjLength(bin)) return 0;
   return BinaryData(bin)[index];
 }
 
-void BinarySet(u32 bin, u32 index, u32 value)
+void BinarySet(val bin, u32 index, u32 value)
 {
   if (index < 0 || index >= ObjLength(bin)) return;
   BinaryData(bin)[index] = value;
+  mem.data[RawVal(bin)] = BinHeader(ObjLength(bin));
 }
 
-u32 BinaryJoin(u32 left, u32 right)
+val BinaryJoin(val left, val right)
 {
-  u32 bin;
+  val bin;
   StackPush(left);
   StackPush(right);
   bin = NewBinary(ObjLength(left) + ObjLength(right));
@@ -336,10 +934,10 @@ u32 BinaryJoin(u32 left, u32 right)
   return bin;
 }
 
-u32 BinarySlice(u32 bin, u32 start, u32 end)
+val BinarySlice(val bin, u32 start, u32 end)
 {
   u32 len = (end > start) ? end - start : 0;
-  u32 slice;
+  val slice;
   StackPush(bin);
   slice = NewBinary(Min(len, ObjLength(bin)));
   bin = StackPop();
@@ -348,7 +946,27 @@ u32 BinarySlice(u32 bin, u32 start, u32 end)
   return slice;
 }
 
-bool BinIsPrintable(u32 bin)
+/* The cells a binary frees become a filler object, so the heap can still be walked. A single cell
+ * is too small for one, so then the binary is copied instead. */
+val BinaryTruncate(val bin, u32 length)
+{
+  u32 index = RawVal(bin);
+  u32 filler = index + BinCells(length);
+  u32 spare = BinCells(ObjLength(bin)) - BinCells(length);
+
+  if (length >= ObjLength(bin)) return bin;
+  if (spare == 1) return BinarySlice(bin, 0, length);
+  mem.data[index] = BinHeader(length);
+  if (spare == 2) {
+    mem.data[filler] = TupleHeader(1);
+    mem.data[filler + 1] = 0;
+  } else if (spare > 2) {
+    mem.data[filler] = BinHeader((spare - 2)*sizeof(val));
+  }
+  return bin;
+}
+
+bool BinIsPrintable(val bin)
 {
   u32 i;
   for (i = 0; i < ObjLength(bin); i++) {
@@ -357,7 +975,7 @@ bool BinIsPrintable(u32 bin)
   return true;
 }
 
-char *BinToStr(u32 bin)
+char *BinToStr(val bin)
 {
   char *str = malloc(ObjLength(bin) + 1);
   Copy(BinaryData(bin), str, ObjLength(bin));
@@ -366,26 +984,33 @@ char *BinToStr(u32 bin)
 }
 
 
-static u32 FormatSize(u32 value)
+#define IsIOByte(v)   (IsInt(v) && RawInt(v) >= 0 && RawInt(v) < 256)
+
+u32 IOListSize(val value)
 {
-  if (IsInt(value) && RawInt(value) >= 0 && RawInt(value) < 256) return 1;
-  if (IsBinary(value)) return ObjLength(value);
+  u32 len = 0;
+  while (value && IsPair(value)) {
+    len += IOListSize(Head(value));
+    value = Tail(value);
+  }
+  if (IsIOByte(value)) return len + 1;
+  if (IsBinary(value)) return len + ObjLength(value);
   if (IsTuple(value)) {
-    u32 i, len = 0;
+    u32 i;
     for (i = 0; i < ObjLength(value); i++) {
-      len += FormatSize(TupleGet(value, i));
+      len += IOListSize(TupleGet(value, i));
     }
-    return len;
-  }
-  if (value && IsPair(value)) {
-    return FormatSize(Head(value)) + FormatSize(Tail(value));
   }
-  return 0;
+  return len;
 }
 
-static u8 *FormatValInto(u32 value, u8 *buf)
+static u8 *FormatValInto(val value, u8 *buf)
 {
-  if (IsInt(value) && RawInt(value) >= 0 && RawInt(value) < 256) {
+  while (value && IsPair(value)) {
+    buf = FormatValInto(Head(value), buf);
+    value = Tail(value);
+  }
+  if (IsIOByte(value)) {
     *buf = (u8)RawInt(value);
     return buf + 1;
   }
@@ -398,21 +1023,21 @@ static u8 *FormatValInto(u32 value, u8 *buf)
     for (i = 0; i < ObjLength(value); i++) {
       buf = FormatValInto(TupleGet(value, i), buf);
     }
-    return buf;
-  }
-  if (value && IsPair(value)) {
-    buf = FormatValInto(Head(value), buf);
-    buf = FormatValInto(Tail(value), buf);
-    return buf;
   }
   return buf;
 }
 
-u32 FormatVal(u32 value)
+void FormatValTo(val value, char *buf)
 {
-  u32 size, bin;
+  FormatValInto(value, (u8*)buf);
+}
+
+val FormatVal(val value)
+{
+  u32 size;
+  val bin;
   if (IsBinary(value)) return value;
-  size = FormatSize(value);
+  size = IOListSize(value);
   StackPush(value);
   bin = NewBinary(size);
   value = StackPop();
@@ -420,70 +1045,236 @@ u32 FormatVal(u32 value)
   return bin;
 }
 
-bool ValEq(u32 a, u32 b)
+static val *BinHashCell(val bin)
 {
-  if (a == b) {
-    return true;
-  } else if (IsPair(a) && IsPair(b)) {
-    return ValEq(Head(a), Head(b)) && ValEq(Tail(a), Tail(b));
-  } else if (IsTuple(a) && IsTuple(b)) {
-    u32 i;
-    if (ObjLength(a) != ObjLength(b)) return false;
-    for (i = 0; i < ObjLength(a); i++) {
-      if (!ValEq(TupleGet(a, i), TupleGet(b, i))) return false;
+  return mem.data + RawVal(bin) + BinCells(ObjLength(bin)) - 1;
+}
+
+static bool BinIsHashed(val bin)
+{
+  return (RawVal(mem.data[RawVal(bin)]) & binHashed) != 0;
+}
+
+enum {orderNil, orderInt, orderSymbol, orderBinary, orderTuple, orderPair};
+
+/* nil comes first, then integers, symbols, binaries, tuples and pairs */
+static u32 OrderKind(val value)
+{
+  if (!value) return orderNil;
+  if (IsInt(value)) return IsSymbol(value) ? orderSymbol : orderInt;
+  if (IsBinary(value)) return orderBinary;
+  if (IsTuple(value)) return orderTuple;
+  return orderPair;
+}
+
+/* memcmp compares a word (or vector) at a time, so binaries aren't compared byte by byte */
+static i32 CompareBinaries(val a, val b)
+{
+  u32 alen = ObjLength(a), blen = ObjLength(b);
+  i32 cmp = memcmp(BinaryData(a), BinaryData(b), Min(alen, blen));
+  if (cmp != 0) return cmp < 0 ? -1 : 1;
+  return alen < blen ? -1 : alen > blen;
+}
+
+/*
+ * Compares two unequal values without descending into them. Equal tuples and pairs so far have
+ * their items pushed onto `pending`, last first, to be compared in order. When only testing for
+ * equality, any nonzero result means unequal, which skips the work of ordering.
+ */
+static i32 CompareNode(val a, val b, bool equality, val **pending)
+{
+  u32 kind = OrderKind(a), i;
+  if (kind != OrderKind(b)) return kind < OrderKind(b) ? -1 : 1;
+
+  switch (kind) {
+  case orderInt:
+    return RawInt(a) < RawInt(b) ? -1 : 1;
+  case orderSymbol:
+    if (equality) return 1;
+    return strcmp(SymbolName(RawVal(a)), SymbolName(RawVal(b)));
+  case orderBinary:
+    if (equality) {
+      if (ObjLength(a) != ObjLength(b)) return 1;
+      if (BinIsHashed(a) && BinIsHashed(b) && *BinHashCell(a) != *BinHashCell(b)) return 1;
     }
-    return true;
-  } else if (IsBinary(a) && IsBinary(b)) {
-    char *adata = BinaryData(a);
-    char *bdata = BinaryData(b);
-    u32 i;
-    if (ObjLength(a) != ObjLength(b)) return false;
-    for (i = 0; i < ObjLength(a); i++) {
-      if (adata[i] != bdata[i]) return false;
+    return CompareBinaries(a, b);
+  case orderTuple:
+    if (ObjLength(a) != ObjLength(b)) return ObjLength(a) < ObjLength(b) ? -1 : 1;
+    for (i = ObjLength(a); i > 0; i--) {
+      VecPush(*pending, TupleGet(a, i - 1));
+      VecPush(*pending, TupleGet(b, i - 1));
     }
-    return true;
-  } else {
-    return false;
+    return 0;
+  default:
+    VecPush(*pending, Tail(a));
+    VecPush(*pending, Tail(b));
+    VecPush(*pending, Head(a));
+    VecPush(*pending, Head(b));
+    return 0;
   }
 }
 
-static u32 HashValRec(u32 value, HashMap *map)
+/* Walks both values depth-first with an explicit stack, so deep structures can't overflow */
+static i32 CompareDeep(val a, val b, bool equality)
 {
-  u32 hash = EmptyHash;
-  u32 h = Hash(&value, sizeof(value));
-  if (HashMapContains(map, h)) return HashMapGet(map, h);
-
-  HashMapSet(map, h, IntVal(hash));
-
-  if (IsSymbol(value)) {
-    hash = value;
-  } else if (IsInt(value) || value == 0) {
-    hash = IntVal(Hash(&value, sizeof(value)));
-  } else if (IsPair(value)) {
-    hash = IntVal(HashValRec(Head(value), map) ^ HashValRec(Tail(value), map));
-  } else if (IsTuple(value)) {
-    u32 i;
-    for (i = 0; i < ObjLength(value); i++) {
-      hash ^= HashValRec(TupleGet(value, i), map);
+  val *pending = 0;
+  i32 cmp = 0;
+  while (true) {
+    if (a != b) {
+      cmp = CompareNode(a, b, equality, &pending);
+      if (cmp != 0) break;
     }
-    hash = IntVal(hash);
-  } else if (IsBinary(value)) {
-    hash = IntVal(Hash(BinaryData(value), ObjLength(value)));
+    if (VecCount(pending) == 0) break;
+    b = VecPop(pending);
+    a = VecPop(pending);
   }
-  HashMapSet(map, h, hash);
+  FreeVec(pending);
+  return cmp;
+}
+
+bool ValEq(val a, val b)
+{
+  if (a == b) return true;
+  if (!IsObj(a) || !IsObj(b) || !a || !b) return false;
+  return CompareDeep(a, b, true) == 0;
+}
+
+i32 CompareVal(val a, val b)
+{
+  if (a == b) return 0;
+  if (IsInt(a) && IsInt(b) && !IsSymbol(a) && !IsSymbol(b)) return RawInt(a) < RawInt(b) ? -1 : 1;
+  return CompareDeep(a, b, false);
+}
+
+/*
+ * Values are hashed by mixing each node of the structure in a depth-first walk, so the order of
+ * items matters. The walk uses a small fixed stack instead of recursion; structures nested deeper
+ * than the stack contribute only their header. The number of nodes visited is capped, which also
+ * stops cyclic structures (made with opSet). Equal values are visited the same way, so they still
+ * hash the same.
+ */
+
+#define HashSeed        0x9E3779B9
+#define HashPairToken   0x85EBCA6B
+#define HashStackSize   32
+#define HashMaxNodes    65536
+
+typedef struct {
+  val *items;
+  u32 remaining;
+  val pair;     /* a pair's tail is read with Tail, in case it's cdr-coded */
+} HashFrame;
+
+static u32 MixHash(u32 hash, u32 k)
+{
+  k *= 0xCC9E2D51;
+  k = RotL(k, 15);
+  k *= 0x1B873593;
+  hash ^= k;
+  hash = RotL(hash, 13);
+  return hash*5 + 0xE6546B64;
+}
+
+static u32 FinishHash(u32 hash)
+{
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6B;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35;
+  hash ^= hash >> 16;
   return hash;
 }
 
-u32 HashVal(u32 value)
+/* Wide values are mixed in as two words */
+static u32 MixVal(u32 hash, val value)
 {
-  u32 hash;
-  HashMap map = EmptyHashMap;
-  hash = HashValRec(value, &map);
-  DestroyHashMap(&map);
+#ifdef WIDE_VALUES
+  hash = MixHash(hash, (u32)(value >> 32));
+#endif
+  return MixHash(hash, (u32)value);
+}
+
+static u32 HashBinary(val bin)
+{
+  u32 len = ObjLength(bin);
+  u32 *words = (u32*)BinaryData(bin);
+  u8 *tail = (u8*)(words + len/4);
+  u32 i, k = 0;
+  u32 hash = HashSeed ^ len;
+
+  if (BinIsHashed(bin)) return *BinHashCell(bin);
+
+  for (i = 0; i < len/4; i++) hash = MixHash(hash, words[i]);
+  for (i = 0; i < len%4; i++) k |= tail[i] << (8*i);
+  hash = FinishHash(MixHash(hash, k));
+
+  *BinHashCell(bin) = hash;
+  mem.data[RawVal(bin)] = BinHeader(len | binHashed);
   return hash;
 }
 
-char *MemValStr(u32 value)
+val HashVal(val value)
+{
+  HashFrame stack[HashStackSize];
+  u32 depth = 0;
+  u32 budget = HashMaxNodes;
+  u32 hash = HashSeed;
+
+  while (budget--) {
+    if (value == 0 || !IsObj(value)) {
+      hash = MixVal(hash, value);
+    } else if (IsBinary(value)) {
+      hash = MixHash(hash, HashBinary(value));
+    } else if (IsTuple(value)) {
+      val *items = mem.data + RawVal(value);
+      hash = MixVal(hash, *items);
+      if (ObjLength(value) > 0 && depth < HashStackSize) {
+        stack[depth].items = items + 1;
+        stack[depth].remaining = ObjLength(value);
+        stack[depth].pair = 0;
+        depth++;
+      }
+    } else {
+      hash = MixHash(hash, HashPairToken);
+      if (depth < HashStackSize) {
+        stack[depth].items = mem.data + RawVal(value);
+        stack[depth].remaining = 2;
+        stack[depth].pair = value;
+        depth++;
+      }
+    }
+
+    if (depth == 0) break;
+    if (stack[depth-1].pair && stack[depth-1].remaining == 1) {
+      value = Tail(stack[depth-1].pair);
+    } else {
+      value = ReadCell(stack[depth-1].items++);
+    }
+    /* the last item of a frame is visited in its parent's place, so lists don't grow the stack */
+    if (--stack[depth-1].remaining == 0) depth--;
+  }
+
+  return IntVal(FinishHash(hash));
+}
+
+static char *IntStr(ival num)
+{
+  char digits[24];
+  char *str;
+  u32 len = 0, i = 0;
+  val n = num < 0 ? -(val)num : (val)num;
+  do {
+    digits[len++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  str = malloc(len + 2);
+  if (num < 0) str[i++] = '-';
+  while (len > 0) str[i++] = digits[--len];
+  str[i] = 0;
+  return str;
+}
+
+char *MemValStr(val value)
 {
   char *str;
   if (value == 0) {
@@ -495,16 +1286,14 @@ char *MemValStr(u32 value)
     return str;
   }
   if (IsInt(value)) {
-    char *data = SymbolName(RawVal(value));
+    char *data = SymbolValName(value);
     if (data) {
       str = malloc(StrLen(data) + 2);
       str[0] = ':';
       WriteStr(data, StrLen(data), str+1);
       return str;
     } else {
-      str = malloc(NumDigits(value, 10) + 1);
-      WriteNum(RawInt(value), str);
-      return str;
+      return IntStr(RawInt(value));
     }
   }
   if (IsBinary(value) && ObjLength(value) < 8 && BinIsPrintable(value)) {
@@ -550,16 +1339,17 @@ void DumpMem(void)
   fprintf(stderr, "%*d│", numWidth, 0);
   for (i = 0; i < mem.free; i++) {
     if (bin_cells > 0) {
-      fprintf(stderr, "    \"%*.*s\"│", 4, 4, bin_data);
-      bin_data += 4;
+      fprintf(stderr, "%*s\"%*.*s\"│", (int)(8 - sizeof(val)), "", (int)sizeof(val),
+          (int)sizeof(val), bin_data);
+      bin_data += sizeof(val);
       bin_cells--;
     } else {
-      u32 value = mem.data[i];
+      val value = mem.data[i];
       char *str = MemValStr(value);
       fprintf(stderr, "%*s│", colWidth, str);
       free(str);
       if (IsBinHdr(value)) {
-        bin_cells = BinSpace(RawVal(value));
+        bin_cells = BinSpace(HdrLength(value));
         bin_data = (char*)(mem.data + i + 1);
       }
     }
@@ -76,7 +76,7 @@ u32 DisassembleInst(u8 *code, u32 *index)
     arg_str = MemValStr(arg);
     len += fprintf(stderr, " %s", arg_str);
     free(arg_str);
-    (*index) += LEBSize(arg);
+    while (code[(*index)++] & 0x80);
     return len;
   case opLookup:
   case opDefine:
@@ -131,11 +131,11 @@ static void OpPanic(VM *vm)
 {
   char *msg = 0;
   if (StackSize() > 0) {
-    u32 msgVal = StackPop();
+    val msgVal = StackPop();
     if (IsBinary(msgVal)) {
       msg = StringFrom(BinaryData(msgVal), ObjLength(msgVal));
     } else if (IsInt(msgVal)) {
-      char *name = SymbolName(RawVal(msgVal));
+      char *name = SymbolValName(msgVal);
       if (name) {
         msg = StringFrom(name, StrLen(name));
       }
@@ -148,18 +148,21 @@ static void OpPanic(VM *vm)
 
 static void OpConst(VM *vm)
 {
-  u32 value = ReadLEB(++vm->pc, vm->program->code);
-  vm->pc += LEBSize(value);
-  StackPush(value);
+  /* constants are encoded as 32-bit values, which sign-extend into wide values. Module IDs are
+   * padded (see "chunk.h"), so this skips every byte of the LEB rather than its minimal size. */
+  u8 *code = vm->program->code;
+  i32 value = ReadLEB(++vm->pc, code);
+  while (code[vm->pc++] & 0x80);
+  StackPush((val)(ival)value);
 }
 
 static void OpLookup(VM *vm)
 {
   u32 n = ReadLEB(++vm->pc, vm->program->code);
-  u32 env;
+  val env;
   env = StackPop();
   while (env) {
-    u32 frame = Head(env);
+    val frame = Head(env);
     if (ObjLength(frame) > n) {
       StackPush(TupleGet(frame, n));
       break;
@@ -177,11 +180,11 @@ static void OpLookup(VM *vm)
 static void OpDefine(VM *vm)
 {
   u32 n = ReadLEB(++vm->pc, vm->program->code);
-  u32 env, value;
+  val env, value;
   value = StackPop();
   env = StackPop();
   while (env) {
-    u32 frame = Head(env);
+    val frame = Head(env);
     if (ObjLength(frame) > n) {
       TupleSet(frame, n, value);
       break;
@@ -205,7 +208,7 @@ static void OpPos(VM *vm)
 
 static void OpGoto(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   assert(IsInt(a));
   assert(RawInt(a) >= 0 && RawInt(a) < (i32)VecCount(vm->program->code));
@@ -226,7 +229,7 @@ static void OpJump(VM *vm)
 
 static void OpBranch(VM *vm)
 {
-  u32 a;
+  val a;
   i32 n = ReadLEB(++vm->pc, vm->program->code);
   vm->pc += LEBSize(n);
 
@@ -263,7 +266,7 @@ static void OpLink(VM *vm)
 
 static void OpUnlink(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   if (!IsInt(a)) {
     RuntimeError("Invalid stack link", vm);
@@ -275,7 +278,7 @@ static void OpUnlink(VM *vm)
 
 static void OpAdd(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -288,7 +291,7 @@ static void OpAdd(VM *vm)
 
 static void OpSub(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -301,7 +304,7 @@ static void OpSub(VM *vm)
 
 static void OpMul(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -314,7 +317,7 @@ static void OpMul(VM *vm)
 
 static void OpDiv(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -331,7 +334,7 @@ static void OpDiv(VM *vm)
 
 static void OpRem(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -348,7 +351,7 @@ static void OpRem(VM *vm)
 
 static void OpAnd(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -361,7 +364,7 @@ static void OpAnd(VM *vm)
 
 static void OpOr(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -374,7 +377,7 @@ static void OpOr(VM *vm)
 
 static void OpComp(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   if (!IsInt(a)) {
     RuntimeError("Only integers can be complemented", vm);
@@ -386,7 +389,7 @@ static void OpComp(VM *vm)
 
 static void OpLt(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -399,7 +402,7 @@ static void OpLt(VM *vm)
 
 static void OpGt(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -412,7 +415,7 @@ static void OpGt(VM *vm)
 
 static void OpEq(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   StackPush(IntVal(ValEq(a, b)));
@@ -421,7 +424,7 @@ static void OpEq(VM *vm)
 
 static void OpNeg(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   if (!IsInt(a)) {
     RuntimeError("Only integers can be negated", vm);
@@ -433,7 +436,7 @@ static void OpNeg(VM *vm)
 
 static void OpNot(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   StackPush(IntVal(RawVal(a) == 0));
   vm->pc++;
@@ -441,26 +444,27 @@ static void OpNot(VM *vm)
 
 static void OpShift(VM *vm)
 {
-  i32 a, b;
+  val a, b;
+  ival n, shift;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
     RuntimeError("Only integers can be shifted", vm);
     return;
   }
-  a = RawInt(a);
-  b = RawInt(b);
-  if (b < 0) {
-    StackPush(IntVal(a >> -b));
+  n = RawInt(a);
+  shift = RawInt(b);
+  if (shift < 0) {
+    StackPush(IntVal(n >> -shift));
   } else {
-    StackPush(IntVal(a << b));
+    StackPush(IntVal(n << shift));
   }
   vm->pc++;
 }
 
 static void OpXor(VM *vm)
 {
-  i32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(a) || !IsInt(b)) {
@@ -486,7 +490,7 @@ static void OpDrop(VM *vm)
 
 static void OpSwap(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   StackPush(b);
@@ -503,7 +507,7 @@ static void OpOver(VM *vm)
 
 static void OpRot(VM *vm)
 {
-  u32 a, b, c;
+  val a, b, c;
   c = StackPop();
   b = StackPop();
   a = StackPop();
@@ -530,7 +534,7 @@ static void OpPick(VM *vm)
 
 static void OpPair(VM *vm)
 {
-  u32 a, b;
+  val a, b;
 
   b = StackPop();
   a = StackPop();
@@ -540,7 +544,7 @@ static void OpPair(VM *vm)
 
 static void OpHead(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   if (!IsPair(a)) {
     RuntimeError("Only pairs have heads", vm);
@@ -552,7 +556,7 @@ static void OpHead(VM *vm)
 
 static void OpTail(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   if (!IsPair(a)) {
     RuntimeError("Only pairs have tails", vm);
@@ -571,7 +575,7 @@ static void OpTuple(VM *vm)
 
 static void OpLen(VM *vm)
 {
-  u32 a;
+  val a;
   a = StackPop();
   if (!IsTuple(a) && !IsBinary(a)) {
     RuntimeError("Only tuples and binaries have lengths", vm);
@@ -583,14 +587,14 @@ static void OpLen(VM *vm)
 
 static void OpGet(VM *vm)
 {
-  u32 a, b;
+  val a, b;
   b = StackPop();
   a = StackPop();
   if (!IsInt(b)) {
     RuntimeError("Only integers can be indexes", vm);
     return;
   }
-  if (RawInt(b) < 0 || RawInt(b) >= (i32)ObjLength(a)) {
+  if (RawInt(b) < 0 || RawInt(b) >= (ival)ObjLength(a)) {
     RuntimeError("Out of bounds", vm);
     return;
   }
@@ -607,7 +611,7 @@ static void OpGet(VM *vm)
 
 static void OpSet(VM *vm)
 {
-  u32 a, b, c;
+  val a, b, c;
   c = StackPop();
   b = StackPop();
   a = StackPop();
@@ -634,14 +638,14 @@ static void OpSet(VM *vm)
 static void OpStr(VM *vm)
 {
   char *name;
-  u32 a;
+  val a;
 
   a = StackPop();
   if (!IsInt(a)) {
     RuntimeError("Only symbols can become strings", vm);
     return;
   }
-  name = SymbolName(RawVal(a));
+  name = SymbolValName(a);
   if (!name) {
     RuntimeError("Unrecognized symbol", vm);
     return;
@@ -652,7 +656,7 @@ static void OpStr(VM *vm)
 
 static void OpJoin(VM *vm)
 {
-  u32 a, b, obj = 0;
+  val a, b, obj = 0;
   b = StackPop();
   a = StackPop();
   if (ValType(a) != ValType(b)) {
@@ -683,7 +687,7 @@ static void OpJoin(VM *vm)
 
 static void OpSlice(VM *vm)
 {
-  u32 a, b, c, obj = 0;
+  val a, b, c, obj = 0;
   c = StackPop();
   b = StackPop();
   a = StackPop();
@@ -691,7 +695,7 @@ static void OpSlice(VM *vm)
     RuntimeError("Only integers can be slice indexes", vm);
     return;
   }
-  if (RawInt(b) < 0 || RawInt(c) < RawInt(b) || RawInt(c) > (i32)ObjLength(a)) {
+  if (RawInt(b) < 0 || RawInt(c) < RawInt(b) || RawInt(c) > (ival)ObjLength(a)) {
     RuntimeError("Out of bounds", vm);
     return;
   }
@@ -711,7 +715,7 @@ static void OpSlice(VM *vm)
 static void OpTrap(VM *vm)
 {
   u32 id = ReadLEB(vm->pc+1, vm->program->code);
-  u32 value;
+  val value;
   value = PrimitiveFn(id)(vm);
   if (vm->error) return;
 
@@ -1,6 +1,11 @@
 #include "runtime/primitives.h"
+#include "runtime/buffer.h"
+#include "runtime/builder.h"
 #include "runtime/mem.h"
+#include "runtime/map.h"
+#include "runtime/sort.h"
 #include "runtime/symbol.h"
+#include "runtime/vector.h"
 #include "univ/file.h"
 #include "graphics/font.h"
 #include "univ/math.h"
@@ -9,8 +14,9 @@
 #include "univ/time.h"
 #include "univ/vec.h"
 #include "graphics/window.h"
+#include <sys/uio.h>
 
-static u32 IOError(char *msg, VM *vm)
+static val IOError(char *msg, VM *vm)
 {
   StackPush(Tuple(2));
   TupleSet(StackPeek(0), 0, IntVal(Symbol("error")));
@@ -18,9 +24,9 @@ static u32 IOError(char *msg, VM *vm)
   return StackPop();
 }
 
-static u32 VMPanic(VM *vm)
+static val VMPanic(VM *vm)
 {
-  u32 a;
+  val a;
   assert(StackSize() >= 1);
   a = StackPop();
   if (IsBinary(a)) {
@@ -33,9 +39,9 @@ static u32 VMPanic(VM *vm)
   return a;
 }
 
-static u32 VMTypeOf(VM *vm)
+static val VMTypeOf(VM *vm)
 {
-  u32 a;
+  val a;
   assert(StackSize() >= 1);
   a = StackPop();
   if (IsPair(a))    return IntVal(Symbol("pair"));
@@ -46,22 +52,45 @@ static u32 VMTypeOf(VM *vm)
   return 0;
 }
 
-static u32 VMFormat(VM *vm)
+static val VMFormat(VM *vm)
 {
   assert(StackSize() >= 1);
   return FormatVal(StackPop());
 }
 
-static u32 VMMakeTuple(VM *vm)
+/* Returns the length of a list, or -1 if it isn't a proper list */
+static i32 ListLength(val list)
 {
-  u32 list, size = 0, tuple, i;
-  assert(StackSize() >= 1);
-  list = StackPeek(0);
-  if (!IsPair(list)) return RuntimeError("Expected a list", vm);
+  i32 length = 0;
   while (list) {
-    size++;
+    if (!IsPair(list)) return -1;
+    length++;
+    list = Tail(list);
+  }
+  return length;
+}
+
+/* Conses the first count items of a list onto a tail, in order. Memory must be reserved. */
+static val CopyList(val list, u32 count, val tail)
+{
+  val *items = malloc(count*sizeof(val));
+  u32 i;
+  for (i = 0; i < count; i++) {
+    items[i] = Head(list);
     list = Tail(list);
   }
+  while (count > 0) tail = Pair(items[--count], tail);
+  free(items);
+  return tail;
+}
+
+static val VMMakeTuple(VM *vm)
+{
+  val list, tuple;
+  i32 size, i;
+  assert(StackSize() >= 1);
+  size = ListLength(StackPeek(0));
+  if (size < 0) return RuntimeError("Expected a list", vm);
 
   tuple = Tuple(size);
   list = StackPop();
@@ -72,22 +101,213 @@ static u32 VMMakeTuple(VM *vm)
   return tuple;
 }
 
-static u32 VMSymbolName(VM *vm)
+static val VMTupleToList(VM *vm)
+{
+  val tuple, list = 0;
+  u32 i;
+  assert(StackSize() >= 1);
+  if (!IsTuple(StackPeek(0))) return RuntimeError("Expected a tuple", vm);
+  ReserveMem(2*ObjLength(StackPeek(0)));
+  tuple = StackPop();
+  for (i = ObjLength(tuple); i > 0; i--) list = Pair(TupleGet(tuple, i - 1), list);
+  return list;
+}
+
+static val VMListLength(VM *vm)
+{
+  i32 length;
+  assert(StackSize() >= 1);
+  length = ListLength(StackPop());
+  if (length < 0) return RuntimeError("Expected a list", vm);
+  return IntVal(length);
+}
+
+static val VMListReverse(VM *vm)
+{
+  val list, reversed = 0;
+  i32 length;
+  assert(StackSize() >= 1);
+  length = ListLength(StackPeek(0));
+  if (length < 0) return RuntimeError("Expected a list", vm);
+  ReserveMem(2*length);
+  list = StackPop();
+  while (list) {
+    reversed = Pair(Head(list), reversed);
+    list = Tail(list);
+  }
+  return reversed;
+}
+
+static val VMListNth(VM *vm)
+{
+  val index, list;
+  ival i;
+  assert(StackSize() >= 2);
+  index = StackPop();
+  list = StackPop();
+  if (!IsPair(list)) return RuntimeError("Expected a list", vm);
+  if (!IsInt(index)) return RuntimeError("Index must be an integer", vm);
+  if (RawInt(index) < 0) return 0;
+  for (i = 0; i < RawInt(index) && list && IsPair(list); i++) list = Tail(list);
+  if (!IsPair(list)) return RuntimeError("Expected a list", vm);
+  return Head(list);
+}
+
+static val VMListMember(VM *vm)
+{
+  val item, list;
+  assert(StackSize() >= 2);
+  item = StackPop();
+  list = StackPop();
+  while (list && IsPair(list)) {
+    if (ValEq(Head(list), item)) return IntVal(1);
+    list = Tail(list);
+  }
+  if (list) return RuntimeError("Expected a list", vm);
+  return IntVal(0);
+}
+
+static val VMListAppend(VM *vm)
+{
+  val right, left;
+  i32 length;
+  assert(StackSize() >= 2);
+  length = ListLength(StackPeek(1));
+  if (length < 0) return RuntimeError("Expected a list", vm);
+  ReserveMem(2*length);
+  right = StackPop();
+  left = StackPop();
+  return CopyList(left, length, right);
+}
+
+static val VMListTake(VM *vm)
+{
+  val n, list;
+  ival count = 0;
+  assert(StackSize() >= 2);
+  n = StackPeek(0);
+  if (!IsInt(n)) return RuntimeError("Count must be an integer", vm);
+  for (list = StackPeek(1); list && count < RawInt(n); list = Tail(list)) {
+    if (!IsPair(list)) return RuntimeError("Expected a list", vm);
+    count++;
+  }
+  ReserveMem(2*count);
+  StackPop();
+  return CopyList(StackPop(), count, 0);
+}
+
+static val VMListDrop(VM *vm)
+{
+  val n, list;
+  ival i;
+  assert(StackSize() >= 2);
+  n = StackPop();
+  list = StackPop();
+  if (!IsInt(n)) return RuntimeError("Count must be an integer", vm);
+  for (i = 0; i < RawInt(n) && list; i++) {
+    if (!IsPair(list)) return RuntimeError("Expected a list", vm);
+    list = Tail(list);
+  }
+  return list;
+}
+
+/* Counts the items of nested lists, or returns -1 if one isn't a proper list */
+static i32 FlatLength(val list)
+{
+  i32 length = 0;
+  while (list) {
+    if (!IsPair(list)) return -1;
+    if (IsPair(Head(list))) {
+      i32 nested = FlatLength(Head(list));
+      if (nested < 0) return -1;
+      length += nested;
+    } else {
+      length++;
+    }
+    list = Tail(list);
+  }
+  return length;
+}
+
+static val *FlattenInto(val list, val *items)
+{
+  for (; list; list = Tail(list)) {
+    if (IsPair(Head(list))) {
+      items = FlattenInto(Head(list), items);
+    } else {
+      *items++ = Head(list);
+    }
+  }
+  return items;
+}
+
+static val VMListFlatten(VM *vm)
+{
+  val *items, flat = 0;
+  i32 length;
+  assert(StackSize() >= 1);
+  length = FlatLength(StackPeek(0));
+  if (length < 0) return RuntimeError("Expected a list", vm);
+  ReserveMem(2*length);
+  items = malloc(length*sizeof(val));
+  FlattenInto(StackPop(), items);
+  while (length > 0) flat = Pair(items[--length], flat);
+  free(items);
+  return flat;
+}
+
+static bool IsSortable(val items)
+{
+  return IsTuple(items) || ListLength(items) >= 0;
+}
+
+static val VMSort(VM *vm)
+{
+  val items;
+  assert(StackSize() >= 1);
+  items = StackPop();
+  if (!IsSortable(items)) return RuntimeError("Expected a list or tuple", vm);
+  return Sort(items, vm);
+}
+
+static val VMSortWith(VM *vm)
+{
+  val items, less;
+  assert(StackSize() >= 2);
+  less = StackPop();
+  items = StackPop();
+  if (!IsSortable(items)) return RuntimeError("Expected a list or tuple", vm);
+  if (!IsFunction(less)) return RuntimeError("Expected a function", vm);
+  return SortWith(items, less, vm);
+}
+
+static val VMSortByKey(VM *vm)
+{
+  val items, key_fn;
+  assert(StackSize() >= 2);
+  key_fn = StackPop();
+  items = StackPop();
+  if (!IsSortable(items)) return RuntimeError("Expected a list or tuple", vm);
+  if (!IsFunction(key_fn)) return RuntimeError("Expected a function", vm);
+  return SortByKey(items, key_fn, vm);
+}
+
+static val VMSymbolName(VM *vm)
 {
-  u32 a;
+  val a;
   char *name;
-  u32 bin;
+  val bin;
   assert(StackSize() >= 1);
   a = StackPop();
-  name = SymbolName(RawVal(a));
+  name = SymbolValName(a);
   if (!name || !*name) return 0;
   bin = Binary(name);
   return bin;
 }
 
-static u32 VMOpen(VM *vm)
+static val VMOpen(VM *vm)
 {
-  u32 flags, path;
+  val flags, path;
   char *str, *error;
   i32 file;
   assert(StackSize() >= 2);
@@ -104,9 +324,9 @@ static u32 VMOpen(VM *vm)
   return IntVal(file);
 }
 
-static u32 VMOpenSerial(VM *vm)
+static val VMOpenSerial(VM *vm)
 {
-  u32 opts, port, speed;
+  val opts, port, speed;
   i32 file;
   char *str, *error;
   assert(StackSize() >= 3);
@@ -127,9 +347,9 @@ static u32 VMOpenSerial(VM *vm)
   return IntVal(file);
 }
 
-static u32 VMClose(VM *vm)
+static val VMClose(VM *vm)
 {
-  u32 file;
+  val file;
   char *err;
   assert(StackSize() >= 1);
   file = StackPop();
@@ -140,9 +360,9 @@ static u32 VMClose(VM *vm)
   return IntVal(Symbol("ok"));
 }
 
-static u32 VMRead(VM *vm)
+static val VMRead(VM *vm)
 {
-  u32 result, size, file;
+  val result, size, file;
   char *data, *error;
   i32 bytes_read;
   assert(StackSize() >= 2);
@@ -160,24 +380,95 @@ static u32 VMRead(VM *vm)
   return result;
 }
 
-static u32 VMWrite(VM *vm)
+/* Collects the segments of an iolist into iovecs. Binaries are referenced in place; runs of byte
+ * integers are copied into a side buffer, and their iovecs hold offsets into it until the walk is
+ * done (the buffer may move as it grows). */
+typedef struct {
+  struct iovec *iov; /* vec */
+  u8 *bytes; /* vec */
+  u32 *byte_runs; /* vec */
+} IOGather;
+
+static void GatherIOList(val value, IOGather *gather)
+{
+  while (value && IsPair(value)) {
+    GatherIOList(Head(value), gather);
+    value = Tail(value);
+  }
+  if (IsInt(value) && RawInt(value) >= 0 && RawInt(value) < 256) {
+    u32 last = VecCount(gather->iov);
+    if (VecCount(gather->byte_runs) == 0 ||
+        gather->byte_runs[VecCount(gather->byte_runs)-1] != last-1) {
+      struct iovec run;
+      run.iov_base = (void*)(size_t)VecCount(gather->bytes);
+      run.iov_len = 0;
+      VecPush(gather->byte_runs, last);
+      VecPush(gather->iov, run);
+      last++;
+    }
+    VecPush(gather->bytes, (u8)RawInt(value));
+    gather->iov[last-1].iov_len++;
+  } else if (IsBinary(value) && ObjLength(value) > 0) {
+    struct iovec seg;
+    seg.iov_base = BinaryData(value);
+    seg.iov_len = ObjLength(value);
+    VecPush(gather->iov, seg);
+  } else if (IsTuple(value)) {
+    u32 i;
+    for (i = 0; i < ObjLength(value); i++) {
+      GatherIOList(TupleGet(value, i), gather);
+    }
+  }
+}
+
+static i32 WriteIOList(i32 file, val data, char **error)
 {
-  u32 buf, file;
+  IOGather gather = {0};
+  u32 i;
+  i32 written;
+
+  GatherIOList(data, &gather);
+  for (i = 0; i < VecCount(gather.byte_runs); i++) {
+    struct iovec *run = &gather.iov[gather.byte_runs[i]];
+    run->iov_base = gather.bytes + (size_t)run->iov_base;
+  }
+  written = WriteVec(file, gather.iov, VecCount(gather.iov), error);
+  FreeVec(gather.iov);
+  FreeVec(gather.bytes);
+  FreeVec(gather.byte_runs);
+  return written;
+}
+
+static val VMWrite(VM *vm)
+{
+  val buf, file;
   i32 written;
   char *error;
   assert(StackSize() >= 2);
   buf = StackPop();
   file = StackPop();
   if (!IsInt(file)) return RuntimeError("File must be an integer", vm);
-  if (!IsBinary(buf)) return RuntimeError("Data must be binary", vm);
-  written = Write(RawInt(file), BinaryData(buf), ObjLength(buf), &error);
+  if (IsBinary(buf)) {
+    written = Write(RawInt(file), BinaryData(buf), ObjLength(buf), &error);
+  } else if (IsPair(buf) || IsTuple(buf)) {
+    /* no allocation happens between gathering and writing, so heap pointers stay valid */
+    written = WriteIOList(RawInt(file), buf, &error);
+  } else {
+    return RuntimeError("Data must be binary or an iolist", vm);
+  }
   if (error) return IOError(error, vm);
   return IntVal(written);
 }
 
-static u32 VMSeek(VM *vm)
+static val VMIOListSize(VM *vm)
+{
+  assert(StackSize() >= 1);
+  return IntVal(IOListSize(StackPop()));
+}
+
+static val VMSeek(VM *vm)
 {
-  u32 whence, offset, file;
+  val whence, offset, file;
   i32 pos;
   char *error;
   assert(StackSize() >= 3);
@@ -194,9 +485,9 @@ static u32 VMSeek(VM *vm)
   return IntVal(pos);
 }
 
-static u32 VMListen(VM *vm)
+static val VMListen(VM *vm)
 {
-  u32 portVal;
+  val portVal;
   i32 s;
   char *port, *error;
   assert(StackSize() >= 1);
@@ -210,9 +501,9 @@ static u32 VMListen(VM *vm)
   return IntVal(s);
 }
 
-static u32 VMAccept(VM *vm)
+static val VMAccept(VM *vm)
 {
-  u32 socketVal;
+  val socketVal;
   i32 s;
   char *error;
   assert(StackSize() >= 1);
@@ -223,9 +514,9 @@ static u32 VMAccept(VM *vm)
   return IntVal(s);
 }
 
-static u32 VMConnect(VM *vm)
+static val VMConnect(VM *vm)
 {
-  u32 portVal, nodeVal;
+  val portVal, nodeVal;
   i32 s;
   char *node, *port, *error;
 
@@ -249,14 +540,14 @@ static u32 VMConnect(VM *vm)
   return IntVal(s);
 }
 
-static u32 VMRandom(VM *vm)
+static val VMRandom(VM *vm)
 {
   return IntVal(Random());
 }
 
-static u32 VMSeed(VM *vm)
+static val VMSeed(VM *vm)
 {
-  u32 seed;
+  val seed;
   assert(StackSize() >= 1);
   seed = StackPop();
   if (!IsInt(seed)) return RuntimeError("Seed must be an integer", vm);
@@ -264,7 +555,7 @@ static u32 VMSeed(VM *vm)
   return 0;
 }
 
-static u32 VMArgs(VM *vm)
+static val VMArgs(VM *vm)
 {
   u32 i;
   u32 num_args = VecCount(vm->opts->program_args);
@@ -277,11 +568,11 @@ static u32 VMArgs(VM *vm)
   return StackPop();
 }
 
-static u32 VMEnv(VM *vm)
+static val VMEnv(VM *vm)
 {
   char *name;
   char *value;
-  u32 nameVal, valueVal;
+  val nameVal, valueVal;
 
   assert(StackSize() >= 1);
   nameVal = StackPop();
@@ -297,11 +588,11 @@ static u32 VMEnv(VM *vm)
   return valueVal;
 }
 
-static u32 VMShell(VM *vm)
+static val VMShell(VM *vm)
 {
   char *cmd;
-  u32 cmdVal;
-  u32 result;
+  val cmdVal;
+  val result;
 
   assert(StackSize() >= 1);
   cmdVal = StackPeek(0);
@@ -315,46 +606,401 @@ static u32 VMShell(VM *vm)
   return IntVal(result);
 }
 
-static u32 VMMaxInt(VM *vm)
+static val VMMaxInt(VM *vm)
 {
   return MaxIntVal;
 }
 
-static u32 VMMinInt(VM *vm)
+static val VMMinInt(VM *vm)
 {
   return MinIntVal;
 }
 
-static u32 VMPopCount(VM *vm)
+static val VMPopCount(VM *vm)
 {
-  i32 a;
+  val a;
+  u32 count;
   assert(StackSize() >= 1);
   a = StackPop();
   if (!IsInt(a)) return RuntimeError("Only integers can be popcnt'd", vm);
-  return IntVal(PopCount(RawInt(a)));
+  count = PopCount((u32)RawInt(a));
+#ifdef WIDE_VALUES
+  count += PopCount((u32)((val)RawInt(a) >> 32));
+#endif
+  return IntVal(count);
 }
 
-static u32 VMHash(VM *vm)
+static val VMHash(VM *vm)
 {
   assert(StackSize() >= 1);
   return HashVal(StackPop());
 }
 
-static u32 VMTime(VM *vm)
+static val VMCompare(VM *vm)
+{
+  val a, b;
+  assert(StackSize() >= 2);
+  b = StackPop();
+  a = StackPop();
+  return IntVal(CompareVal(a, b));
+}
+
+static val VMGCStep(VM *vm)
+{
+  val budget;
+  assert(StackSize() >= 1);
+  budget = StackPop();
+  if (!IsInt(budget) || RawInt(budget) < 0) {
+    return RuntimeError("Budget must be a non-negative integer", vm);
+  }
+  return IntVal(GCStep(RawInt(budget)));
+}
+
+static val VMVectorNew(VM *vm)
+{
+  assert(StackSize() >= 1);
+  if (!IsPair(StackPeek(0))) return RuntimeError("Expected a list", vm);
+  return ListToVector(StackPop());
+}
+
+static val VMVectorCount(VM *vm)
+{
+  val vector;
+  assert(StackSize() >= 1);
+  vector = StackPop();
+  if (!IsVector(vector) && !IsTransientVector(vector)) {
+    return RuntimeError("Expected a vector", vm);
+  }
+  return IntVal(VectorCount(vector));
+}
+
+static val VMVectorGet(VM *vm)
+{
+  val index, vector;
+  assert(StackSize() >= 2);
+  index = StackPop();
+  vector = StackPop();
+  if (!IsVector(vector) && !IsTransientVector(vector)) {
+    return RuntimeError("Expected a vector", vm);
+  }
+  if (!IsInt(index)) return RuntimeError("Index must be an integer", vm);
+  if (RawInt(index) < 0 || (u32)RawInt(index) >= VectorCount(vector)) return 0;
+  return VectorGet(vector, RawInt(index));
+}
+
+static val VMVectorSet(VM *vm)
+{
+  val value, index, vector;
+  assert(StackSize() >= 3);
+  value = StackPop();
+  index = StackPop();
+  vector = StackPop();
+  if (!IsVector(vector)) return RuntimeError("Expected a vector", vm);
+  if (!IsInt(index)) return RuntimeError("Index must be an integer", vm);
+  if (RawInt(index) < 0 || (u32)RawInt(index) >= VectorCount(vector)) {
+    return RuntimeError("Out of bounds", vm);
+  }
+  return VectorSet(vector, RawInt(index), value);
+}
+
+static val VMVectorPush(VM *vm)
+{
+  val value, vector;
+  assert(StackSize() >= 2);
+  value = StackPop();
+  vector = StackPop();
+  if (!IsVector(vector)) return RuntimeError("Expected a vector", vm);
+  return VectorPush(vector, value);
+}
+
+static val VMVectorPop(VM *vm)
+{
+  val vector;
+  assert(StackSize() >= 1);
+  vector = StackPop();
+  if (!IsVector(vector)) return RuntimeError("Expected a vector", vm);
+  if (VectorCount(vector) == 0) return RuntimeError("Vector is empty", vm);
+  return VectorPop(vector);
+}
+
+static val VMVectorConcat(VM *vm)
+{
+  val right, left;
+  assert(StackSize() >= 2);
+  right = StackPop();
+  left = StackPop();
+  if (!IsVector(left) || !IsVector(right)) return RuntimeError("Expected a vector", vm);
+  return VectorConcat(left, right);
+}
+
+static val VMVectorSlice(VM *vm)
+{
+  val end, start, vector;
+  assert(StackSize() >= 3);
+  end = StackPop();
+  start = StackPop();
+  vector = StackPop();
+  if (!IsVector(vector)) return RuntimeError("Expected a vector", vm);
+  if (!IsInt(start) || !IsInt(end)) return RuntimeError("Indexes must be integers", vm);
+  if (RawInt(start) < 0 || RawInt(end) < 0) return RuntimeError("Out of bounds", vm);
+  return VectorSlice(vector, RawInt(start), RawInt(end));
+}
+
+static val VMVectorToList(VM *vm)
+{
+  val vector;
+  assert(StackSize() >= 1);
+  vector = StackPop();
+  if (!IsVector(vector) && !IsTransientVector(vector)) {
+    return RuntimeError("Expected a vector", vm);
+  }
+  return VectorToList(vector);
+}
+
+static val VMVectorTransient(VM *vm)
+{
+  val vector;
+  assert(StackSize() >= 1);
+  vector = StackPop();
+  if (!IsVector(vector)) return RuntimeError("Expected a vector", vm);
+  return VectorTransient(vector);
+}
+
+static val VMTransientPush(VM *vm)
+{
+  val value, transient;
+  assert(StackSize() >= 2);
+  value = StackPop();
+  transient = StackPop();
+  if (!IsTransientVector(transient)) return RuntimeError("Expected a transient vector", vm);
+  return TransientPush(transient, value);
+}
+
+static val VMTransientSet(VM *vm)
+{
+  val value, index, transient;
+  assert(StackSize() >= 3);
+  value = StackPop();
+  index = StackPop();
+  transient = StackPop();
+  if (!IsTransientVector(transient)) return RuntimeError("Expected a transient vector", vm);
+  if (!IsInt(index)) return RuntimeError("Index must be an integer", vm);
+  if (RawInt(index) < 0 || (u32)RawInt(index) >= VectorCount(transient)) {
+    return RuntimeError("Out of bounds", vm);
+  }
+  return TransientSet(transient, RawInt(index), value);
+}
+
+static val VMTransientPop(VM *vm)
+{
+  val transient;
+  assert(StackSize() >= 1);
+  transient = StackPop();
+  if (!IsTransientVector(transient)) return RuntimeError("Expected a transient vector", vm);
+  if (VectorCount(transient) == 0) return RuntimeError("Vector is empty", vm);
+  return TransientPop(transient);
+}
+
+static val VMPersistVector(VM *vm)
+{
+  val transient;
+  assert(StackSize() >= 1);
+  transient = StackPop();
+  if (!IsTransientVector(transient)) return RuntimeError("Expected a transient vector", vm);
+  return PersistVector(transient);
+}
+
+static val VMMapNew(VM *vm)
+{
+  val list;
+  assert(StackSize() >= 1);
+  list = StackPeek(0);
+  if (!IsPair(list)) return RuntimeError("Expected a list", vm);
+  while (list) {
+    if (!Head(list) || !IsPair(Head(list))) return RuntimeError("Expected a list of entries", vm);
+    list = Tail(list);
+  }
+  return ListToMap(StackPop());
+}
+
+static val VMMapCount(VM *vm)
+{
+  val map;
+  assert(StackSize() >= 1);
+  map = StackPop();
+  if (!IsMap(map)) return RuntimeError("Expected a map", vm);
+  return IntVal(MapCount(map));
+}
+
+static val VMMapGet(VM *vm)
+{
+  val missing, key, map;
+  assert(StackSize() >= 3);
+  missing = StackPop();
+  key = StackPop();
+  map = StackPop();
+  if (!IsMap(map)) return RuntimeError("Expected a map", vm);
+  return MapGet(map, key, missing);
+}
+
+static val VMMapContains(VM *vm)
+{
+  val key, map;
+  assert(StackSize() >= 2);
+  key = StackPop();
+  map = StackPop();
+  if (!IsMap(map)) return RuntimeError("Expected a map", vm);
+  return IntVal(MapContains(map, key));
+}
+
+static val VMMapPut(VM *vm)
+{
+  val value, key, map;
+  assert(StackSize() >= 3);
+  value = StackPop();
+  key = StackPop();
+  map = StackPop();
+  if (!IsMap(map)) return RuntimeError("Expected a map", vm);
+  return MapPut(map, key, value);
+}
+
+static val VMMapDelete(VM *vm)
+{
+  val key, map;
+  assert(StackSize() >= 2);
+  key = StackPop();
+  map = StackPop();
+  if (!IsMap(map)) return RuntimeError("Expected a map", vm);
+  return MapDelete(map, key);
+}
+
+static val VMMapEntries(VM *vm)
+{
+  val map;
+  assert(StackSize() >= 1);
+  map = StackPop();
+  if (!IsMap(map)) return RuntimeError("Expected a map", vm);
+  return MapEntries(map);
+}
+
+static val VMBuilderNew(VM *vm)
+{
+  val length, kind;
+  assert(StackSize() >= 2);
+  length = StackPop();
+  kind = StackPop();
+  if (kind != IntVal(Symbol("tuple")) && kind != IntVal(Symbol("binary")) &&
+      kind != IntVal(Symbol("map"))) {
+    return RuntimeError("Builders can only build tuples, binaries and maps", vm);
+  }
+  if (!IsInt(length) || RawInt(length) < 0) return RuntimeError("Expected a length", vm);
+  return NewBuilder(kind, RawInt(length));
+}
+
+static val VMBuilderSet(VM *vm)
+{
+  val value, index, builder;
+  assert(StackSize() >= 3);
+  value = StackPop();
+  index = StackPop();
+  builder = StackPop();
+  if (!IsBuilder(builder)) return RuntimeError("Expected a builder", vm);
+  if (!BuilderKind(builder)) return RuntimeError("Builder is frozen", vm);
+  if (BuilderKind(builder) == IntVal(Symbol("map"))) return BuilderPut(builder, index, value);
+  if (!IsInt(index) || RawInt(index) < 0 || (u32)RawInt(index) >= BuilderLength(builder)) {
+    return RuntimeError("Index out of bounds", vm);
+  }
+  if (BuilderKind(builder) == IntVal(Symbol("binary")) && !IsInt(value)) {
+    return RuntimeError("Expected a byte", vm);
+  }
+  BuilderSet(builder, RawInt(index), value);
+  return builder;
+}
+
+static val VMBuilderFreeze(VM *vm)
+{
+  val builder;
+  assert(StackSize() >= 1);
+  builder = StackPop();
+  if (!IsBuilder(builder)) return RuntimeError("Expected a builder", vm);
+  if (!BuilderKind(builder)) return RuntimeError("Builder is frozen", vm);
+  return FreezeBuilder(builder);
+}
+
+static val VMBufferNew(VM *vm)
+{
+  val capacity;
+  assert(StackSize() >= 1);
+  capacity = StackPop();
+  if (!IsInt(capacity) || RawInt(capacity) < 0) return RuntimeError("Expected a capacity", vm);
+  return NewBuffer(RawInt(capacity));
+}
+
+static val VMBufferLength(VM *vm)
+{
+  val buffer;
+  assert(StackSize() >= 1);
+  buffer = StackPop();
+  if (!IsBuffer(buffer)) return RuntimeError("Expected a buffer", vm);
+  return IntVal(BufferLength(buffer));
+}
+
+static val VMBufferWrite(VM *vm)
+{
+  val data, buffer;
+  assert(StackSize() >= 2);
+  data = StackPop();
+  buffer = StackPop();
+  if (!IsBuffer(buffer)) return RuntimeError("Expected a buffer", vm);
+  if (BufferFinished(buffer)) return RuntimeError("Buffer is finished", vm);
+  return BufferWrite(buffer, data);
+}
+
+static val VMBufferWriteInt(VM *vm)
+{
+  val endian, size, value, buffer;
+  assert(StackSize() >= 4);
+  endian = StackPop();
+  size = StackPop();
+  value = StackPop();
+  buffer = StackPop();
+  if (!IsBuffer(buffer)) return RuntimeError("Expected a buffer", vm);
+  if (BufferFinished(buffer)) return RuntimeError("Buffer is finished", vm);
+  if (!IsInt(value)) return RuntimeError("Expected an integer", vm);
+  if (!IsInt(size) || RawInt(size) < 1 || RawInt(size) > 8) {
+    return RuntimeError("Size must be from 1 to 8 bytes", vm);
+  }
+  if (endian != IntVal(Symbol("big")) && endian != IntVal(Symbol("little"))) {
+    return RuntimeError("Endianness must be :big or :little", vm);
+  }
+  return BufferWriteInt(buffer, RawInt(value), RawInt(size), endian == IntVal(Symbol("little")));
+}
+
+static val VMBufferFinish(VM *vm)
+{
+  val buffer;
+  assert(StackSize() >= 1);
+  buffer = StackPop();
+  if (!IsBuffer(buffer)) return RuntimeError("Expected a buffer", vm);
+  if (BufferFinished(buffer)) return RuntimeError("Buffer is finished", vm);
+  return FinishBuffer(buffer);
+}
+
+static val VMTime(VM *vm)
 {
   return IntVal(Time());
 }
 
-static u32 VMMillis(VM *vm)
+static val VMMillis(VM *vm)
 {
   i32 t = Microtime()/1000;
   return IntVal(t);
 }
 
-static u32 VMNewWindow(VM *vm)
+static val VMNewWindow(VM *vm)
 {
   /* new_window(title, width, height) */
-  u32 title, width, height;
+  val title, width, height;
   CTWindow *w;
   u32 ref;
 
@@ -379,7 +1025,7 @@ static u32 VMNewWindow(VM *vm)
   return IntVal(ref);
 }
 
-static u32 VMDestroyWindow(VM *vm)
+static val VMDestroyWindow(VM *vm)
 {
   CTWindow *w;
   assert(StackSize() >= 1);
@@ -392,7 +1038,7 @@ static u32 VMDestroyWindow(VM *vm)
   return 0;
 }
 
-static u32 VMUpdateWindow(VM *vm)
+static val VMUpdateWindow(VM *vm)
 {
   CTWindow *w;
   assert(StackSize() >= 1);
@@ -402,7 +1048,7 @@ static u32 VMUpdateWindow(VM *vm)
   return 0;
 }
 
-static u32 EventTypeVal(u32 id)
+static val EventTypeVal(u32 id)
 {
   switch (id) {
   case mouseDown: return IntVal(Symbol("mouseDown"));
@@ -415,10 +1061,10 @@ static u32 EventTypeVal(u32 id)
   }
 }
 
-static u32 VMPollEvent(VM *vm)
+static val VMPollEvent(VM *vm)
 {
   Event event;
-  u32 where, msg;
+  val where, msg;
 
   NextEvent(&event);
 
@@ -448,11 +1094,11 @@ static u32 VMPollEvent(VM *vm)
   return StackPop();
 }
 
-static u32 VMWritePixel(VM *vm)
+static val VMWritePixel(VM *vm)
 {
   /* write_pixel(x, y, color, window) */
   CTWindow *w;
-  u32 x, y, color;
+  val x, y, color;
   assert(StackSize() >= 4);
   w = VMGetRef(RawVal(StackPop()), vm);
   color = StackPop();
@@ -469,10 +1115,10 @@ static u32 VMWritePixel(VM *vm)
   return 0;
 }
 
-static u32 VMMoveTo(VM *vm)
+static val VMMoveTo(VM *vm)
 {
   CTWindow *w;
-  u32 x, y;
+  val x, y;
   assert(StackSize() >= 3);
   w = VMGetRef(RawVal(StackPop()), vm);
   y = StackPop();
@@ -486,10 +1132,10 @@ static u32 VMMoveTo(VM *vm)
   return 0;
 }
 
-static u32 VMMove(VM *vm)
+static val VMMove(VM *vm)
 {
   CTWindow *w;
-  u32 x, y;
+  val x, y;
   assert(StackSize() >= 3);
   w = VMGetRef(RawVal(StackPop()), vm);
   y = StackPop();
@@ -503,10 +1149,10 @@ static u32 VMMove(VM *vm)
   return 0;
 }
 
-static u32 VMSetColor(VM *vm)
+static val VMSetColor(VM *vm)
 {
   CTWindow *w;
-  u32 color;
+  val color;
   assert(StackSize() >= 2);
   w = VMGetRef(RawVal(StackPop()), vm);
   color = StackPop();
@@ -518,10 +1164,10 @@ static u32 VMSetColor(VM *vm)
   return 0;
 }
 
-static u32 VMSetFont(VM *vm)
+static val VMSetFont(VM *vm)
 {
   CTWindow *w;
-  u32 name, size;
+  val name, size;
   char *name_str;
   assert(StackSize() >= 3);
   w = VMGetRef(RawVal(StackPop()), vm);
@@ -537,10 +1183,10 @@ static u32 VMSetFont(VM *vm)
   return 0;
 }
 
-static u32 VMDrawString(VM *vm)
+static val VMDrawString(VM *vm)
 {
   CTWindow *w;
-  u32 text;
+  val text;
   char *str;
   assert(StackSize() >= 2);
   w = VMGetRef(RawVal(StackPop()), vm);
@@ -554,10 +1200,10 @@ static u32 VMDrawString(VM *vm)
   return 0;
 }
 
-static u32 VMStringWidth(VM *vm)
+static val VMStringWidth(VM *vm)
 {
   CTWindow *w;
-  u32 text, width;
+  val text, width;
   char *str;
   assert(StackSize() >= 2);
   w = VMGetRef(RawVal(StackPop()), vm);
@@ -571,10 +1217,10 @@ static u32 VMStringWidth(VM *vm)
   return width;
 }
 
-static u32 VMLineTo(VM *vm)
+static val VMLineTo(VM *vm)
 {
   CTWindow *w;
-  u32 x, y;
+  val x, y;
   assert(StackSize() >= 3);
   w = VMGetRef(RawVal(StackPop()), vm);
   y = StackPop();
@@ -588,10 +1234,10 @@ static u32 VMLineTo(VM *vm)
   return 0;
 }
 
-static u32 VMLine(VM *vm)
+static val VMLine(VM *vm)
 {
   CTWindow *w;
-  u32 x, y;
+  val x, y;
   assert(StackSize() >= 3);
   w = VMGetRef(RawVal(StackPop()), vm);
   y = StackPop();
@@ -605,10 +1251,10 @@ static u32 VMLine(VM *vm)
   return 0;
 }
 
-static u32 VMFillRect(VM *vm)
+static val VMFillRect(VM *vm)
 {
   CTWindow *w;
-  u32 x0, y0, x1, y1, color;
+  val x0, y0, x1, y1, color;
   Rect r;
 
   assert(StackSize() >= 5);
@@ -635,11 +1281,11 @@ static u32 VMFillRect(VM *vm)
   return 0;
 }
 
-static u32 VMBlit(VM *vm)
+static val VMBlit(VM *vm)
 {
   /* blit(data, width, height, x, y, window) */
   CTWindow *w;
-  i32 data, width, height, x, y;
+  val data, width, height, x, y;
   u32 *pixels;
   assert(StackSize() >= 6);
   w = VMGetRef(RawVal(StackPop()), vm);
@@ -664,9 +1310,9 @@ static u32 VMBlit(VM *vm)
   return 0;
 }
 
-static u32 VMUseResources(VM *vm)
+static val VMUseResources(VM *vm)
 {
-  u32 res;
+  val res;
   char *filename;
   assert(StackSize() >= 1);
   res = StackPop();
@@ -677,10 +1323,10 @@ static u32 VMUseResources(VM *vm)
   return 0;
 }
 
-static u32 VMGetPen(VM *vm)
+static val VMGetPen(VM *vm)
 {
   CTWindow *w;
-  u32 canvas;
+  val canvas;
   assert(StackSize() >= 1);
   w = VMGetRef(RawVal(StackPeek(0)), vm);
   if (!w) return RuntimeError("Invalid window reference", vm);
@@ -691,10 +1337,10 @@ static u32 VMGetPen(VM *vm)
   return canvas;
 }
 
-static u32 VMGetFont(VM *vm)
+static val VMGetFont(VM *vm)
 {
   CTWindow *w;
-  u32 font_info;
+  val font_info;
   FontInfo info;
   assert(StackSize() >= 1);
   w = VMGetRef(RawVal(StackPeek(0)), vm);
@@ -713,9 +1359,12 @@ static PrimDef primitives[] = {
   {"panic!", VMPanic},
   {"typeof", VMTypeOf},
   {"format", VMFormat},
+  {"iolist_size", VMIOListSize},
   {"make_tuple", VMMakeTuple},
+  {"tuple_to_list", VMTupleToList},
   {"symbol_name", VMSymbolName},
   {"hash", VMHash},
+  {"compare", VMCompare},
   {"popcount", VMPopCount},
   {"max_int", VMMaxInt},
   {"min_int", VMMinInt},
@@ -727,6 +1376,53 @@ static PrimDef primitives[] = {
   {"args", VMArgs},
   {"env", VMEnv},
   {"shell", VMShell},
+  {"gc_step", VMGCStep},
+  /* Lists */
+  {"list_length", VMListLength},
+  {"list_reverse", VMListReverse},
+  {"list_nth", VMListNth},
+  {"list_member?", VMListMember},
+  {"list_append", VMListAppend},
+  {"list_take", VMListTake},
+  {"list_drop", VMListDrop},
+  {"list_flatten", VMListFlatten},
+  /* Sorting */
+  {"sort", VMSort},
+  {"sort_with", VMSortWith},
+  {"sort_by_key", VMSortByKey},
+  /* Vectors */
+  {"vector_new", VMVectorNew},
+  {"vector_count", VMVectorCount},
+  {"vector_get", VMVectorGet},
+  {"vector_set", VMVectorSet},
+  {"vector_push", VMVectorPush},
+  {"vector_pop", VMVectorPop},
+  {"vector_concat", VMVectorConcat},
+  {"vector_slice", VMVectorSlice},
+  {"vector_to_list", VMVectorToList},
+  {"vector_transient", VMVectorTransient},
+  {"vector_push!", VMTransientPush},
+  {"vector_set!", VMTransientSet},
+  {"vector_pop!", VMTransientPop},
+  {"vector_persist", VMPersistVector},
+  /* Maps */
+  {"map_new", VMMapNew},
+  {"map_count", VMMapCount},
+  {"map_get", VMMapGet},
+  {"map_contains?", VMMapContains},
+  {"map_put", VMMapPut},
+  {"map_delete", VMMapDelete},
+  {"map_entries", VMMapEntries},
+  /* Builders */
+  {"builder_new", VMBuilderNew},
+  {"builder_set!", VMBuilderSet},
+  {"builder_freeze", VMBuilderFreeze},
+  /* Buffers */
+  {"buffer_new", VMBufferNew},
+  {"buffer_length", VMBufferLength},
+  {"buffer_write", VMBufferWrite},
+  {"buffer_write_int", VMBufferWriteInt},
+  {"buffer_finish", VMBufferFinish},
   /* I/O */
   {"open", VMOpen},
   {"open_serial", VMOpenSerial},
@@ -758,6 +1454,11 @@ static PrimDef primitives[] = {
   {"font_info", VMGetFont}
 };
 
+u32 NumPrimitives(void)
+{
+  return ArrayCount(primitives);
+}
+
 i32 PrimitiveID(u32 name)
 {
   u32 i;
@@ -0,0 +1,210 @@
+#include "runtime/profile.h"
+#include "runtime/mem.h"
+#include "univ/file.h"
+#include "univ/hashmap.h"
+#include "univ/str.h"
+#include "univ/vec.h"
+
+#define REPORT_LINES 20
+
+typedef struct {
+  u32 site;
+  u32 index;
+  u32 weight;
+  bool survived;
+} HeapSample;
+
+typedef struct {
+  u32 site;
+  u32 samples;
+  u64 allocated;
+  u64 survived;
+  u64 retained;
+  char *file;
+  u32 pos;
+} SiteStats;
+
+static struct {
+  u32 *pc;
+  u32 interval;
+  i64 countdown;
+  HeapSample *samples; /* vec */
+  SiteStats *sites; /* vec */
+  HashMap site_map;
+} profile = {0, 0, 0, 0, 0, EmptyHashMap};
+
+void StartHeapProfile(u32 interval, u32 *pc)
+{
+  StopHeapProfile();
+  profile.pc = pc;
+  profile.interval = Max(1, interval);
+  profile.countdown = profile.interval;
+  SetMemProfile(true);
+}
+
+void StopHeapProfile(void)
+{
+  SetMemProfile(false);
+  FreeVec(profile.samples);
+  FreeVec(profile.sites);
+  DestroyHashMap(&profile.site_map);
+  profile.samples = 0;
+  profile.sites = 0;
+  profile.pc = 0;
+}
+
+static SiteStats *GetSite(u32 site)
+{
+  SiteStats *stats;
+  if (HashMapContains(&profile.site_map, site)) {
+    return &profile.sites[HashMapGet(&profile.site_map, site)];
+  }
+  HashMapSet(&profile.site_map, site, VecCount(profile.sites));
+  GrowVec(profile.sites, 1);
+  stats = &profile.sites[VecCount(profile.sites) - 1];
+  stats->site = site;
+  stats->samples = 0;
+  stats->allocated = 0;
+  stats->survived = 0;
+  stats->retained = 0;
+  stats->file = 0;
+  stats->pos = 0;
+  return stats;
+}
+
+void ProfileAlloc(u32 index, u32 cells)
+{
+  u32 size = cells*sizeof(val);
+  HeapSample sample;
+  SiteStats *stats;
+
+  profile.countdown -= size;
+  if (profile.countdown > 0) return;
+
+  /* the sample stands in for everything allocated since the last one */
+  sample.site = profile.pc ? *profile.pc : 0;
+  sample.index = index;
+  sample.weight = profile.interval - profile.countdown;
+  sample.survived = false;
+  profile.countdown = profile.interval;
+
+  stats = GetSite(sample.site);
+  stats->samples++;
+  stats->allocated += sample.weight;
+  stats->retained += sample.weight;
+  VecPush(profile.samples, sample);
+}
+
+void ProfileCollection(u32 start, u32 end, u32 (*relocate)(u32 index))
+{
+  u32 i, live = 0;
+
+  for (i = 0; i < VecCount(profile.samples); i++) {
+    HeapSample sample = profile.samples[i];
+    SiteStats *stats = GetSite(sample.site);
+
+    /* samples outside the collected range were allocated during the collection */
+    if (sample.index >= start && sample.index < end) {
+      u32 index = relocate(sample.index);
+      if (!index) {
+        stats->retained -= sample.weight;
+        continue;
+      }
+      sample.index = index;
+      if (!sample.survived) stats->survived += sample.weight;
+      sample.survived = true;
+    }
+    profile.samples[live++] = sample;
+  }
+  VecTrunc(profile.samples, live);
+}
+
+static int CompareLocation(const void *a, const void *b)
+{
+  const SiteStats *sa = a, *sb = b;
+  if (sa->file != sb->file) return sa->file < sb->file ? -1 : 1;
+  if (sa->pos != sb->pos) return sa->pos < sb->pos ? -1 : 1;
+  return 0;
+}
+
+static int CompareAllocated(const void *a, const void *b)
+{
+  const SiteStats *sa = a, *sb = b;
+  if (sa->allocated != sb->allocated) return sa->allocated > sb->allocated ? -1 : 1;
+  return CompareLocation(a, b);
+}
+
+static int CompareRetained(const void *a, const void *b)
+{
+  const SiteStats *sa = a, *sb = b;
+  if (sa->retained != sb->retained) return sa->retained > sb->retained ? -1 : 1;
+  return CompareAllocated(a, b);
+}
+
+static void PrintLocation(SiteStats *stats)
+{
+  char *text;
+  if (!stats->file) {
+    fprintf(stderr, "(system)@%d\n", stats->site);
+    return;
+  }
+  text = ReadTextFile(stats->file);
+  if (text) {
+    fprintf(stderr, "%s:%d:%d\n", stats->file, LineNum(text, stats->pos)+1,
+        ColNum(text, stats->pos)+1);
+    free(text);
+  } else {
+    fprintf(stderr, "%s@%d\n", stats->file, stats->pos);
+  }
+}
+
+static void PrintRanking(char *title, SiteStats *locations, u32 count, bool retained)
+{
+  u32 i;
+  fprintf(stderr, "%s\n", title);
+  fprintf(stderr, "  %12s %12s %12s  %s\n", "allocated", "survived", "retained", "location");
+  for (i = 0; i < count && i < REPORT_LINES; i++) {
+    SiteStats *stats = &locations[i];
+    if (retained && stats->retained == 0) break;
+    fprintf(stderr, "  %12lu %12lu %12lu  ", (unsigned long)stats->allocated,
+        (unsigned long)stats->survived, (unsigned long)stats->retained);
+    PrintLocation(stats);
+  }
+}
+
+void PrintHeapProfile(SourceMap *srcmap)
+{
+  SiteStats *sites = 0;
+  u32 i, count = 0;
+
+  fprintf(stderr, "Heap profile (sampled every %d bytes)\n", profile.interval);
+  if (VecCount(profile.sites) == 0) {
+    fprintf(stderr, "  No allocations sampled\n");
+    return;
+  }
+
+  /* group sites by source location; code without a source file is kept by address */
+  GrowVec(sites, VecCount(profile.sites));
+  for (i = 0; i < VecCount(profile.sites); i++) {
+    sites[i] = profile.sites[i];
+    sites[i].file = GetSourceFile(sites[i].site, srcmap);
+    sites[i].pos = sites[i].file ? GetSourcePos(sites[i].site, srcmap) : sites[i].site;
+  }
+  qsort(sites, VecCount(sites), sizeof(SiteStats), CompareLocation);
+  for (i = 0; i < VecCount(sites); i++) {
+    if (count > 0 && CompareLocation(&sites[count-1], &sites[i]) == 0) {
+      sites[count-1].samples += sites[i].samples;
+      sites[count-1].allocated += sites[i].allocated;
+      sites[count-1].survived += sites[i].survived;
+      sites[count-1].retained += sites[i].retained;
+    } else {
+      sites[count++] = sites[i];
+    }
+  }
+
+  qsort(sites, count, sizeof(SiteStats), CompareAllocated);
+  PrintRanking("By bytes allocated:", sites, count, false);
+  qsort(sites, count, sizeof(SiteStats), CompareRetained);
+  PrintRanking("By bytes retained:", sites, count, true);
+  FreeVec(sites);
+}
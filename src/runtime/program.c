@@ -13,6 +13,7 @@ Program *NewProgram(void)
   program->code = 0;
   InitSourceMap(&program->srcmap);
   program->strings = 0;
+  program->entry = 0;
   return program;
 }
 
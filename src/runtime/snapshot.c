@@ -0,0 +1,188 @@
+#include "runtime/snapshot.h"
+#include "runtime/mem.h"
+#include "runtime/symbol.h"
+#include "univ/file.h"
+#include "univ/iff.h"
+#include "univ/math.h"
+#include "univ/str.h"
+#include "univ/vec.h"
+
+#define SNAPSHOT_ORDER 0x01020304
+
+typedef struct {
+  u32 order;
+  u32 val_bits;
+  u32 pc;
+  u32 link;
+  val regs[8];
+} SnapshotRegs;
+
+static IFFChunk *AppendField(IFFChunk *form, u32 type, void *data, u32 size)
+{
+  IFFChunk *chunk = NewIFFChunk(type, data, size);
+  form = IFFAppendChunk(form, chunk);
+  free(chunk);
+  return form;
+}
+
+Error *WriteSnapshot(VM *vm, char *filename)
+{
+  IFFChunk *form;
+  SnapshotRegs regs;
+  u32 version[2];
+  val *heap, *stack = 0;
+  u32 *table, *cdr;
+  u32 i, count;
+  char *names;
+  i32 written;
+
+  if (VecCount(vm->refs) > 0) {
+    return NewError("Can't snapshot a program with open references", filename, -1, 0);
+  }
+
+  heap = HeapImage(&count, &cdr);
+
+  version[0] = ByteSwap(VERSION_MAJOR);
+  version[1] = ByteSwap(VERSION_MINOR);
+  regs.order = SNAPSHOT_ORDER;
+  regs.val_bits = valBits;
+  regs.pc = vm->pc;
+  regs.link = vm->link;
+  for (i = 0; i < ArrayCount(regs.regs); i++) regs.regs[i] = vm->regs[i];
+
+  form = NewIFFForm('SNAP');
+  form = AppendField(form, 'VERS', version, sizeof(version));
+  form = AppendField(form, 'REGS', &regs, sizeof(regs));
+  form = AppendField(form, 'CODE', vm->program->code, VecCount(vm->program->code));
+  names = SymbolNames(&i);
+  form = AppendField(form, 'NAME', names, i);
+  table = SymbolTable();
+  form = AppendField(form, 'SYMS', table, VecCount(table)*sizeof(u32));
+  FreeVec(table);
+  for (i = 0; i < StackSize(); i++) VecPush(stack, StackPeek(StackSize() - 1 - i));
+  form = AppendField(form, 'STAK', stack, VecCount(stack)*sizeof(val));
+  FreeVec(stack);
+  form = AppendField(form, 'HEAP', heap, count*sizeof(val));
+  form = AppendField(form, 'CDRS', cdr, ((count + 31)/32)*sizeof(u32));
+  form = AppendField(form, 'FMAP', vm->program->srcmap.file_map,
+                     VecCount(vm->program->srcmap.file_map)*sizeof(u32));
+  form = AppendField(form, 'PMAP', vm->program->srcmap.pos_map,
+                     VecCount(vm->program->srcmap.pos_map)*sizeof(u32));
+
+  written = WriteFile(form, IFFChunkSize(form), filename);
+  count = IFFChunkSize(form);
+  free(form);
+  if (written < 0 || (u32)written != count) {
+    return NewError("Couldn't write file", filename, -1, 0);
+  }
+  return 0;
+}
+
+static Error *BadSnapshotFile(char *filename)
+{
+  return NewError("Corrupt snapshot file", filename, -1, 0);
+}
+
+/* Fields of a snapshot, in order, and the unit each field's size must be a multiple of */
+static u32 fieldTypes[] = {'VERS', 'REGS', 'CODE', 'NAME', 'SYMS', 'STAK', 'HEAP', 'CDRS', 'FMAP',
+                           'PMAP'};
+static u32 fieldUnits[] = {2*sizeof(u32), sizeof(SnapshotRegs), 1, 1, 2*sizeof(u32), sizeof(val),
+                           sizeof(val), sizeof(u32), 2*sizeof(u32), 2*sizeof(u32)};
+enum {versField, regsField, codeField, nameField, symsField, stakField, heapField, cdrsField,
+      fmapField, pmapField, numFields};
+
+Error *ReadSnapshot(char *filename, VM *vm, Opts *opts)
+{
+  IFFChunk *form, *fields[numFields];
+  SnapshotRegs regs;
+  u32 version[2];
+  u32 *table = 0, *cdr = 0;
+  val *stack = 0;
+  u32 file_size, size, i, end;
+  Program *program;
+
+  form = MapFile(filename, &file_size);
+  if (!form) return NewError("Couldn't read file", filename, -1, 0);
+
+  if (file_size < 12 || IFFChunkSize(form) > file_size || IFFFormType(form) != 'SNAP') {
+    UnmapFile(form, file_size);
+    return BadSnapshotFile(filename);
+  }
+
+  /* make sure every field is present and lies within the form before reading any of them */
+  end = IFFChunkSize(form);
+  for (i = 0; i < numFields; i++) {
+    u32 offset;
+    fields[i] = IFFGetField(form, i);
+    if (!fields[i]) break;
+    offset = (u8*)fields[i] - (u8*)form;
+    if (offset + 8 > end || offset + IFFChunkSize(fields[i]) > end) break;
+    if (IFFChunkType(fields[i]) != fieldTypes[i]) break;
+    if (IFFDataSize(fields[i]) % fieldUnits[i] != 0) break;
+  }
+  if (i < numFields || IFFDataSize(fields[versField]) != sizeof(version)
+      || IFFDataSize(fields[regsField]) != sizeof(regs)
+      || IFFDataSize(fields[heapField]) < 2*sizeof(val)
+      || IFFDataSize(fields[cdrsField]) !=
+         ((IFFDataSize(fields[heapField])/sizeof(val) + 31)/32)*sizeof(u32)) {
+    UnmapFile(form, file_size);
+    return BadSnapshotFile(filename);
+  }
+
+  Copy(IFFData(fields[versField]), version, sizeof(version));
+  Copy(IFFData(fields[regsField]), &regs, sizeof(regs));
+  if (ByteSwap(version[0]) != VERSION_MAJOR || ByteSwap(version[1]) > VERSION_MINOR ||
+      regs.order != SNAPSHOT_ORDER || regs.val_bits != valBits) {
+    UnmapFile(form, file_size);
+    return NewError("Unsupported snapshot", filename, -1, 0);
+  }
+
+  program = NewProgram();
+  size = IFFDataSize(fields[codeField]);
+  if (size > 0) {
+    GrowVec(program->code, size);
+    Copy(IFFData(fields[codeField]), program->code, size);
+  }
+  program->entry = regs.pc;
+  size = IFFDataSize(fields[fmapField]);
+  if (size > 0) {
+    GrowVec(program->srcmap.file_map, size/sizeof(u32));
+    Copy(IFFData(fields[fmapField]), program->srcmap.file_map, size);
+  }
+  size = IFFDataSize(fields[pmapField]);
+  if (size > 0) {
+    GrowVec(program->srcmap.pos_map, size/sizeof(u32));
+    Copy(IFFData(fields[pmapField]), program->srcmap.pos_map, size);
+  }
+
+  InitVM(vm, program, opts);
+  vm->pc = regs.pc;
+  vm->link = regs.link;
+  for (i = 0; i < ArrayCount(regs.regs); i++) vm->regs[i] = regs.regs[i];
+
+  /* the symbol table, stack, and cdr bitmap are copied to aligned memory; the heap is copied by
+   * LoadHeapImage */
+  size = IFFDataSize(fields[symsField]);
+  if (size > 0) {
+    GrowVec(table, size/sizeof(u32));
+    Copy(IFFData(fields[symsField]), table, size);
+  }
+  LoadSymbols(IFFData(fields[nameField]), IFFDataSize(fields[nameField]), table, VecCount(table));
+  FreeVec(table);
+
+  size = IFFDataSize(fields[stakField]);
+  if (size > 0) {
+    GrowVec(stack, size/sizeof(val));
+    Copy(IFFData(fields[stakField]), stack, size);
+  }
+  size = IFFDataSize(fields[cdrsField]);
+  GrowVec(cdr, size/sizeof(u32));
+  Copy(IFFData(fields[cdrsField]), cdr, size);
+  LoadHeapImage(IFFData(fields[heapField]), IFFDataSize(fields[heapField])/sizeof(val), cdr, stack,
+                VecCount(stack));
+  FreeVec(stack);
+  FreeVec(cdr);
+
+  UnmapFile(form, file_size);
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include "runtime/sort.h"
+#include "runtime/symbol.h"
+#include "univ/str.h"
+
+enum {sortDefault, sortWith, sortByKey};
+
+/* Stack positions are counted from the bottom, since calls push and pop above them */
+#define StackAt(index)  StackPeek(StackSize() - 1 - (index))
+
+typedef struct {
+  u32 keys; /* stack position of a tuple of the sort keys */
+  u32 less; /* stack position of the comparison function */
+  bool with_fn;
+  VM *vm;
+} SortState;
+
+static bool Less(u32 a, u32 b, SortState *state)
+{
+  val keys = StackAt(state->keys);
+  if (!state->with_fn) return CompareVal(TupleGet(keys, a), TupleGet(keys, b)) < 0;
+  if (state->vm->error) return false;
+  StackPush(TupleGet(keys, a));
+  StackPush(TupleGet(keys, b));
+  return RawVal(VMCall(StackAt(state->less), 2, state->vm)) != 0;
+}
+
+/* Merges each half in turn, skipping the merge when the halves are already in order */
+static void MergeSort(u32 *order, u32 *scratch, u32 count, SortState *state)
+{
+  u32 mid = count/2, i = 0, j = mid, k = 0;
+  if (count < 2) return;
+  MergeSort(order, scratch, mid, state);
+  MergeSort(order + mid, scratch, count - mid, state);
+  if (!Less(order[mid], order[mid - 1], state)) return;
+
+  while (i < mid && j < count) {
+    if (Less(order[j], order[i], state)) {
+      scratch[k++] = order[j++];
+    } else {
+      scratch[k++] = order[i++];
+    }
+  }
+  while (i < mid) scratch[k++] = order[i++];
+  /* any items left on the right are already in place */
+  Copy(scratch, order, k*sizeof(u32));
+}
+
+typedef struct {
+  u64 key;
+  u32 index;
+} RadixItem;
+
+/*
+ * Sorts by each byte of the keys, least significant first, skipping bytes that are all the same.
+ * Each pass moves the items between the two arrays, so this returns the one that ends up sorted.
+ */
+static RadixItem *RadixSort(RadixItem *items, RadixItem *scratch, u32 count)
+{
+  u32 counts[256], shift, i;
+  RadixItem *tmp;
+  for (shift = 0; shift < 64; shift += 8) {
+    u32 pos = 0;
+    for (i = 0; i < 256; i++) counts[i] = 0;
+    for (i = 0; i < count; i++) counts[(items[i].key >> shift) & 0xFF]++;
+    if (counts[(items[0].key >> shift) & 0xFF] == count) continue;
+    for (i = 0; i < 256; i++) {
+      u32 n = counts[i];
+      counts[i] = pos;
+      pos += n;
+    }
+    for (i = 0; i < count; i++) scratch[counts[(items[i].key >> shift) & 0xFF]++] = items[i];
+    tmp = items;
+    items = scratch;
+    scratch = tmp;
+  }
+  return items;
+}
+
+static bool IsPlainInt(val value)
+{
+  return IsInt(value) && !IsSymbol(value);
+}
+
+/* Fills order with the sorted indexes of the keys */
+static void SortOrder(u32 *order, u32 count, SortState *state)
+{
+  val keys = StackAt(state->keys);
+  u32 i;
+
+  for (i = 0; i < count; i++) order[i] = i;
+  if (count < 2) return;
+
+  if (!state->with_fn) {
+    for (i = 0; i < count && IsPlainInt(TupleGet(keys, i)); i++);
+    if (i == count) {
+      RadixItem *items = malloc(2*count*sizeof(RadixItem)), *sorted;
+      /* flipping the sign bit orders negative integers first */
+      for (i = 0; i < count; i++) {
+        items[i].key = (u64)(i64)RawInt(TupleGet(keys, i)) ^ ((u64)1 << 63);
+        items[i].index = i;
+      }
+      sorted = RadixSort(items, items + count, count);
+      for (i = 0; i < count; i++) order[i] = sorted[i].index;
+      free(items);
+      return;
+    }
+  }
+
+  {
+    u32 *scratch = malloc(count*sizeof(u32));
+    MergeSort(order, scratch, count, state);
+    free(scratch);
+  }
+}
+
+static val SortItems(val items, val fn, u32 mode, VM *vm)
+{
+  bool is_list = !IsTuple(items);
+  u32 base = StackSize(), count = 0, i;
+  u32 *order;
+  SortState state;
+  val result;
+
+  if (is_list) {
+    val list;
+    for (list = items; list; list = Tail(list)) count++;
+    StackPush(fn);
+    StackPush(items);
+    result = Tuple(count);
+    items = StackPop();
+    for (i = 0; i < count; i++, items = Tail(items)) TupleSet(result, i, Head(items));
+    StackPush(result);
+  } else {
+    count = ObjLength(items);
+    StackPush(fn);
+    StackPush(items);
+  }
+
+  state.keys = base + 1;
+  if (mode == sortByKey) {
+    StackPush(Tuple(count));
+    state.keys = base + 2;
+    for (i = 0; i < count; i++) {
+      StackPush(TupleGet(StackAt(base + 1), i));
+      result = VMCall(StackAt(base), 1, vm);
+      if (vm->error) return 0;
+      TupleSet(StackAt(base + 2), i, result);
+    }
+  }
+  state.less = base;
+  state.with_fn = mode == sortWith;
+  state.vm = vm;
+
+  order = malloc(count*sizeof(u32));
+  SortOrder(order, count, &state);
+  if (vm->error) {
+    free(order);
+    return 0;
+  }
+
+  if (is_list) {
+    ReserveMem(2*count);
+    result = 0;
+    for (i = count; i > 0; i--) result = Pair(TupleGet(StackAt(base + 1), order[i - 1]), result);
+  } else {
+    result = Tuple(count);
+    for (i = 0; i < count; i++) TupleSet(result, i, TupleGet(StackAt(base + 1), order[i]));
+  }
+  free(order);
+
+  while (StackSize() > base) StackPop();
+  return result;
+}
+
+val Sort(val items, VM *vm)
+{
+  return SortItems(items, 0, sortDefault, vm);
+}
+
+val SortWith(val items, val less, VM *vm)
+{
+  return SortItems(items, less, sortWith, vm);
+}
+
+val SortByKey(val items, val key_fn, VM *vm)
+{
+  return SortItems(items, key_fn, sortByKey, vm);
+}
@@ -3,10 +3,35 @@
 #include "univ/math.h"
 #include "univ/str.h"
 #include "univ/vec.h"
+#include <pthread.h>
+#include <string.h>
 
 static i32 symSize = 32;
 static char *names = 0; /* vec */
 static HashMap map = EmptyHashMap;
+static pthread_key_t local_key;
+static pthread_once_t local_once = PTHREAD_ONCE_INIT;
+static bool has_local_key = false;
+
+static void MakeLocalKey(void)
+{
+  has_local_key = pthread_key_create(&local_key, 0) == 0;
+}
+
+static SymbolSet *LocalSymbols(void)
+{
+  if (!has_local_key) return 0;
+  return pthread_getspecific(local_key);
+}
+
+static void AddSymbol(u32 sym, char *name, u32 len, char **names, HashMap *map)
+{
+  u32 index = VecCount(*names);
+  HashMapSet(map, sym, index);
+  GrowVec(*names, len);
+  Copy(name, *names + index, len);
+  VecPush(*names, 0);
+}
 
 u32 Symbol(char *name)
 {
@@ -17,23 +42,88 @@ u32 Symbol(char *name)
 u32 SymbolFrom(char *name, u32 len)
 {
   u32 sym = FoldHash(Hash(name, len), symSize);
-  if (!HashMapContains(&map, sym)) {
-    u32 index = VecCount(names);
-    HashMapSet(&map, sym, index);
-    GrowVec(names, len);
-    Copy(name, names + index, len);
-    VecPush(names, 0);
+  SymbolSet *local;
+  if (HashMapContains(&map, sym)) return sym;
+  local = LocalSymbols();
+  if (local) {
+    if (!HashMapContains(&local->map, sym)) AddSymbol(sym, name, len, &local->names, &local->map);
+  } else {
+    AddSymbol(sym, name, len, &names, &map);
   }
   return sym;
 }
 
 char *SymbolName(u32 sym)
 {
-  if (!HashMapContains(&map, sym)) return 0;
-  return names + HashMapGet(&map, sym);
+  SymbolSet *local;
+  if (HashMapContains(&map, sym)) return names + HashMapGet(&map, sym);
+  local = LocalSymbols();
+  if (!local || !HashMapContains(&local->map, sym)) return 0;
+  return local->names + HashMapGet(&local->map, sym);
+}
+
+void InitSymbolSet(SymbolSet *set)
+{
+  set->names = 0;
+  InitHashMap(&set->map);
+}
+
+void SetLocalSymbols(SymbolSet *set)
+{
+  pthread_once(&local_once, MakeLocalKey);
+  if (has_local_key) pthread_setspecific(local_key, set);
+}
+
+void MergeSymbols(SymbolSet *set)
+{
+  char *name = set->names;
+  char *end = set->names + VecCount(set->names);
+  while (name < end) {
+    u32 len = strlen(name);
+    SymbolFrom(name, len);
+    name += len + 1;
+  }
+  FreeVec(set->names);
+  DestroyHashMap(&set->map);
+  InitSymbolSet(set);
 }
 
 void SetSymbolSize(i32 size)
 {
   symSize = size;
 }
+
+char *SymbolNames(u32 *size)
+{
+  *size = VecCount(names);
+  return names;
+}
+
+u32 *SymbolTable(void)
+{
+  u32 *table = 0;
+  char *name = names;
+  char *end = names + VecCount(names);
+  while (name < end) {
+    u32 len = strlen(name);
+    VecPush(table, FoldHash(Hash(name, len), symSize));
+    VecPush(table, name - names);
+    name += len + 1;
+  }
+  return table;
+}
+
+void LoadSymbols(char *data, u32 size, u32 *table, u32 count)
+{
+  u32 i;
+  FreeVec(names);
+  names = 0;
+  DestroyHashMap(&map);
+  if (size > 0) {
+    GrowVec(names, size);
+    Copy(data, names, size);
+  }
+  for (i = 0; i < count; i += 2) {
+    HashMapSet(&map, table[i], table[i+1]);
+  }
+}
@@ -0,0 +1,764 @@
+#include "runtime/vector.h"
+#include "runtime/symbol.h"
+#include "univ/math.h"
+
+#define VectorBits    5
+#define VectorWidth   (1 << VectorBits)
+#define MaxExtra      2 /* nodes a level may have beyond the fewest that fit its items */
+
+/* Cells to copy a node and its size table at each level of a tree, with room to add two levels */
+#define LevelCells        (2*VectorWidth + 4)
+#define PathCells(shift)  (((shift)/VectorBits + 3)*LevelCells)
+/* Concatenation can rebuild every node of a level along its seam */
+#define ConcatCells(shift) (PathCells(shift)*(2*VectorWidth + 4))
+
+enum {vecTag, vecCount, vecShift, vecRoot, vecTail, vecTailCount};
+#define VectorFields    5
+#define TransientFields 6
+
+#define NodeEdit(n)       TupleGet(n, 0)
+#define LeafCount(n)      (ObjLength(n) - 1)
+#define LeafItem(n, i)    TupleGet(n, (i) + 1)
+#define BranchCount(n)    (ObjLength(n) - 2)
+#define BranchSizes(n)    TupleGet(n, 1)
+#define BranchChild(n, i) TupleGet(n, (i) + 2)
+#define SizeAt(sizes, i)  ((u32)RawVal(TupleGet(sizes, i)))
+#define NodeSlots(n, shift)     ((shift) ? BranchCount(n) : LeafCount(n))
+#define NodeSlot(n, shift, i)   TupleGet(n, (i) + ((shift) ? 2 : 1))
+
+#define Field(v, f)       ((u32)RawVal(TupleGet(v, f)))
+
+bool IsVector(val value)
+{
+  return IsTuple(value) && ObjLength(value) == VectorFields &&
+    TupleGet(value, vecTag) == IntVal(Symbol("Vector"));
+}
+
+bool IsTransientVector(val value)
+{
+  return IsTuple(value) && ObjLength(value) == TransientFields &&
+    TupleGet(value, vecTag) == IntVal(Symbol("TransientVector"));
+}
+
+static val MakeVector(u32 count, u32 shift, val root, val tail)
+{
+  val vector = Tuple(VectorFields);
+  TupleSet(vector, vecTag, IntVal(Symbol("Vector")));
+  TupleSet(vector, vecCount, IntVal(count));
+  TupleSet(vector, vecShift, IntVal(shift));
+  TupleSet(vector, vecRoot, root);
+  TupleSet(vector, vecTail, tail);
+  return vector;
+}
+
+static u32 TailCount(val vector)
+{
+  if (ObjLength(vector) == TransientFields) return Field(vector, vecTailCount);
+  return TupleGet(vector, vecTail) ? LeafCount(TupleGet(vector, vecTail)) : 0;
+}
+
+static val NewLeaf(u32 count, val edit)
+{
+  val leaf = Tuple(count + 1);
+  TupleSet(leaf, 0, edit);
+  return leaf;
+}
+
+static val NewBranch(u32 count, val edit)
+{
+  val branch = Tuple(count + 2);
+  TupleSet(branch, 0, edit);
+  return branch;
+}
+
+/* Copies a node (or nil) into a tuple of a new length, owned by edit */
+static val ResizeNode(val node, u32 length, val edit)
+{
+  val copy = Tuple(length);
+  u32 i, count = node ? Min(length, ObjLength(node)) : 1;
+  TupleSet(copy, 0, edit);
+  for (i = 1; i < count; i++) TupleSet(copy, i, TupleGet(node, i));
+  return copy;
+}
+
+/* Returns the node if it's owned by edit, or else a copy owned by edit */
+static val EditableNode(val node, val edit)
+{
+  if (edit && NodeEdit(node) == edit) return node;
+  return ResizeNode(node, ObjLength(node), edit);
+}
+
+/* Copies the first count-1 entries of a size table, and sets the last one */
+static val CopySizes(val sizes, u32 count, u32 last)
+{
+  val copy = Tuple(count);
+  u32 i;
+  for (i = 0; i + 1 < count; i++) TupleSet(copy, i, TupleGet(sizes, i));
+  TupleSet(copy, count - 1, IntVal(last));
+  return copy;
+}
+
+static u32 TreeSize(val node, u32 shift)
+{
+  u32 size = 0;
+  while (shift > 0) {
+    u32 last = BranchCount(node) - 1;
+    if (BranchSizes(node)) return size + SizeAt(BranchSizes(node), last);
+    size += last << shift;
+    node = BranchChild(node, last);
+    shift -= VectorBits;
+  }
+  return size + LeafCount(node);
+}
+
+/* Makes a size table for a branch that doesn't have one */
+static val RadixSizes(val node, u32 shift)
+{
+  u32 i, count = BranchCount(node);
+  val sizes = Tuple(count);
+  for (i = 0; i + 1 < count; i++) TupleSet(sizes, i, IntVal((i + 1) << shift));
+  TupleSet(sizes, count - 1, IntVal(TreeSize(node, shift)));
+  return sizes;
+}
+
+/* Returns the slot of a branch's child that holds an index, and makes the index relative to it.
+ * A child holds at most 1 << shift items, so the radix slot is never past the right one. */
+static u32 ChildIndex(val node, u32 shift, u32 *index)
+{
+  val sizes = BranchSizes(node);
+  u32 slot = *index >> shift;
+  if (!sizes) {
+    *index -= slot << shift;
+    return slot;
+  }
+  while (SizeAt(sizes, slot) <= *index) slot++;
+  if (slot > 0) *index -= SizeAt(sizes, slot - 1);
+  return slot;
+}
+
+/* Makes a branch of children, with a size table unless every child but the last is full */
+static val Branch(val *children, u32 count, u32 child_shift, val edit)
+{
+  val node = NewBranch(count, edit);
+  u32 i, sizes[VectorWidth];
+  bool balanced = true;
+
+  for (i = 0; i < count; i++) {
+    TupleSet(node, i + 2, children[i]);
+    sizes[i] = TreeSize(children[i], child_shift);
+    if (i + 1 < count && sizes[i] != (u32)1 << (child_shift + VectorBits)) balanced = false;
+    if (i > 0) sizes[i] += sizes[i - 1];
+  }
+  if (!balanced) {
+    val table = Tuple(count);
+    for (i = 0; i < count; i++) TupleSet(table, i, IntVal(sizes[i]));
+    TupleSet(node, 1, table);
+  }
+  return node;
+}
+
+/* Wraps a node in single-child branches up to a shift */
+static val NewPath(val node, u32 node_shift, u32 shift, val edit)
+{
+  for (; node_shift < shift; node_shift += VectorBits) {
+    val parent = NewBranch(1, edit);
+    TupleSet(parent, 2, node);
+    node = parent;
+  }
+  return node;
+}
+
+/* Collapses branches with one child at the top of a tree */
+static val Collapse(val root, u32 *shift)
+{
+  while (*shift > 0 && BranchCount(root) == 1) {
+    root = BranchChild(root, 0);
+    *shift -= VectorBits;
+  }
+  if (!root) *shift = 0;
+  return root;
+}
+
+static val SetNode(val node, u32 shift, u32 index, val value, val edit)
+{
+  node = EditableNode(node, edit);
+  if (shift == 0) {
+    TupleSet(node, index + 1, value);
+  } else {
+    u32 slot = ChildIndex(node, shift, &index);
+    val child = SetNode(BranchChild(node, slot), shift - VectorBits, index, value, edit);
+    TupleSet(node, slot + 2, child);
+  }
+  return node;
+}
+
+/* Appends a leaf to the rightmost path of a branch, or returns nil if there's no room */
+static val PushLeaf(val node, u32 shift, val leaf, val edit)
+{
+  u32 count = BranchCount(node);
+  val sizes = BranchSizes(node);
+  val child = 0;
+
+  if (shift > VectorBits) {
+    child = PushLeaf(BranchChild(node, count - 1), shift - VectorBits, leaf, edit);
+  }
+  if (child) {
+    node = EditableNode(node, edit);
+    TupleSet(node, count + 1, child);
+    if (sizes) {
+      TupleSet(node, 1, CopySizes(sizes, count, SizeAt(sizes, count - 1) + LeafCount(leaf)));
+    }
+    return node;
+  }
+
+  if (count == VectorWidth) return 0;
+  /* a branch without a size table can only grow past a full child */
+  if (!sizes && TreeSize(BranchChild(node, count - 1), shift - VectorBits) != (u32)1 << shift) {
+    sizes = RadixSizes(node, shift);
+  }
+  child = NewPath(leaf, 0, shift - VectorBits, edit);
+  node = ResizeNode(node, count + 3, edit);
+  TupleSet(node, count + 2, child);
+  if (sizes) {
+    TupleSet(node, 1, CopySizes(sizes, count + 1, SizeAt(sizes, count - 1) + LeafCount(leaf)));
+  }
+  return node;
+}
+
+/* Appends a leaf to a tree, adding a level if the tree is full */
+static val AppendLeaf(val root, u32 *shift, val leaf, val edit)
+{
+  val node, children[2];
+  if (!root) {
+    *shift = 0;
+    return leaf;
+  }
+  if (*shift > 0) {
+    node = PushLeaf(root, *shift, leaf, edit);
+    if (node) return node;
+  }
+  children[0] = root;
+  children[1] = NewPath(leaf, 0, *shift, edit);
+  node = Branch(children, 2, *shift, edit);
+  *shift += VectorBits;
+  return node;
+}
+
+/* Removes the last leaf of a tree into *leaf; returns the rest of the tree, or nil if it's empty */
+static val PopLeaf(val node, u32 shift, val *leaf, val edit)
+{
+  u32 count;
+  val child, sizes;
+
+  if (shift == 0) {
+    *leaf = node;
+    return 0;
+  }
+
+  count = BranchCount(node);
+  sizes = BranchSizes(node);
+  child = PopLeaf(BranchChild(node, count - 1), shift - VectorBits, leaf, edit);
+  if (child) {
+    node = EditableNode(node, edit);
+    TupleSet(node, count + 1, child);
+    if (sizes) {
+      TupleSet(node, 1, CopySizes(sizes, count, SizeAt(sizes, count - 1) - LeafCount(*leaf)));
+    }
+    return node;
+  }
+
+  if (count == 1) return 0;
+  node = ResizeNode(node, count + 1, edit);
+  if (sizes) TupleSet(node, 1, CopySizes(sizes, count - 1, SizeAt(sizes, count - 2)));
+  return node;
+}
+
+val NewVector(void)
+{
+  return MakeVector(0, 0, 0, 0);
+}
+
+u32 VectorCount(val vector)
+{
+  return Field(vector, vecCount);
+}
+
+val VectorGet(val vector, u32 index)
+{
+  u32 shift = Field(vector, vecShift);
+  u32 tree_count = VectorCount(vector) - TailCount(vector);
+  val node = TupleGet(vector, vecRoot);
+
+  if (index >= tree_count) return LeafItem(TupleGet(vector, vecTail), index - tree_count);
+  while (shift > 0) {
+    node = BranchChild(node, ChildIndex(node, shift, &index));
+    shift -= VectorBits;
+  }
+  return LeafItem(node, index);
+}
+
+val VectorSet(val vector, u32 index, val value)
+{
+  u32 count, shift, tree_count;
+  val root, tail;
+
+  StackPush(value);
+  StackPush(vector);
+  ReserveMem(PathCells(Field(vector, vecShift)));
+  vector = StackPop();
+  value = StackPop();
+
+  count = VectorCount(vector);
+  shift = Field(vector, vecShift);
+  root = TupleGet(vector, vecRoot);
+  tail = TupleGet(vector, vecTail);
+  tree_count = count - TailCount(vector);
+
+  if (index >= tree_count) {
+    tail = ResizeNode(tail, ObjLength(tail), 0);
+    TupleSet(tail, index - tree_count + 1, value);
+  } else {
+    root = SetNode(root, shift, index, value, 0);
+  }
+  return MakeVector(count, shift, root, tail);
+}
+
+val VectorPush(val vector, val value)
+{
+  u32 count, shift, tail_count;
+  val root, tail;
+
+  StackPush(value);
+  StackPush(vector);
+  ReserveMem(PathCells(Field(vector, vecShift)));
+  vector = StackPop();
+  value = StackPop();
+
+  count = VectorCount(vector);
+  shift = Field(vector, vecShift);
+  root = TupleGet(vector, vecRoot);
+  tail = TupleGet(vector, vecTail);
+  tail_count = TailCount(vector);
+
+  if (tail_count < VectorWidth) {
+    tail = ResizeNode(tail, tail_count + 2, 0);
+    TupleSet(tail, tail_count + 1, value);
+  } else {
+    root = AppendLeaf(root, &shift, tail, 0);
+    tail = NewLeaf(1, 0);
+    TupleSet(tail, 1, value);
+  }
+  return MakeVector(count + 1, shift, root, tail);
+}
+
+val VectorPop(val vector)
+{
+  u32 count, shift, tail_count;
+  val root, tail;
+
+  StackPush(vector);
+  ReserveMem(PathCells(Field(vector, vecShift)));
+  vector = StackPop();
+
+  count = VectorCount(vector);
+  shift = Field(vector, vecShift);
+  root = TupleGet(vector, vecRoot);
+  tail = TupleGet(vector, vecTail);
+  tail_count = TailCount(vector);
+
+  if (count <= 1) return NewVector();
+  if (tail_count > 1) {
+    tail = ResizeNode(tail, tail_count, 0);
+  } else {
+    root = PopLeaf(root, shift, &tail, 0);
+    root = Collapse(root, &shift);
+  }
+  return MakeVector(count - 1, shift, root, tail);
+}
+
+/* Plans how to spread the slots of a level's nodes over fewer nodes, if there are more than
+ * MaxExtra nodes beyond the fewest that could hold them. Nodes that are nearly full are skipped,
+ * and the slots of the first one that isn't are pushed into the nodes after it, until one of them
+ * is absorbed. Returns the new number of nodes. */
+static u32 PlanLevel(u32 *plan, u32 count)
+{
+  u32 i, j, total = 0, optimal;
+  for (i = 0; i < count; i++) total += plan[i];
+  optimal = (total + VectorWidth - 1)/VectorWidth;
+
+  i = 0;
+  while (count > optimal + MaxExtra) {
+    u32 remaining;
+    while (plan[i] >= VectorWidth - 1) i++;
+    remaining = plan[i];
+    while (remaining > 0) {
+      u32 size = Min(remaining + plan[i + 1], VectorWidth);
+      plan[i] = size;
+      remaining = remaining + plan[i + 1] - size;
+      i++;
+    }
+    for (j = i; j + 1 < count; j++) plan[j] = plan[j + 1];
+    count--;
+    i--;
+  }
+  return count;
+}
+
+/* Rebalances a level of nodes at a shift into `out`, following a plan. Nodes that don't change
+ * are reused. Returns the new number of nodes. */
+static u32 RebalanceLevel(val *nodes, u32 count, u32 shift, val *out)
+{
+  u32 plan[2*VectorWidth + 3];
+  u32 i, j, planned, src = 0, offset = 0;
+
+  for (i = 0; i < count; i++) plan[i] = NodeSlots(nodes[i], shift);
+  plan[count] = 0;
+  planned = PlanLevel(plan, count);
+
+  for (i = 0; i < planned; i++) {
+    val slots[VectorWidth];
+    if (offset == 0 && NodeSlots(nodes[src], shift) == plan[i]) {
+      out[i] = nodes[src++];
+      continue;
+    }
+    for (j = 0; j < plan[i]; j++) {
+      slots[j] = NodeSlot(nodes[src], shift, offset);
+      offset++;
+      if (offset == NodeSlots(nodes[src], shift)) {
+        src++;
+        offset = 0;
+      }
+    }
+    if (shift > 0) {
+      out[i] = Branch(slots, plan[i], shift - VectorBits, 0);
+    } else {
+      out[i] = NewLeaf(plan[i], 0);
+      for (j = 0; j < plan[i]; j++) TupleSet(out[i], j + 1, slots[j]);
+    }
+  }
+  return planned;
+}
+
+/* Concatenates two trees into a branch one level above the taller one. The trees are merged down
+ * the seam between them: the nodes along the seam are concatenated first, and then each level is
+ * rebalanced and regrouped on the way back up. */
+static val ConcatTrees(val left, u32 left_shift, val right, u32 right_shift)
+{
+  val nodes[2*VectorWidth + 2], out[2*VectorWidth + 2], groups[2];
+  u32 i, count = 0, shift = Max(left_shift, right_shift);
+  val center;
+
+  if (shift == 0) {
+    nodes[0] = left;
+    nodes[1] = right;
+    count = RebalanceLevel(nodes, 2, 0, out);
+    return Branch(out, count, 0, 0);
+  }
+
+  if (left_shift > right_shift) {
+    center = ConcatTrees(BranchChild(left, BranchCount(left) - 1), left_shift - VectorBits,
+                         right, right_shift);
+  } else if (left_shift < right_shift) {
+    center = ConcatTrees(left, left_shift,
+                         BranchChild(right, 0), right_shift - VectorBits);
+  } else {
+    center = ConcatTrees(BranchChild(left, BranchCount(left) - 1), left_shift - VectorBits,
+                         BranchChild(right, 0), right_shift - VectorBits);
+  }
+
+  /* the center is at this shift, so the children of all three are one level down */
+  if (left_shift == shift) {
+    for (i = 0; i + 1 < BranchCount(left); i++) nodes[count++] = BranchChild(left, i);
+  }
+  for (i = 0; i < BranchCount(center); i++) nodes[count++] = BranchChild(center, i);
+  if (right_shift == shift) {
+    for (i = 1; i < BranchCount(right); i++) nodes[count++] = BranchChild(right, i);
+  }
+
+  count = RebalanceLevel(nodes, count, shift - VectorBits, out);
+  groups[0] = Branch(out, Min(count, VectorWidth), shift - VectorBits, 0);
+  if (count > VectorWidth) {
+    groups[1] = Branch(out + VectorWidth, count - VectorWidth, shift - VectorBits, 0);
+  }
+  return Branch(groups, count > VectorWidth ? 2 : 1, shift, 0);
+}
+
+val VectorConcat(val left, val right)
+{
+  u32 left_shift, right_shift, shift;
+  val left_root, right_root, root;
+
+  if (VectorCount(left) == 0) return right;
+  if (VectorCount(right) == 0) return left;
+
+  StackPush(left);
+  StackPush(right);
+  ReserveMem(ConcatCells(Max(Field(left, vecShift), Field(right, vecShift)) + VectorBits));
+  right = StackPop();
+  left = StackPop();
+
+  /* the left tail goes into the left tree, and the right tail stays the tail */
+  left_shift = Field(left, vecShift);
+  left_root = AppendLeaf(TupleGet(left, vecRoot), &left_shift, TupleGet(left, vecTail), 0);
+  right_shift = Field(right, vecShift);
+  right_root = TupleGet(right, vecRoot);
+
+  if (!right_root) {
+    root = left_root;
+    shift = left_shift;
+  } else {
+    root = ConcatTrees(left_root, left_shift, right_root, right_shift);
+    shift = Max(left_shift, right_shift) + VectorBits;
+    root = Collapse(root, &shift);
+  }
+  return MakeVector(VectorCount(left) + VectorCount(right), shift, root,
+                    TupleGet(right, vecTail));
+}
+
+/* Drops the items of a tree from `end` on */
+static val SliceRight(val node, u32 shift, u32 end)
+{
+  u32 slot, index = end - 1;
+  val child, sizes;
+
+  if (shift == 0) {
+    if (end == LeafCount(node)) return node;
+    return ResizeNode(node, end + 1, 0);
+  }
+
+  slot = ChildIndex(node, shift, &index);
+  child = SliceRight(BranchChild(node, slot), shift - VectorBits, index + 1);
+  sizes = BranchSizes(node);
+  node = ResizeNode(node, slot + 3, 0);
+  TupleSet(node, slot + 2, child);
+  if (sizes) TupleSet(node, 1, CopySizes(sizes, slot + 1, end));
+  return node;
+}
+
+/* Drops the items of a tree before `start`. Since its first child is cut short, the new branch
+ * always has a size table. */
+static val SliceLeft(val node, u32 shift, u32 start)
+{
+  u32 i, slot, count, total, index = start;
+  val child, sizes, old_sizes, copy;
+
+  if (start == 0) return node;
+  if (shift == 0) {
+    copy = NewLeaf(LeafCount(node) - start, 0);
+    for (i = start; i < LeafCount(node); i++) TupleSet(copy, i - start + 1, LeafItem(node, i));
+    return copy;
+  }
+
+  slot = ChildIndex(node, shift, &index);
+  count = BranchCount(node);
+  total = TreeSize(node, shift);
+  old_sizes = BranchSizes(node);
+  child = SliceLeft(BranchChild(node, slot), shift - VectorBits, index);
+
+  copy = NewBranch(count - slot, 0);
+  sizes = Tuple(count - slot);
+  for (i = slot; i < count; i++) {
+    u32 end;
+    if (old_sizes) {
+      end = SizeAt(old_sizes, i);
+    } else {
+      end = (i + 1 == count) ? total : (i + 1) << shift;
+    }
+    TupleSet(copy, i - slot + 2, (i == slot) ? child : BranchChild(node, i));
+    TupleSet(sizes, i - slot, IntVal(end - start));
+  }
+  TupleSet(copy, 1, sizes);
+  return copy;
+}
+
+val VectorSlice(val vector, u32 start, u32 end)
+{
+  u32 i, shift, tree_count;
+  val root, tail;
+
+  end = Min(end, VectorCount(vector));
+  if (start >= end) return NewVector();
+
+  StackPush(vector);
+  ReserveMem(2*PathCells(Field(vector, vecShift)));
+  vector = StackPop();
+
+  shift = Field(vector, vecShift);
+  root = TupleGet(vector, vecRoot);
+  tail = TupleGet(vector, vecTail);
+  tree_count = VectorCount(vector) - TailCount(vector);
+
+  if (start >= tree_count) {
+    root = 0;
+    shift = 0;
+    tail = NewLeaf(end - start, 0);
+    for (i = start; i < end; i++) {
+      TupleSet(tail, i - start + 1, LeafItem(TupleGet(vector, vecTail), i - tree_count));
+    }
+  } else {
+    root = SliceRight(root, shift, Min(end, tree_count));
+    root = SliceLeft(root, shift, start);
+    root = Collapse(root, &shift);
+    if (end > tree_count) {
+      tail = ResizeNode(tail, end - tree_count + 1, 0);
+    } else {
+      /* the tail can't be empty, so it's taken from the tree */
+      root = PopLeaf(root, shift, &tail, 0);
+      root = Collapse(root, &shift);
+    }
+  }
+  return MakeVector(end - start, shift, root, tail);
+}
+
+val VectorToList(val vector)
+{
+  u32 i, count = VectorCount(vector);
+  val list = 0;
+
+  StackPush(vector);
+  ReserveMem(2*count);
+  vector = StackPop();
+
+  for (i = count; i > 0; i--) list = Pair(VectorGet(vector, i - 1), list);
+  return list;
+}
+
+val ListToVector(val list)
+{
+  val transient;
+
+  StackPush(list);
+  transient = VectorTransient(NewVector());
+  list = StackPop();
+  while (list) {
+    StackPush(Tail(list));
+    transient = TransientPush(transient, Head(list));
+    list = StackPop();
+  }
+  return PersistVector(transient);
+}
+
+val VectorTransient(val vector)
+{
+  u32 i, tail_count;
+  val transient, tail;
+
+  StackPush(vector);
+  ReserveMem(LevelCells + TransientFields + 1);
+  vector = StackPop();
+
+  tail_count = TailCount(vector);
+  transient = Tuple(TransientFields);
+  tail = NewLeaf(VectorWidth, transient);
+  for (i = 0; i < tail_count; i++) {
+    TupleSet(tail, i + 1, LeafItem(TupleGet(vector, vecTail), i));
+  }
+  TupleSet(transient, vecTag, IntVal(Symbol("TransientVector")));
+  TupleSet(transient, vecCount, TupleGet(vector, vecCount));
+  TupleSet(transient, vecShift, TupleGet(vector, vecShift));
+  TupleSet(transient, vecRoot, TupleGet(vector, vecRoot));
+  TupleSet(transient, vecTail, tail);
+  TupleSet(transient, vecTailCount, IntVal(tail_count));
+  return transient;
+}
+
+val TransientPush(val transient, val value)
+{
+  u32 shift, tail_count;
+  val root, tail;
+
+  StackPush(value);
+  StackPush(transient);
+  ReserveMem(PathCells(Field(transient, vecShift)));
+  transient = StackPop();
+  value = StackPop();
+
+  shift = Field(transient, vecShift);
+  tail = TupleGet(transient, vecTail);
+  tail_count = TailCount(transient);
+
+  if (tail_count == VectorWidth) {
+    root = AppendLeaf(TupleGet(transient, vecRoot), &shift, tail, transient);
+    tail = NewLeaf(VectorWidth, transient);
+    tail_count = 0;
+    TupleSet(transient, vecShift, IntVal(shift));
+    TupleSet(transient, vecRoot, root);
+    TupleSet(transient, vecTail, tail);
+  }
+  TupleSet(tail, tail_count + 1, value);
+  TupleSet(transient, vecTailCount, IntVal(tail_count + 1));
+  TupleSet(transient, vecCount, IntVal(VectorCount(transient) + 1));
+  return transient;
+}
+
+val TransientSet(val transient, u32 index, val value)
+{
+  u32 tree_count;
+  val root;
+
+  StackPush(value);
+  StackPush(transient);
+  ReserveMem(PathCells(Field(transient, vecShift)));
+  transient = StackPop();
+  value = StackPop();
+
+  tree_count = VectorCount(transient) - TailCount(transient);
+  if (index >= tree_count) {
+    TupleSet(TupleGet(transient, vecTail), index - tree_count + 1, value);
+  } else {
+    root = SetNode(TupleGet(transient, vecRoot), Field(transient, vecShift), index, value,
+                   transient);
+    TupleSet(transient, vecRoot, root);
+  }
+  return transient;
+}
+
+val TransientPop(val transient)
+{
+  u32 shift, count, tail_count;
+  val root, leaf, tail;
+
+  StackPush(transient);
+  ReserveMem(PathCells(Field(transient, vecShift)));
+  transient = StackPop();
+
+  count = VectorCount(transient);
+  tail_count = TailCount(transient);
+  if (count == 0) return transient;
+
+  /* when the tail runs out, the last leaf of the tree becomes the tail */
+  TupleSet(TupleGet(transient, vecTail), tail_count, 0);
+  tail_count--;
+  if (tail_count == 0 && count > 1) {
+    shift = Field(transient, vecShift);
+    root = PopLeaf(TupleGet(transient, vecRoot), shift, &leaf, transient);
+    root = Collapse(root, &shift);
+    tail = ResizeNode(leaf, VectorWidth + 1, transient);
+    tail_count = LeafCount(leaf);
+    TupleSet(transient, vecShift, IntVal(shift));
+    TupleSet(transient, vecRoot, root);
+    TupleSet(transient, vecTail, tail);
+  }
+  TupleSet(transient, vecTailCount, IntVal(tail_count));
+  TupleSet(transient, vecCount, IntVal(count - 1));
+  return transient;
+}
+
+val PersistVector(val transient)
+{
+  u32 tail_count;
+  val tail = 0, vector;
+
+  StackPush(transient);
+  ReserveMem(LevelCells + VectorFields + 1);
+  transient = StackPop();
+
+  tail_count = TailCount(transient);
+  if (tail_count > 0) tail = ResizeNode(TupleGet(transient, vecTail), tail_count + 1, 0);
+  vector = MakeVector(VectorCount(transient), Field(transient, vecShift),
+                      TupleGet(transient, vecRoot), tail);
+
+  /* the transient is retired, so nothing can change the nodes it owned */
+  TupleSet(transient, vecTag, 0);
+  return vector;
+}
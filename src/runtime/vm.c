@@ -1,6 +1,8 @@
 #include "runtime/vm.h"
 #include "runtime/mem.h"
 #include "runtime/ops.h"
+#include "runtime/profile.h"
+#include "runtime/snapshot.h"
 #include "runtime/symbol.h"
 #include "univ/math.h"
 #include "univ/str.h"
@@ -18,7 +20,7 @@ void InitVM(VM *vm, Program *program, Opts *opts)
   for (i = 0; i < ArrayCount(vm->regs); i++) vm->regs[i] = 0;
   vm->link = 0;
   vm->program = program;
-  SetSymbolSize(valBits);
+  SetSymbolSize(symBits);
   if (program) {
     char *names = program->strings;
     u32 len = VecCount(program->strings);
@@ -42,6 +44,7 @@ void VMStep(VM *vm)
 {
   if (vm->opts->debug) VMTrace(vm);
   ExecOp(vm->program->code[vm->pc], vm);
+  if (MemExhausted() && !vm->error) RuntimeError("Out of memory", vm);
 }
 
 static u32 PrintStack(VM *vm, u32 max)
@@ -76,33 +79,120 @@ static void VMTrace(VM *vm)
   fprintf(stderr, "\n");
 }
 
-Error *VMRun(Program *program, Opts *opts)
+static void RunVM(VM *vm)
 {
-  VM vm;
-
-  InitVM(&vm, program, opts);
-  InitMem(0);
-  SetMemRoots(vm.regs, ArrayCount(vm.regs));
+  if (vm->opts->heap_profile) StartHeapProfile(vm->opts->heap_profile, &vm->pc);
 
-  if (opts->debug) {
-    u32 num_width = NumDigits(VecCount(program->code), 10);
+  if (vm->opts->debug) {
+    u32 num_width = NumDigits(VecCount(vm->program->code), 10);
     u32 i;
     for (i = 0; i < num_width; i++) fprintf(stderr, "─");
     fprintf(stderr, "┬─inst─────────stack───────────────\n");
-    while (!VMDone(&vm)) {
-      VMStep(&vm);
+    while (!VMDone(vm)) {
+      VMStep(vm);
     }
     for (i = 0; i < 20; i++) fprintf(stderr, " ");
-    PrintStack(&vm, 20);
+    PrintStack(vm, 20);
     fprintf(stderr, "\n");
   } else {
-    while (!VMDone(&vm)) VMStep(&vm);
+    while (!VMDone(vm)) VMStep(vm);
   }
 
+  if (vm->opts->heap_profile) {
+    PrintHeapProfile(&vm->program->srcmap);
+    StopHeapProfile();
+  }
+}
+
+Error *VMRun(Program *program, Opts *opts)
+{
+  VM vm;
+
+  InitVM(&vm, program, opts);
+  InitMem(0);
+  SetMemRoots(vm.regs, ArrayCount(vm.regs));
+  SetMemLimit(opts->mem_limit);
+  if (opts->gc_pause) SetGCPause(opts->gc_pause);
+
+  RunVM(&vm);
+
+  DestroyVM(&vm);
+  return vm.error;
+}
+
+Error *VMSnapshot(Program *program, Opts *opts, char *filename)
+{
+  VM vm;
+
+  InitVM(&vm, program, opts);
+  InitMem(0);
+  SetMemRoots(vm.regs, ArrayCount(vm.regs));
+
+  /* run until the entry module is reached; the imported modules have been loaded by then */
+  while (!VMDone(&vm) && vm.pc != program->entry) VMStep(&vm);
+  if (!vm.error) vm.error = WriteSnapshot(&vm, filename);
+
   DestroyVM(&vm);
+  DestroyMem();
   return vm.error;
 }
 
+Error *VMResume(char *filename, Opts *opts)
+{
+  VM vm;
+  Error *error = ReadSnapshot(filename, &vm, opts);
+  if (error) return error;
+
+  SetMemRoots(vm.regs, ArrayCount(vm.regs));
+  SetMemLimit(opts->mem_limit);
+  if (opts->gc_pause) SetGCPause(opts->gc_pause);
+
+  RunVM(&vm);
+
+  DestroyVM(&vm);
+  FreeProgram(vm.program);
+  return vm.error;
+}
+
+bool IsFunction(val value)
+{
+  return IsTuple(value) && ObjLength(value) == 3 && TupleGet(value, 0) == IntVal(Symbol("fn"));
+}
+
+/*
+ * Sets up a call frame like a compiled call, with the current instruction as the return address,
+ * and steps the VM until the function returns to it. A nested call from the same instruction
+ * returns with a deeper stack, so the stack size tells the two apart.
+ */
+val VMCall(val fn, u32 num_args, VM *vm)
+{
+  val args[MaxCallArgs], result;
+  u32 i, pc = vm->pc, frame;
+  assert(num_args <= MaxCallArgs && StackSize() >= num_args);
+  for (i = 0; i < num_args; i++) args[i] = StackPop();
+
+  StackPush(vm->regs[regEnv]);
+  StackPush(IntVal(vm->link));
+  vm->link = StackSize();
+  StackPush(IntVal(pc));
+  StackPush(IntVal(pc));
+  frame = StackSize();
+  for (i = num_args; i > 0; i--) StackPush(args[i - 1]);
+  StackPush(IntVal(num_args));
+
+  vm->regs[regEnv] = TupleGet(fn, 1);
+  vm->pc = RawVal(TupleGet(fn, 2));
+  while (!VMDone(vm) && (vm->pc != pc || StackSize() != frame)) VMStep(vm);
+  if (vm->error) return 0;
+  if (vm->pc != pc) return RuntimeError("Function call didn't return", vm);
+
+  result = StackPop();
+  StackPop();
+  vm->link = RawInt(StackPop());
+  vm->regs[regEnv] = StackPop();
+  return result;
+}
+
 u32 VMPushRef(void *ref, VM *vm)
 {
   u32 index = VecCount(vm->refs);
@@ -124,7 +214,7 @@ i32 VMFindRef(void *ref, VM *vm)
   return -1;
 }
 
-u32 RuntimeError(char *message, VM *vm)
+val RuntimeError(char *message, VM *vm)
 {
   vm->error = NewRuntimeError(message, vm->pc, vm->link, &vm->program->srcmap);
   return 0;
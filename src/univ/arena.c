@@ -0,0 +1,124 @@
+#include "univ/arena.h"
+#include "univ/str.h"
+#include <pthread.h>
+
+#define BlockSize       65536
+#define MaxSharedAlloc  (BlockSize/4) /* larger allocations get their own block */
+#define Align(n)        (((n) + 7) & ~7)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  u32 size;
+  u32 used;
+} ArenaBlock;
+#define BlockData(block)  ((u8*)(block) + Align(sizeof(ArenaBlock)))
+
+static pthread_key_t local_key;
+static pthread_once_t local_once = PTHREAD_ONCE_INIT;
+static bool has_local_key = false;
+
+static void MakeLocalKey(void)
+{
+  has_local_key = pthread_key_create(&local_key, 0) == 0;
+}
+
+void SetLocalArena(Arena *arena)
+{
+  pthread_once(&local_once, MakeLocalKey);
+  if (has_local_key) pthread_setspecific(local_key, arena);
+}
+
+Arena *LocalArena(void)
+{
+  Arena *arena = has_local_key ? pthread_getspecific(local_key) : 0;
+  assert(arena);
+  return arena;
+}
+
+void InitArena(Arena *arena)
+{
+  arena->blocks = 0;
+  arena->last = 0;
+}
+
+void DestroyArena(Arena *arena)
+{
+  ArenaBlock *block = arena->blocks;
+  while (block) {
+    ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  InitArena(arena);
+}
+
+static ArenaBlock *NewBlock(u32 size)
+{
+  ArenaBlock *block = malloc(Align(sizeof(ArenaBlock)) + size);
+  assert(block);
+  block->next = 0;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void *ArenaAlloc(Arena *arena, u32 size)
+{
+  ArenaBlock *block = arena->blocks;
+  u8 *data;
+  size = Align(size);
+
+  /* large allocations go behind the current block, so its space isn't abandoned */
+  if (size > MaxSharedAlloc) {
+    ArenaBlock *large = NewBlock(size);
+    large->used = size;
+    if (block) {
+      large->next = block->next;
+      block->next = large;
+    } else {
+      arena->blocks = large;
+      arena->last = 0;
+    }
+    return BlockData(large);
+  }
+
+  if (!block || block->used + size > block->size) {
+    block = NewBlock(BlockSize);
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  data = BlockData(block) + block->used;
+  block->used += size;
+  arena->last = data;
+  return data;
+}
+
+/* Grows the last allocation in place, if it's in the current block and there's room */
+static bool ArenaExtend(Arena *arena, void *ptr, u32 size)
+{
+  ArenaBlock *block = arena->blocks;
+  u32 offset;
+  if (!block || (u8*)ptr != arena->last) return false;
+  offset = arena->last - BlockData(block);
+  if (offset + Align(size) > block->size) return false;
+  block->used = offset + Align(size);
+  return true;
+}
+
+void *ArenaResizeVec(Arena *arena, void *vec, u32 numItems, u32 itemSize)
+{
+  u32 doubleCap = vec ? 2*VecCapacity(vec) : 4;
+  u32 minCap = VecCount(vec) + numItems;
+  u32 newCap = Max(doubleCap, minCap);
+  u32 size = itemSize*newCap + sizeof(u32)*2;
+  u32 *newVec;
+  if (vec && ArenaExtend(arena, RawVec(vec), size)) {
+    newVec = RawVec(vec);
+  } else {
+    newVec = ArenaAlloc(arena, size);
+    if (vec) Copy(RawVec(vec), newVec, itemSize*VecCount(vec) + sizeof(u32)*2);
+  }
+  newVec[0] = newCap;
+  if (!vec) newVec[1] = 0;
+  return newVec + 2;
+}
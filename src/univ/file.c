@@ -5,10 +5,13 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <limits.h>
 #include <netdb.h>
 #include <pwd.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -62,6 +65,36 @@ i32 Write(i32 file, char *buf, u32 size, char **error)
   return num_written;
 }
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+i32 WriteVec(i32 file, struct iovec *iov, u32 count, char **error)
+{
+  i32 total = 0;
+  while (count > 0) {
+    i32 num_written = writev(file, iov, Min(count, IOV_MAX));
+    if (num_written < 0) {
+      if (errno == EINTR) continue;
+      if (error) *error = strerror(errno);
+      return num_written;
+    }
+    total += num_written;
+    /* skip past fully-written segments, then trim a partially-written one */
+    while (count > 0 && (u32)num_written >= iov->iov_len) {
+      num_written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + num_written;
+      iov->iov_len -= num_written;
+    }
+  }
+  if (error) *error = 0;
+  return total;
+}
+
 i32 Seek(i32 file, i32 offset, SeekMethod whence, char **error)
 {
   i32 pos = lseek(file, offset, whence);
@@ -201,6 +234,44 @@ i32 WriteFile(void *data, u32 size, char *path)
   return written;
 }
 
+bool ReplaceFile(void *data, u32 size, char *path)
+{
+  char *suffix = FormatInt(NewString(".^.tmp"), getpid());
+  char *temp = StrCat(path, suffix);
+  bool written = WriteFile(data, size, temp) == (i32)size;
+  if (written) {
+    written = rename(temp, path) == 0;
+  }
+  if (!written) remove(temp);
+  free(suffix);
+  free(temp);
+  return written;
+}
+
+void *MapFile(char *path, u32 *size)
+{
+  int file;
+  void *data;
+  struct stat info;
+
+  file = open(path, O_RDONLY, 0);
+  if (file < 0) return 0;
+  if (fstat(file, &info) < 0 || info.st_size == 0) {
+    close(file);
+    return 0;
+  }
+  data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (data == MAP_FAILED) return 0;
+  *size = info.st_size;
+  return data;
+}
+
+void UnmapFile(void *data, u32 size)
+{
+  munmap(data, size);
+}
+
 FileList *NewFileList(u32 count)
 {
   FileList *list = malloc(sizeof(FileList));
@@ -301,6 +372,22 @@ char *DirName(char *path)
   return dirname(path);
 }
 
+bool FileStat(char *path, u64 *mtime, u32 *size)
+{
+  struct stat info;
+  if (stat(path, &info) != 0) return false;
+  *mtime = info.st_mtime;
+  *size = info.st_size;
+  return true;
+}
+
+char *AbsolutePath(char *path)
+{
+  char buf[PATH_MAX];
+  if (!realpath(path, buf)) return 0;
+  return NewString(buf);
+}
+
 bool FileExists(char *path)
 {
   struct stat info;
@@ -313,6 +400,23 @@ bool DirExists(char *path)
   return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
 }
 
+bool MakeDirs(char *path)
+{
+  char *dir = NewString(path);
+  char *cur;
+  bool exists;
+  for (cur = dir + 1; *cur; cur++) {
+    if (*cur != '/') continue;
+    *cur = 0;
+    mkdir(dir, 0777);
+    *cur = '/';
+  }
+  mkdir(dir, 0777);
+  exists = DirExists(dir);
+  free(dir);
+  return exists;
+}
+
 char *HomeDir(void)
 {
   struct passwd *pw = getpwuid(getuid());
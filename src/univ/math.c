@@ -77,6 +77,17 @@ void WriteLEB(i32 num, u32 pos, u8 *buf)
   buf[pos++] = num & 0x7F;
 }
 
+void WritePaddedLEB(i32 num, u32 size, u32 pos, u8 *buf)
+{
+  u32 i;
+  assert(LEBSize(num) <= (i32)size);
+  for (i = 0; i < size - 1; i++) {
+    buf[pos++] = (num & 0x7F) | 0x80;
+    num >>= 7;
+  }
+  buf[pos] = num & 0x7F;
+}
+
 i32 ReadLEB(u32 index, u8 *buf)
 {
   i8 byte = buf[index++];
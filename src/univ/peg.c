@@ -8,6 +8,8 @@ Grammar *NewGrammar(void)
   Grammar *g = malloc(sizeof(Grammar));
   InitHashMap(&g->map);
   g->rules = 0;
+  g->resolved = false;
+  g->memoLimit = 0;
   return g;
 }
 
@@ -30,6 +32,7 @@ static PExpr *NewPExpr(PExprType type)
   expr->type = type;
   expr->predicate = pegMatch;
   expr->quantity = pegOne;
+  expr->rule = MaxUInt;
   expr->data.parts = 0;
   return expr;
 }
@@ -38,6 +41,7 @@ static PExpr *ClonePExpr(PExpr *expr)
 {
   PExpr *clone = NewPExpr(expr->type);
   u32 i;
+  clone->rule = expr->rule;
   switch (expr->type) {
   case pegChoice:
   case pegSeq:
@@ -85,7 +89,7 @@ static void FreePExpr(PExpr *expr)
   free(expr);
 }
 
-static PNode *NewPNode(char *name)
+PNode *NewPNode(char *name)
 {
   PNode *node = malloc(sizeof(PNode));
   node->name = NewString(name);
@@ -371,6 +375,7 @@ static void PutRule(PRule *rule, Grammar *g)
   u32 key = HashStr(rule->name);
   HashMapSet(&g->map, key, VecCount(g->rules));
   VecPush(g->rules, rule);
+  g->resolved = false;
 }
 
 void AddRule(char *name, char *expr, PRuleAction action, Grammar *g)
@@ -396,21 +401,181 @@ void OnRule(char *name, PRuleAction action, Grammar *g)
   }
 }
 
+void SetGrammarMemo(u32 limit, Grammar *g)
+{
+  g->memoLimit = limit;
+}
+
+/* The result of matching a rule at a position */
+typedef struct {
+  u32 rule; /* MaxUInt for an empty slot */
+  u32 pos;
+  u32 end; /* where the match ended, or NoMatch */
+  u32 longest; /* furthest position the rule backtracked from */
+  bool nodeless; /* whether the rule is known to leave no node */
+  u32 shape; /* the nodes the match built, or NoMatch if it didn't build any */
+} MemoEntry;
+
+#define NoMatch             MaxUInt
+#define MemoProbes          4
+#define MemoStartSize       1024
+
 typedef struct {
   Grammar *g;
   u32 index;
   char *text;
   u32 length;
   u32 longest;
+  MemoEntry *memo; /* open addressed, with a power of two capacity */
+  u32 memoCap;
+  u32 memoCount;
+  u32 memoDist; /* furthest any entry is from its first slot */
+  u32 *shapes; /* vec, the shape of each rule node built while memoizing */
+  u32 *built; /* vec, the shapes of rule nodes built and not yet backtracked over */
 } Parser;
 
+static u32 MemoHash(u32 rule, u32 pos, Parser *p)
+{
+  u32 hash = (pos*VecCount(p->g->rules) + rule)*0x9E3779B1;
+  return hash ^ (hash >> 15);
+}
+
+static void InitMemo(Parser *p, u32 capacity)
+{
+  u32 i;
+  p->memo = malloc(capacity*sizeof(MemoEntry));
+  p->memoCap = capacity;
+  p->memoCount = 0;
+  p->memoDist = 0;
+  for (i = 0; i < capacity; i++) p->memo[i].rule = MaxUInt;
+}
+
 static void InitParser(Parser *p, Grammar *g, char *text, u32 length)
 {
+  u32 capacity = 1;
   p->g = g;
   p->index = 0;
   p->text = text;
   p->length = length;
   p->longest = 0;
+  p->memo = 0;
+  p->memoCap = 0;
+  p->memoCount = 0;
+  p->memoDist = 0;
+  p->shapes = 0;
+  p->built = 0;
+  if (g->memoLimit) {
+    while (capacity < MemoStartSize && capacity <= g->memoLimit/2) capacity *= 2;
+    InitMemo(p, capacity);
+  }
+}
+
+static void DestroyParser(Parser *p)
+{
+  if (p->memo) free(p->memo);
+  FreeVec(p->shapes);
+  FreeVec(p->built);
+}
+
+/* Entries are never removed, only replaced, so a probe can stop at an empty slot */
+static MemoEntry *FindMemo(u32 rule, u32 pos, Parser *p)
+{
+  u32 slot = MemoHash(rule, pos, p), i;
+  for (i = 0; i <= p->memoDist; i++) {
+    MemoEntry *entry = &p->memo[(slot + i) & (p->memoCap - 1)];
+    if (entry->rule == rule && entry->pos == pos) return entry;
+    if (entry->rule == MaxUInt) return 0;
+  }
+  return 0;
+}
+
+#define CanGrowMemo(p)  ((p)->memoCap <= (p)->g->memoLimit/2)
+
+static MemoEntry *MemoSlot(u32 rule, u32 pos, Parser *p);
+
+static void GrowMemo(Parser *p)
+{
+  MemoEntry *old = p->memo;
+  u32 oldCap = p->memoCap, i;
+  InitMemo(p, 2*oldCap);
+  for (i = 0; i < oldCap; i++) {
+    if (old[i].rule != MaxUInt) *MemoSlot(old[i].rule, old[i].pos, p) = old[i];
+  }
+  free(old);
+}
+
+/*
+ * Returns the slot for a rule and position. The memo grows to stay at most half full until it
+ * reaches its limit. After that, a new entry replaces the entry in its first slot when the next
+ * few slots are full.
+ */
+static MemoEntry *MemoSlot(u32 rule, u32 pos, Parser *p)
+{
+  u32 slot, probes, i;
+  if (CanGrowMemo(p) && 2*(p->memoCount + 1) > p->memoCap) GrowMemo(p);
+  slot = MemoHash(rule, pos, p);
+  probes = CanGrowMemo(p) ? p->memoCap : MemoProbes;
+  for (i = 0; i < probes; i++) {
+    MemoEntry *entry = &p->memo[(slot + i) & (p->memoCap - 1)];
+    if (entry->rule == rule && entry->pos == pos) return entry;
+    if (entry->rule == MaxUInt) {
+      p->memoCount++;
+      p->memoDist = Max(p->memoDist, i);
+      return entry;
+    }
+  }
+  return &p->memo[slot & (p->memoCap - 1)];
+}
+
+static void SaveMemo(u32 rule, u32 pos, u32 end, u32 longest, bool nodeless, u32 shape,
+    Parser *p)
+{
+  MemoEntry *entry = MemoSlot(rule, pos, p);
+  entry->rule = rule;
+  entry->pos = pos;
+  entry->end = end;
+  entry->longest = longest;
+  entry->nodeless = nodeless;
+  entry->shape = shape;
+}
+
+/*
+ * A memoized match that built a node keeps the node's shape, so the node can be built again without
+ * matching. Nodes can't be shared, since actions may take ownership of their children's data.
+ *
+ * A shape is the rule, start, end, and number of children, followed by each child's shape index.
+ * The shapes of a node's children are collected in `built` as they're matched, and dropped when
+ * their nodes are backtracked over.
+ */
+static u32 SaveShape(u32 rule, u32 start, u32 end, u32 children, Parser *p)
+{
+  u32 shape = VecCount(p->shapes), i;
+  VecPush(p->shapes, rule);
+  VecPush(p->shapes, start);
+  VecPush(p->shapes, end);
+  VecPush(p->shapes, VecCount(p->built) - children);
+  for (i = children; i < VecCount(p->built); i++) VecPush(p->shapes, p->built[i]);
+  VecTrunc(p->built, children);
+  return shape;
+}
+
+/* Builds a node from its shape, running the actions of it and its children again */
+static void BuildShape(u32 shape, PNode *node, Parser *p)
+{
+  PRule *rule = p->g->rules[p->shapes[shape]];
+  PNode *child = NewPNode(rule->name);
+  u32 i;
+  child->lexeme = p->text + p->shapes[shape + 1];
+  child->length = p->shapes[shape + 2] - p->shapes[shape + 1];
+  for (i = 0; i < p->shapes[shape + 3]; i++) BuildShape(p->shapes[shape + 4 + i], child, p);
+  if (rule->action) child = rule->action(child);
+  if (child) VecPush(node->elements, child);
+}
+
+static void Backtrack(PNode *node, u32 elemStart, u32 builtStart, Parser *p)
+{
+  if (node) TruncNodes(node->elements, elemStart);
+  VecTrunc(p->built, builtStart);
 }
 
 bool MatchExpr(PExpr *expr, PNode *node, Parser *p);
@@ -418,26 +583,59 @@ bool MatchExpr(PExpr *expr, PNode *node, Parser *p);
 bool MatchRuleExpr(PExpr *expr, PNode *node, Parser *p)
 {
   PNode *child = 0;
-  u32 key = HashStr(expr->data.text);
   PRule *rule;
-  u32 ruleIndex;
-  if (!HashMapFetch(&p->g->map, key, &ruleIndex)) return false;
-  rule = p->g->rules[ruleIndex];
+  u32 start = p->index, longest = p->longest, children = VecCount(p->built);
+  bool match;
+  if (expr->rule >= VecCount(p->g->rules)) return false;
+  rule = p->g->rules[expr->rule];
+
+  if (p->memo) {
+    MemoEntry *entry = FindMemo(expr->rule, start, p);
+    if (entry) {
+      p->longest = Max(p->longest, entry->longest);
+      if (entry->end == NoMatch) return false;
+      if (!node || entry->nodeless) {
+        p->index = entry->end;
+        return true;
+      }
+      if (entry->shape != NoMatch) {
+        BuildShape(entry->shape, node, p);
+        VecPush(p->built, entry->shape);
+        p->index = entry->end;
+        return true;
+      }
+    }
+    /* track the rule's own longest position, to memoize it */
+    p->longest = 0;
+  }
 
   if (node) {
-    child = NewPNode(expr->data.text);
-    child->lexeme = p->text + p->index;
+    child = NewPNode(rule->name);
+    child->lexeme = p->text + start;
   }
-  if (!MatchExpr(rule->expr, child, p)) {
+  match = MatchExpr(rule->expr, child, p);
+  if (!match) {
     if (child) FreePNode(child);
-    return false;
-  }
-  if (child) {
+    child = 0;
+  } else if (child) {
     child->length = p->text + p->index - child->lexeme;
     if (rule->action) child = rule->action(child);
     if (child) VecPush(node->elements, child);
   }
-  return true;
+
+  if (p->memo) {
+    u32 shape = NoMatch;
+    if (child) {
+      shape = SaveShape(expr->rule, start, p->index, children, p);
+      VecPush(p->built, shape);
+    } else {
+      VecTrunc(p->built, children);
+    }
+    SaveMemo(expr->rule, start, match ? p->index : NoMatch, p->longest, match && node && !child,
+        shape, p);
+    p->longest = Max(longest, p->longest);
+  }
+  return match;
 }
 
 bool MatchPrimary(PExpr *expr, PNode *node, Parser *p)
@@ -445,6 +643,7 @@ bool MatchPrimary(PExpr *expr, PNode *node, Parser *p)
   u32 start = p->index;
   u32 i, len;
   u32 elemStart = node ? VecCount(node->elements) : 0;
+  u32 builtStart = VecCount(p->built);
   char ch;
 
   switch (expr->type) {
@@ -489,7 +688,7 @@ bool MatchPrimary(PExpr *expr, PNode *node, Parser *p)
       if (MatchExpr(expr->data.parts[i], node, p)) {
         return true;
       }
-      if (node) TruncNodes(node->elements, elemStart);
+      Backtrack(node, elemStart, builtStart, p);
       p->longest = Max(p->longest, p->index);
       p->index = start;
     }
@@ -501,6 +700,7 @@ bool MatchQuantity(PExpr *expr, PNode *node, Parser *p)
 {
   u32 start = p->index;
   u32 elemStart = node ? VecCount(node->elements) : 0;
+  u32 builtStart = VecCount(p->built);
   bool match;
 
   switch (expr->quantity) {
@@ -509,18 +709,19 @@ bool MatchQuantity(PExpr *expr, PNode *node, Parser *p)
   case pegOptional:
     if (!MatchPrimary(expr, node, p)) {
       p->index = start;
-      if (node) TruncNodes(node->elements, elemStart);
+      Backtrack(node, elemStart, builtStart, p);
     }
     return true;
   case pegZeroPlus:
     do {
       start = p->index;
       elemStart = node ? VecCount(node->elements) : 0;
+      builtStart = VecCount(p->built);
       match = MatchPrimary(expr, node, p);
     } while (match);
     if (!match) {
       p->index = start;
-      if (node) TruncNodes(node->elements, elemStart);
+      Backtrack(node, elemStart, builtStart, p);
     }
     return true;
   case pegOnePlus:
@@ -529,11 +730,12 @@ bool MatchQuantity(PExpr *expr, PNode *node, Parser *p)
     while (match) {
       start = p->index;
       elemStart = node ? VecCount(node->elements) : 0;
+      builtStart = VecCount(p->built);
       match = MatchPrimary(expr, node, p);
     }
     if (!match) {
       p->index = start;
-      if (node) TruncNodes(node->elements, elemStart);
+      Backtrack(node, elemStart, builtStart, p);
     }
     return true;
   }
@@ -563,6 +765,44 @@ bool MatchExpr(PExpr *expr, PNode *node, Parser *p)
   return MatchPredicate(expr, node, p);
 }
 
+/* Resolves each rule reference to its rule's index, returning the first undefined rule's name.
+ * References to undefined rules never match. */
+static char *ResolveExpr(PExpr *expr, Grammar *g)
+{
+  char *error = 0;
+  u32 i;
+
+  switch (expr->type) {
+  case pegRule:
+    if (!HashMapFetch(&g->map, HashStr(expr->data.text), &expr->rule)) {
+      expr->rule = MaxUInt;
+      return expr->data.text;
+    }
+    return 0;
+  case pegChoice:
+  case pegSeq:
+    for (i = 0; i < VecCount(expr->data.parts); i++) {
+      char *undefined = ResolveExpr(expr->data.parts[i], g);
+      if (!error) error = undefined;
+    }
+    return error;
+  default:
+    return 0;
+  }
+}
+
+static char *ResolveGrammar(Grammar *g)
+{
+  char *error = 0;
+  u32 i;
+  for (i = 0; i < VecCount(g->rules); i++) {
+    char *undefined = ResolveExpr(g->rules[i]->expr, g);
+    if (!error) error = undefined;
+  }
+  g->resolved = true;
+  return error;
+}
+
 PNode *ParseRule(char *name, char *text, u32 *index, u32 length, Grammar *g)
 {
   Parser p;
@@ -572,18 +812,22 @@ PNode *ParseRule(char *name, char *text, u32 *index, u32 length, Grammar *g)
   u32 key = HashStr(name);
   if (!HashMapFetch(&g->map, key, &ruleIndex)) return 0;
   rule = g->rules[ruleIndex];
+  if (!g->resolved) ResolveGrammar(g);
 
   InitParser(&p, g, text, length);
+  p.index = *index;
 
   node = NewPNode(name);
   node->lexeme = text + *index;
   if (!MatchExpr(rule->expr, node, &p)) {
+    DestroyParser(&p);
     FreePNode(node);
     *index = p.longest;
     return 0;
   }
 
-  node->length = text + *index - node->lexeme;
+  DestroyParser(&p);
+  node->length = text + p.index - node->lexeme;
   if (rule->action) node = rule->action(node);
   *index = p.index;
   return node;
@@ -794,38 +1038,6 @@ static Grammar *PEGGrammar(void)
   return g;
 }
 
-static char *CheckExpr(PExpr *expr, Grammar *g)
-{
-  u32 i;
-
-  switch (expr->type) {
-  case pegRule:
-    if (!HashMapContains(&g->map, HashStr(expr->data.text))) {
-      return expr->data.text;
-    }
-    return 0;
-  case pegChoice:
-  case pegSeq:
-    for (i = 0; i < VecCount(expr->data.parts); i++) {
-      char *error = CheckExpr(expr->data.parts[i], g);
-      if (error) return error;
-    }
-    return 0;
-  default:
-    return 0;
-  }
-}
-
-static char *CheckGrammar(Grammar *g)
-{
-  u32 i;
-  for (i = 0; i < VecCount(g->rules); i++) {
-    char *error = CheckExpr(g->rules[i]->expr, g);
-    if (error) return error;
-  }
-  return 0;
-}
-
 Grammar *ReadGrammar(char *text)
 {
   Grammar *pegGrammar = PEGGrammar();
@@ -842,7 +1054,7 @@ Grammar *ReadGrammar(char *text)
 
   g = node->value.data;
   FreePNode(node);
-  error = CheckGrammar(g);
+  error = ResolveGrammar(g);
   if (error) {
     fprintf(stderr, "Undefined rule %s\n", error);
     FreeGrammar(g);
@@ -0,0 +1,399 @@
+#include "univ/pegvm.h"
+#include "univ/math.h"
+#include "univ/str.h"
+#include "univ/vec.h"
+
+enum {
+  pChar,          /* match a character */
+  pAny,           /* match any character */
+  pSet,           /* match a character in a set */
+  pChoice,        /* push a backtrack entry to an address */
+  pCommit,        /* pop a backtrack entry, and jump */
+  pPartialCommit, /* update the top backtrack entry to here, and jump (for loops) */
+  pBackCommit,    /* pop a backtrack entry and return to its position, and jump (for &) */
+  pFailTwice,     /* pop a backtrack entry, and fail (for !) */
+  pFail,          /* fail */
+  pCall,          /* push a return entry, and jump */
+  pReturn,        /* pop a return entry, and jump to it */
+  pOpen,          /* log the start of a rule */
+  pClose,         /* log the end of a rule */
+  pEnd            /* finish the match */
+};
+
+#define Instr(op, arg)    ((op) | ((arg) << 8))
+#define InstrOp(instr)    ((instr) & 0xFF)
+#define InstrArg(instr)   ((instr) >> 8)
+#define Here(prog)        VecCount((prog)->code)
+#define SetSize           (256/32)
+
+static u32 Emit(u32 op, u32 arg, PProgram *prog)
+{
+  VecPush(prog->code, Instr(op, arg));
+  return VecCount(prog->code) - 1;
+}
+
+/* Points a jump at an address */
+static void Patch(u32 jump, u32 target, PProgram *prog)
+{
+  prog->code[jump] = Instr(InstrOp(prog->code[jump]), target);
+}
+
+/* Ranges are compared as chars, the same as MatchPrimary does */
+static u32 CompileSet(PRange *ranges, PProgram *prog)
+{
+  u32 set = VecCount(prog->sets)/SetSize, c, i;
+  u32 *bits;
+  GrowVec(prog->sets, SetSize);
+  bits = prog->sets + set*SetSize;
+  for (i = 0; i < SetSize; i++) bits[i] = 0;
+  for (c = 0; c < 256; c++) {
+    char ch = (char)c;
+    for (i = 0; i < VecCount(ranges); i++) {
+      if (ch >= ranges[i].start && ch <= ranges[i].end) {
+        bits[c/32] |= (u32)1 << (c % 32);
+        break;
+      }
+    }
+  }
+  return set;
+}
+
+/* Calls are compiled with a rule index and whether the call is quiet, since rules can be called
+ * before they're compiled */
+#define CallArg(rule, quiet)  (2*(rule) + (quiet))
+
+static void CompileExpr(PExpr *expr, bool quiet, PProgram *prog);
+
+static void CompilePrimary(PExpr *expr, bool quiet, PProgram *prog)
+{
+  u32 *commits = 0; /* vec */
+  u32 i, rule;
+
+  switch (expr->type) {
+  case pegAny:
+    Emit(pAny, 0, prog);
+    break;
+  case pegLiteral:
+    for (i = 0; expr->data.text[i]; i++) Emit(pChar, (u8)expr->data.text[i], prog);
+    break;
+  case pegClass:
+    Emit(pSet, CompileSet(expr->data.ranges, prog), prog);
+    break;
+  case pegRule:
+    if (HashMapFetch(&prog->g->map, HashStr(expr->data.text), &rule)) {
+      Emit(pCall, CallArg(rule, quiet), prog);
+    } else {
+      Emit(pFail, 0, prog);
+    }
+    break;
+  case pegSeq:
+    for (i = 0; i < VecCount(expr->data.parts); i++) {
+      CompileExpr(expr->data.parts[i], quiet, prog);
+    }
+    break;
+  case pegChoice:
+    for (i = 0; i < VecCount(expr->data.parts) - 1; i++) {
+      u32 choice = Emit(pChoice, 0, prog);
+      CompileExpr(expr->data.parts[i], quiet, prog);
+      VecPush(commits, Emit(pCommit, 0, prog));
+      Patch(choice, Here(prog), prog);
+    }
+    CompileExpr(expr->data.parts[i], quiet, prog);
+    for (i = 0; i < VecCount(commits); i++) Patch(commits[i], Here(prog), prog);
+    FreeVec(commits);
+    break;
+  }
+}
+
+static void CompileQuantity(PExpr *expr, bool quiet, PProgram *prog)
+{
+  u32 choice, commit, loop;
+
+  switch (expr->quantity) {
+  case pegOne:
+    CompilePrimary(expr, quiet, prog);
+    return;
+  case pegOptional:
+    choice = Emit(pChoice, 0, prog);
+    CompilePrimary(expr, quiet, prog);
+    commit = Emit(pCommit, 0, prog);
+    Patch(choice, Here(prog), prog);
+    Patch(commit, Here(prog), prog);
+    return;
+  case pegOnePlus:
+    CompilePrimary(expr, quiet, prog);
+    /* fall through */
+  case pegZeroPlus:
+    choice = Emit(pChoice, 0, prog);
+    loop = Here(prog);
+    CompilePrimary(expr, quiet, prog);
+    Emit(pPartialCommit, loop, prog);
+    Patch(choice, Here(prog), prog);
+    return;
+  }
+}
+
+/* Predicates never build nodes, so they're compiled quietly */
+static void CompileExpr(PExpr *expr, bool quiet, PProgram *prog)
+{
+  u32 choice, commit;
+
+  switch (expr->predicate) {
+  case pegMatch:
+    CompileQuantity(expr, quiet, prog);
+    return;
+  case pegAssert:
+    choice = Emit(pChoice, 0, prog);
+    CompileQuantity(expr, true, prog);
+    commit = Emit(pBackCommit, 0, prog);
+    Patch(choice, Here(prog), prog);
+    Emit(pFail, 0, prog);
+    Patch(commit, Here(prog), prog);
+    return;
+  case pegRefute:
+    choice = Emit(pChoice, 0, prog);
+    CompileQuantity(expr, true, prog);
+    Emit(pFailTwice, 0, prog);
+    Patch(choice, Here(prog), prog);
+    return;
+  }
+}
+
+/*
+ * Each rule is compiled twice: once to log its node, and once quietly, for where its node would be
+ * discarded. A rule whose action is DiscardNode only has the quiet version.
+ *
+ * Address 0 ends the match, so a match starts by calling a rule with 0 as its return address.
+ */
+PProgram *CompileGrammar(Grammar *g)
+{
+  PProgram *prog = malloc(sizeof(PProgram));
+  u32 i;
+  prog->g = g;
+  prog->code = 0;
+  prog->rules = 0;
+  prog->quiet = 0;
+  prog->sets = 0;
+
+  Emit(pEnd, 0, prog);
+  for (i = 0; i < VecCount(g->rules); i++) {
+    VecPush(prog->quiet, Here(prog));
+    CompileExpr(g->rules[i]->expr, true, prog);
+    Emit(pReturn, 0, prog);
+    if (g->rules[i]->action == DiscardNode) {
+      VecPush(prog->rules, prog->quiet[i]);
+    } else {
+      VecPush(prog->rules, Here(prog));
+      Emit(pOpen, i, prog);
+      CompileExpr(g->rules[i]->expr, false, prog);
+      Emit(pClose, i, prog);
+      Emit(pReturn, 0, prog);
+    }
+  }
+
+  for (i = 0; i < VecCount(prog->code); i++) {
+    if (InstrOp(prog->code[i]) == pCall) {
+      u32 arg = InstrArg(prog->code[i]);
+      Patch(i, (arg & 1) ? prog->quiet[arg/2] : prog->rules[arg/2], prog);
+    }
+  }
+
+  return prog;
+}
+
+void FreePProgram(PProgram *prog)
+{
+  FreeVec(prog->code);
+  FreeVec(prog->rules);
+  FreeVec(prog->quiet);
+  FreeVec(prog->sets);
+  free(prog);
+}
+
+typedef struct {
+  u32 pc;
+  u32 pos; /* MaxUInt for a return entry */
+  u32 captures;
+} Backtrack;
+
+typedef struct {
+  u32 rule;
+  u32 pos;
+  bool close;
+} Capture;
+
+/* Replays a capture log, returning the outermost rule's node */
+static PNode *BuildNodes(Capture *captures, char *text, PProgram *prog)
+{
+  PNode **open = 0; /* vec */
+  PNode *node = 0;
+  u32 i;
+
+  for (i = 0; i < VecCount(captures); i++) {
+    PRule *rule = prog->g->rules[captures[i].rule];
+    if (!captures[i].close) {
+      node = NewPNode(rule->name);
+      node->lexeme = text + captures[i].pos;
+      VecPush(open, node);
+    } else {
+      node = VecPop(open);
+      node->length = text + captures[i].pos - node->lexeme;
+      if (rule->action) node = rule->action(node);
+      if (node && VecCount(open) > 0) VecPush(open[VecCount(open) - 1]->elements, node);
+    }
+  }
+
+  FreeVec(open);
+  return node;
+}
+
+PNode *RunPProgram(char *name, char *text, u32 *index, u32 length, PProgram *prog)
+{
+  u32 *code = prog->code;
+  Backtrack *stack = 0; /* vec */
+  Capture *captures = 0; /* vec */
+  Backtrack entry;
+  Capture capture;
+  u32 pc, pos = *index, longest = *index, rule;
+  bool matched = false;
+  PNode *node = 0;
+
+  if (!HashMapFetch(&prog->g->map, HashStr(name), &rule)) return 0;
+  entry.pc = 0;
+  entry.pos = MaxUInt;
+  entry.captures = 0;
+  VecPush(stack, entry);
+  pc = prog->rules[rule];
+
+  for (;;) {
+    u32 instr = code[pc];
+    u32 arg = InstrArg(instr);
+    u8 ch;
+
+    switch (InstrOp(instr)) {
+    case pChar:
+      if (pos < length && (u8)text[pos] == arg) {
+        pos++;
+        pc++;
+        continue;
+      }
+      break;
+    case pAny:
+      if (pos < length) {
+        pos++;
+        pc++;
+        continue;
+      }
+      break;
+    case pSet:
+      if (pos >= length) break;
+      ch = (u8)text[pos];
+      if (prog->sets[arg*SetSize + ch/32] & ((u32)1 << (ch % 32))) {
+        pos++;
+        pc++;
+        continue;
+      }
+      break;
+    case pChoice:
+      entry.pc = arg;
+      entry.pos = pos;
+      entry.captures = VecCount(captures);
+      VecPush(stack, entry);
+      pc++;
+      continue;
+    case pCommit:
+      VecTrunc(stack, VecCount(stack) - 1);
+      pc = arg;
+      continue;
+    case pPartialCommit:
+      stack[VecCount(stack) - 1].pos = pos;
+      stack[VecCount(stack) - 1].captures = VecCount(captures);
+      pc = arg;
+      continue;
+    case pBackCommit:
+      entry = VecPop(stack);
+      pos = entry.pos;
+      VecTrunc(captures, entry.captures);
+      pc = arg;
+      continue;
+    case pFailTwice:
+      VecTrunc(stack, VecCount(stack) - 1);
+      break;
+    case pFail:
+      break;
+    case pCall:
+      entry.pc = pc + 1;
+      entry.pos = MaxUInt;
+      entry.captures = 0;
+      VecPush(stack, entry);
+      pc = arg;
+      continue;
+    case pReturn:
+      entry = VecPop(stack);
+      pc = entry.pc;
+      continue;
+    case pOpen:
+    case pClose:
+      capture.rule = arg;
+      capture.pos = pos;
+      capture.close = InstrOp(instr) == pClose;
+      VecPush(captures, capture);
+      pc++;
+      continue;
+    case pEnd:
+      matched = true;
+      break;
+    }
+    if (matched) break;
+
+    /* backtrack to the last choice, discarding any calls since */
+    longest = Max(longest, pos);
+    while (VecCount(stack) > 0 && stack[VecCount(stack) - 1].pos == MaxUInt) {
+      VecTrunc(stack, VecCount(stack) - 1);
+    }
+    if (VecCount(stack) == 0) break;
+    entry = VecPop(stack);
+    pc = entry.pc;
+    pos = entry.pos;
+    VecTrunc(captures, entry.captures);
+  }
+
+  if (matched) {
+    node = BuildNodes(captures, text, prog);
+    *index = pos;
+  } else {
+    *index = longest;
+  }
+  FreeVec(stack);
+  FreeVec(captures);
+  return node;
+}
+
+#ifdef DEBUG
+void PrintPProgram(PProgram *prog)
+{
+  static char *names[] = {
+    "char", "any", "set", "choice", "commit", "partialcommit", "backcommit", "failtwice", "fail",
+    "call", "return", "open", "close", "end"
+  };
+  u32 i, j;
+  for (i = 0; i < VecCount(prog->code); i++) {
+    u32 op = InstrOp(prog->code[i]), arg = InstrArg(prog->code[i]);
+    for (j = 0; j < VecCount(prog->rules); j++) {
+      if (prog->quiet[j] == i) printf("%s (quiet):\n", prog->g->rules[j]->name);
+      if (prog->rules[j] == i && prog->rules[j] != prog->quiet[j]) {
+        printf("%s:\n", prog->g->rules[j]->name);
+      }
+    }
+    printf("%5d  %s", i, names[op]);
+    if (op == pChar) {
+      printf(IsPrintable(arg) ? " '%c'" : " \\%02X", arg);
+    } else if (op == pOpen || op == pClose) {
+      printf(" %s", prog->g->rules[arg]->name);
+    } else if (op != pAny && op != pFailTwice && op != pFail && op != pReturn && op != pEnd) {
+      printf(" %d", arg);
+    }
+    printf("\n");
+  }
+}
+#endif
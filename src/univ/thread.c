@@ -0,0 +1,62 @@
+#include "univ/thread.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define MaxThreads 64
+
+typedef struct {
+  TaskFn fn;
+  void *data;
+  u32 count;
+  u32 next;
+  pthread_mutex_t lock;
+} TaskQueue;
+
+u32 NumProcessors(void)
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (u32)count : 1;
+}
+
+static void *TaskWorker(void *arg)
+{
+  TaskQueue *queue = arg;
+  while (true) {
+    u32 index;
+    pthread_mutex_lock(&queue->lock);
+    index = queue->next;
+    if (index < queue->count) queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (index >= queue->count) break;
+    queue->fn(index, queue->data);
+  }
+  return 0;
+}
+
+void RunTasks(TaskFn fn, u32 count, void *data)
+{
+  pthread_t threads[MaxThreads];
+  u32 num_threads = Min(Min(NumProcessors(), count), MaxThreads);
+  u32 started, i;
+  TaskQueue queue;
+
+  if (num_threads <= 1) {
+    for (i = 0; i < count; i++) fn(i, data);
+    return;
+  }
+
+  queue.fn = fn;
+  queue.data = data;
+  queue.count = count;
+  queue.next = 0;
+  pthread_mutex_init(&queue.lock, 0);
+
+  /* the calling thread works too, so if no threads can be started the tasks still run */
+  for (started = 0; started < num_threads - 1; started++) {
+    if (pthread_create(&threads[started], 0, TaskWorker, &queue) != 0) break;
+  }
+  TaskWorker(&queue);
+  for (i = 0; i < started; i++) pthread_join(threads[i], 0);
+
+  pthread_mutex_destroy(&queue.lock);
+}
@@ -1,5 +1,5 @@
 #include "univ/xml.h"
-#include "univ/peg.h"
+#include "univ/pegvm.h"
 #include "univ/str.h"
 #include "univ/vec.h"
 
@@ -210,12 +210,15 @@ XMLNode *ParseXML(char *str)
   u32 index = 0;
   PNode *node;
   Grammar *g;
+  PProgram *prog;
 
   if (!str) return 0;
 
   g = XMLGrammar();
-
-  node = ParseRule("document", str, &index, StrLen(str), g);
+  prog = CompileGrammar(g);
+  node = RunPProgram("document", str, &index, StrLen(str), prog);
+  FreePProgram(prog);
+  FreeGrammar(g);
   if (!node) {
     fprintf(stderr, "Parse error at %d\n", index);
     return 0;
@@ -0,0 +1,68 @@
+#include "compile/lex.h"
+#include "univ/file.h"
+#include "univ/time.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Lexer microbenchmark: lexes each given file into a token list, repeatedly, and reports the
+ * throughput of the fastest round.
+ *
+ *   make bench                       (lexes the library in share)
+ *   bin/lexbench [-n rounds] file...
+ */
+
+static u32 LexFile(char *text)
+{
+  TokenList list;
+  u32 count;
+  InitTokenList(&list, text);
+  LexTokens(&list, (u32)-1);
+  count = VecCount(list.tokens);
+  DestroyTokenList(&list);
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  char **texts = 0; /* vec */
+  u32 rounds = 20, bytes = 0, tokens = 0, i, j;
+  u64 best = 0;
+  int arg = 1;
+
+  if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+    rounds = atoi(argv[arg + 1]);
+    arg += 2;
+  }
+  if (arg >= argc || rounds == 0) {
+    fprintf(stderr, "Usage: %s [-n rounds] file...\n", argv[0]);
+    return 1;
+  }
+
+  for (; arg < argc; arg++) {
+    char *text = ReadFile(argv[arg]);
+    if (!text) {
+      fprintf(stderr, "Couldn't read \"%s\"\n", argv[arg]);
+      return 1;
+    }
+    VecPush(texts, text);
+    bytes += strlen(text);
+  }
+
+  for (i = 0; i < rounds; i++) {
+    u64 start = Microtime(), elapsed;
+    tokens = 0;
+    for (j = 0; j < VecCount(texts); j++) tokens += LexFile(texts[j]);
+    elapsed = Microtime() - start;
+    if (i == 0 || elapsed < best) best = elapsed;
+  }
+  if (best == 0) best = 1;
+
+  printf("%d files, %d bytes, %d tokens\n", VecCount(texts), bytes, tokens);
+  printf("best of %d: %.3f ms, %.2f MB/s, %.1f Mtokens/s\n", rounds, best/1000.0,
+      (double)bytes/best, (double)tokens/best);
+
+  for (j = 0; j < VecCount(texts); j++) free(texts[j]);
+  FreeVec(texts);
+  return 0;
+}
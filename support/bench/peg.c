@@ -0,0 +1,119 @@
+#include "univ/pegvm.h"
+#include "univ/math.h"
+#include "univ/str.h"
+#include "univ/time.h"
+#include "univ/vec.h"
+#include "univ/xml.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * PEG microbenchmark: parses a generated XML document with the XML grammar, using the tree
+ * interpreter (ParseRule), the parsing machine (RunPProgram), and the tree interpreter with a
+ * packrat memo, and reports the throughput of the fastest round of each.
+ *
+ *   make bench
+ *   bin/pegbench [-n rounds] [items]
+ */
+
+static void PushText(char **buf, char *text)
+{
+  u32 len = strlen(text);
+  GrowVec(*buf, len);
+  Copy(text, *buf + VecCount(*buf) - len, len);
+}
+
+static char *Document(u32 items)
+{
+  char *doc = 0; /* vec */
+  char item[256];
+  u32 i;
+  PushText(&doc, "<?xml version=\"1.0\"?>\n<catalog name=\"bench\">\n");
+  for (i = 0; i < items; i++) {
+    sprintf(item, "  <item id=\"%d\" kind=\"k%d\">\n    <title>Item %d &amp; more</title>\n"
+        "    <flag on=\"yes\"/>\n    <note>&#x41;bc &lt; def</note>\n  </item>\n", i, i % 7, i);
+    PushText(&doc, item);
+  }
+  PushText(&doc, "</catalog>\n");
+  VecPush(doc, 0);
+  return doc;
+}
+
+/* Returns the fastest time, in microseconds, and the end position of the last round */
+static u64 Bench(char *doc, u32 rounds, Grammar *g, PProgram *prog, u32 *end)
+{
+  u64 best = 0;
+  u32 i;
+  for (i = 0; i < rounds; i++) {
+    u64 start = Microtime(), elapsed;
+    PNode *node;
+    *end = 0;
+    if (prog) {
+      node = RunPProgram("document", doc, end, strlen(doc), prog);
+    } else {
+      node = ParseRule("document", doc, end, strlen(doc), g);
+    }
+    elapsed = Microtime() - start;
+    if (i == 0 || elapsed < best) best = elapsed;
+    if (!node) {
+      *end = MaxUInt;
+      break;
+    }
+    FreeXMLNode(node->value.data);
+    FreePNode(node);
+  }
+  return Max(best, 1);
+}
+
+static void Report(char *name, u64 time, u32 end, u32 size)
+{
+  if (end != size) {
+    printf("%-12s parse failed\n", name);
+    return;
+  }
+  printf("%-12s %8.3f ms  %6.2f MB/s\n", name, time/1000.0, (double)size/time);
+}
+
+int main(int argc, char *argv[])
+{
+  u32 rounds = 10, items = 2000, size, end;
+  Grammar *g = XMLGrammar();
+  PProgram *prog;
+  char *doc;
+  u64 time;
+  int arg = 1;
+
+  if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+    rounds = atoi(argv[arg + 1]);
+    arg += 2;
+  }
+  if (arg < argc) items = atoi(argv[arg]);
+  if (rounds == 0) {
+    fprintf(stderr, "Usage: %s [-n rounds] [items]\n", argv[0]);
+    return 1;
+  }
+
+  doc = Document(items);
+  size = strlen(doc);
+  printf("XML document: %d items, %d bytes, best of %d\n", items, size, rounds);
+
+  time = Microtime();
+  prog = CompileGrammar(g);
+  time = Microtime() - time;
+  printf("compiled %d instructions in %.3f ms\n", VecCount(prog->code), time/1000.0);
+
+  time = Bench(doc, rounds, g, 0, &end);
+  Report("tree", time, end, size);
+
+  time = Bench(doc, rounds, g, prog, &end);
+  Report("machine", time, end, size);
+
+  SetGrammarMemo(MaxUInt, g);
+  time = Bench(doc, rounds, g, 0, &end);
+  Report("tree+memo", time, end, size);
+
+  FreePProgram(prog);
+  FreeGrammar(g);
+  FreeVec(doc);
+  return 0;
+}